@@ -0,0 +1,474 @@
+/**
+ * Native counterpart of `sblogs/process.py`.
+ *
+ * Raw logs of a single run easily reach hundreds of megabytes, most of which
+ * belongs to other processes or to fields we do not care about. Instead of
+ * parsing the JSON, we search for the `eventMessage` keys and only decode the
+ * messages containing the PID marker of the process we are interested in.
+ */
+
+#include "log_ingest.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static const char *find_substring_scalar(const char *haystack, size_t haystack_size, const char *needle, size_t needle_size)
+{
+    const char *end = haystack + haystack_size;
+    const char *candidate = haystack;
+    while (static_cast<size_t>(end - candidate) >= needle_size) {
+        candidate = static_cast<const char *>(memchr(candidate, needle[0], end - candidate - needle_size + 1));
+        if (candidate == nullptr) {
+            return nullptr;
+        }
+        if (!memcmp(candidate + 1, needle + 1, needle_size - 1)) {
+            return candidate;
+        }
+        ++candidate;
+    }
+    return nullptr;
+}
+
+/**
+ * Candidate positions are those where both the first and the last byte of the
+ * needle match, which rules out almost all positions for the needles we use.
+ * Sixteen positions are tested at once; the remaining ones are left to the
+ * scalar implementation.
+ */
+const char *find_substring(const char *haystack, size_t haystack_size, const char *needle, size_t needle_size)
+{
+    if (needle_size == 0) {
+        return haystack;
+    }
+    if (needle_size > haystack_size) {
+        return nullptr;
+    }
+    if (needle_size == 1) {
+        return static_cast<const char *>(memchr(haystack, needle[0], haystack_size));
+    }
+
+    size_t offset = 0;
+
+#if defined(__SSE2__)
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_size - 1]);
+    for (; offset + needle_size - 1 + 16 <= haystack_size; offset += 16) {
+        const __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + offset));
+        const __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + offset + needle_size - 1));
+        unsigned mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last))
+        );
+        while (mask != 0) {
+            const char *candidate = haystack + offset + __builtin_ctz(mask);
+            if (!memcmp(candidate + 1, needle + 1, needle_size - 2)) {
+                return candidate;
+            }
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t first = vdupq_n_u8(needle[0]);
+    const uint8x16_t last = vdupq_n_u8(needle[needle_size - 1]);
+    for (; offset + needle_size - 1 + 16 <= haystack_size; offset += 16) {
+        const uint8x16_t block_first = vld1q_u8(reinterpret_cast<const uint8_t *>(haystack + offset));
+        const uint8x16_t block_last = vld1q_u8(reinterpret_cast<const uint8_t *>(haystack + offset + needle_size - 1));
+        const uint8x16_t matches = vandq_u8(vceqq_u8(block_first, first), vceqq_u8(block_last, last));
+        // NEON has no movemask, narrowing leaves four bits per position.
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+        while (mask != 0) {
+            const unsigned position = __builtin_ctzll(mask) / 4;
+            const char *candidate = haystack + offset + position;
+            if (!memcmp(candidate + 1, needle + 1, needle_size - 2)) {
+                return candidate;
+            }
+            mask &= ~(0xfULL << (4 * position));
+        }
+    }
+#endif
+
+    return find_substring_scalar(haystack + offset, haystack_size - offset, needle, needle_size);
+}
+
+static bool starts_with(const std::string &s, const std::string &prefix)
+{
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+/**
+ * Whether `s` contains "allow(N)" or "deny(N)" for some number N at `pos`.
+ */
+static bool action_with_code_at(const std::string &s, size_t pos, const std::string &action)
+{
+    if (s.compare(pos, action.size() + 1, action + "(") != 0) {
+        return false;
+    }
+    size_t digits_end = pos + action.size() + 1;
+    while (digits_end < s.size() && s[digits_end] >= '0' && s[digits_end] <= '9') {
+        ++digits_end;
+    }
+    return digits_end > pos + action.size() + 1 && digits_end < s.size() && s[digits_end] == ')';
+}
+
+/**
+ * See `parse_action_field` in `sblogs/process.py`.
+ */
+static std::string parse_action_field(const std::string &action_part)
+{
+    if (action_part == "allow" || action_part == "deny") {
+        return action_part;
+    }
+
+    for (size_t pos = 0; pos < action_part.size(); ++pos) {
+        if (action_with_code_at(action_part, pos, "allow")) {
+            return "allow";
+        }
+        if (action_with_code_at(action_part, pos, "deny")) {
+            return "deny";
+        }
+    }
+    return "";
+}
+
+/**
+ * Splits a file-issue-extension argument of the form "target: X class: Y",
+ * where the spaces after the colons are missing on Catalina. Mirrors the
+ * (greedy) regex used in `sblogs/process.py`.
+ */
+static bool parse_extension_argument(const std::string &argument, std::string &target, std::string &cls)
+{
+    static const std::string target_prefix = "target:";
+    static const std::string class_prefix = " class:";
+
+    if (!starts_with(argument, target_prefix)) {
+        return false;
+    }
+    size_t target_begin = target_prefix.size();
+    if (target_begin < argument.size() && argument[target_begin] == ' ') {
+        ++target_begin;
+    }
+
+    // Neither target nor class extend across lines.
+    size_t line_end = argument.find('\n', target_begin);
+    if (line_end == std::string::npos) {
+        line_end = argument.size();
+    }
+    if (line_end < target_begin + class_prefix.size()) {
+        return false;
+    }
+    const size_t class_pos = argument.rfind(class_prefix, line_end - class_prefix.size());
+    if (class_pos == std::string::npos || class_pos < target_begin) {
+        return false;
+    }
+
+    size_t class_begin = class_pos + class_prefix.size();
+    if (class_begin < argument.size() && argument[class_begin] == ' ') {
+        ++class_begin;
+    }
+    size_t class_end = argument.find('\n', class_begin);
+    if (class_end == std::string::npos) {
+        class_end = argument.size();
+    }
+
+    target = argument.substr(target_begin, class_pos - target_begin);
+    cls = argument.substr(class_begin, class_end - class_begin);
+    return true;
+}
+
+bool convert_log_message(const std::string &msg, processed_log &out, std::string &error)
+{
+    const size_t allow_pos = msg.find(") allow");
+    const size_t deny_pos = msg.find(") deny");
+
+    // Make sure our simple heuristics will not be fooled.
+    if ((allow_pos == std::string::npos) == (deny_pos == std::string::npos)) {
+        error = "Expected exactly one decision in log message: " + msg;
+        return false;
+    }
+
+    // Simply look for "allow" or "deny", then go from there and ignore the prefix.
+    const std::string relevant_part = msg.substr((allow_pos != std::string::npos ? allow_pos : deny_pos) + 2);
+
+    // At least the decision and the operation should be specified...
+    const size_t operation_begin = relevant_part.find(' ');
+    if (operation_begin == std::string::npos) {
+        error = "Missing operation in log message: " + msg;
+        return false;
+    }
+    const size_t operation_end = relevant_part.find(' ', operation_begin + 1);
+
+    out.action = parse_action_field(relevant_part.substr(0, operation_begin));
+    out.operation = relevant_part.substr(operation_begin + 1, operation_end - (operation_begin + 1));
+    out.has_argument = operation_end != std::string::npos;
+    out.argument = out.has_argument ? relevant_part.substr(operation_end + 1) : "";
+
+    // The log format has changed in Catalina. There is no space between the
+    // operation and the argument, eg.: network-outbound*:443
+    static const char *network_ops[] = {"network-bind", "network-inbound", "network-outbound"};
+    for (const char *network_op : network_ops) {
+        if (!starts_with(out.operation, network_op)) {
+            continue;
+        }
+        if (out.operation != network_op) {
+            if (out.has_argument) {
+                error = "Unexpected argument for network operation in log message: " + msg;
+                return false;
+            }
+            out.argument = out.operation.substr(strlen(network_op));
+            out.has_argument = true;
+            out.operation = network_op;
+        }
+        break;
+    }
+
+    if (out.operation == "file-issue-extension") {
+        // The log format has changed in Catalina, no space after names for
+        // arguments. Add the space, so that processed logs are uniform.
+        std::string target;
+        std::string cls;
+        if (!out.has_argument
+            || out.argument.find(' ') == std::string::npos
+            || !parse_extension_argument(out.argument, target, cls)) {
+            error = "Unexpected file-issue-extension argument in log message: " + msg;
+            return false;
+        }
+        out.argument = "target: " + target + " class: " + cls;
+    }
+
+    return true;
+}
+
+static void append_utf8(uint32_t code_point, std::string &out)
+{
+    if (code_point < 0x80) {
+        out += static_cast<char>(code_point);
+    } else if (code_point < 0x800) {
+        out += static_cast<char>(0xc0 | (code_point >> 6));
+        out += static_cast<char>(0x80 | (code_point & 0x3f));
+    } else if (code_point < 0x10000) {
+        out += static_cast<char>(0xe0 | (code_point >> 12));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (code_point & 0x3f));
+    } else {
+        out += static_cast<char>(0xf0 | (code_point >> 18));
+        out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3f));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (code_point & 0x3f));
+    }
+}
+
+static bool parse_hex4(const char *p, const char *end, uint32_t &value)
+{
+    if (end - p < 4) {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+        const char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Decodes the contents of a JSON string literal, without the quotes.
+ */
+static bool decode_json_string(const char *p, const char *end, std::string &out)
+{
+    out.clear();
+    out.reserve(end - p);
+    while (p < end) {
+        const char *backslash = static_cast<const char *>(memchr(p, '\\', end - p));
+        if (backslash == nullptr) {
+            out.append(p, end);
+            return true;
+        }
+        out.append(p, backslash);
+        p = backslash + 1;
+        if (p == end) {
+            return false;
+        }
+
+        switch (*p++) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                uint32_t code_point = 0;
+                if (!parse_hex4(p, end, code_point)) {
+                    return false;
+                }
+                p += 4;
+                if (code_point >= 0xd800 && code_point < 0xdc00) {
+                    uint32_t low = 0;
+                    if (end - p < 2 || p[0] != '\\' || p[1] != 'u' || !parse_hex4(p + 2, end, low)
+                        || low < 0xdc00 || low >= 0xe000) {
+                        return false;
+                    }
+                    p += 6;
+                    code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+                }
+                append_utf8(code_point, out);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Returns the closing quote of the string literal starting at `p`.
+ */
+static const char *find_string_end(const char *p, const char *end)
+{
+    while (p < end) {
+        const char *quote = static_cast<const char *>(memchr(p, '"', end - p));
+        if (quote == nullptr) {
+            return nullptr;
+        }
+        size_t backslashes = 0;
+        while (quote - backslashes > p && quote[-1 - static_cast<ptrdiff_t>(backslashes)] == '\\') {
+            ++backslashes;
+        }
+        if (backslashes % 2 == 0) {
+            return quote;
+        }
+        p = quote + 1;
+    }
+    return nullptr;
+}
+
+static const char *skip_whitespace(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        ++p;
+    }
+    return p;
+}
+
+bool ingest_raw_logs(
+    const char *data,
+    size_t size,
+    long pid,
+    const processed_log_handler &handler,
+    std::string &error)
+{
+    static const char key[] = "\"eventMessage\"";
+    static const size_t key_size = sizeof(key) - 1;
+
+    // Sandbox messages are of the following form: .... (Processname)(PID) ...
+    const std::string marker = "(" + std::to_string(pid) + ")";
+
+    const char *end = data + size;
+    const char *p = data;
+    std::string msg;
+    processed_log log;
+
+    while ((p = find_substring(p, end - p, key, key_size)) != nullptr) {
+        p = skip_whitespace(p + key_size, end);
+        if (p == end || *p != ':') {
+            // Not a key, but a value that happens to be "eventMessage".
+            continue;
+        }
+        p = skip_whitespace(p + 1, end);
+        if (p == end || *p != '"') {
+            // Messages that are not strings cannot be sandbox messages.
+            continue;
+        }
+
+        const char *value_begin = p + 1;
+        const char *value_end = find_string_end(value_begin, end);
+        if (value_end == nullptr) {
+            error = "Unterminated eventMessage at offset " + std::to_string(value_begin - data);
+            return false;
+        }
+        p = value_end + 1;
+
+        // Neither the marker nor the decisions contain characters that need
+        // to be escaped, so we can search the message before decoding it.
+        const size_t value_size = value_end - value_begin;
+        if (find_substring(value_begin, value_size, marker.data(), marker.size()) == nullptr) {
+            continue;
+        }
+        if (find_substring(value_begin, value_size, "allow", 5) == nullptr
+            && find_substring(value_begin, value_size, "deny", 4) == nullptr) {
+            continue;
+        }
+
+        if (!decode_json_string(value_begin, value_end, msg)) {
+            error = "Invalid string escape in eventMessage at offset " + std::to_string(value_begin - data);
+            return false;
+        }
+        if (!convert_log_message(msg, log, error)) {
+            return false;
+        }
+        handler(log);
+    }
+
+    return true;
+}
+
+static void append_json_string(const std::string &s, std::string &out)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    out += '"';
+    for (const char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out += "\\u00";
+                    out += hex[(c >> 4) & 0xf];
+                    out += hex[c & 0xf];
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+void append_processed_log_json(const processed_log &log, std::string &out)
+{
+    out += "{\"action\":";
+    if (log.action.empty()) {
+        out += "null";
+    } else {
+        append_json_string(log.action, out);
+    }
+    out += ",\"operation\":";
+    append_json_string(log.operation, out);
+    if (log.has_argument) {
+        out += ",\"argument\":";
+        append_json_string(log.argument, out);
+    }
+    out += "}\n";
+}
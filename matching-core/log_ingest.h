@@ -0,0 +1,55 @@
+#ifndef LOG_INGEST_H
+#define LOG_INGEST_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+/**
+ * A log entry as produced by `sblogs/process.py`. The action is empty if it
+ * could not be parsed, which `process.py` reports as None.
+ */
+struct processed_log {
+    std::string action;
+    std::string operation;
+    std::string argument;
+    bool has_argument = false;
+};
+
+/**
+ * Returns a pointer to the first occurrence of `needle` in `haystack`, or
+ * nullptr. Uses SSE2 or NEON to find candidate positions if available.
+ */
+const char *find_substring(const char *haystack, size_t haystack_size, const char *needle, size_t needle_size);
+
+/**
+ * Converts the message of a sandbox log entry into a processed log entry.
+ * Mirrors `convert_log_entry` in `sblogs/process.py`, including the fixes for
+ * the log format of Catalina. Returns false and sets `error` if the message
+ * does not have the expected format.
+ */
+bool convert_log_message(const std::string &msg, processed_log &out, std::string &error);
+
+typedef std::function<void(const processed_log &)> processed_log_handler;
+
+/**
+ * Scans the output of `log show --style json` for sandbox messages of the
+ * process with the given PID and passes them to `handler` in order. Only the
+ * `eventMessage` fields are looked at; the rest of the JSON is skipped without
+ * parsing it. Returns false and sets `error` on malformed input.
+ */
+bool ingest_raw_logs(
+    const char *data,
+    size_t size,
+    long pid,
+    const processed_log_handler &handler,
+    std::string &error
+);
+
+/**
+ * Appends `log` to `out` as a single line of JSON, in the representation used
+ * by `sblogs/process.py`.
+ */
+void append_processed_log_json(const processed_log &log, std::string &out);
+
+#endif
@@ -0,0 +1,266 @@
+/**
+ * Compressed sparse row storage of rule × log match matrices.
+ *
+ * Rules rarely match more than a small fraction of the unique log entries,
+ * and the columns a rule matches tend to cluster, because log entries of the
+ * same operation are often logged together. Delta-coding the ascending column
+ * indices as varints therefore stores most of them in a single byte.
+ */
+
+#include "match_matrix.h"
+
+#include <cstring>
+#include <utility>
+
+static const char MAGIC[4] = {'S', 'B', 'M', 'X'};
+
+static void append_varint(std::vector<uint8_t> &out, uint32_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+/**
+ * Decodes a varint starting at `pos`, which is advanced past it. Returns false
+ * if the varint is truncated or does not fit 32 bits.
+ */
+static bool read_varint(const uint8_t *data, size_t size, size_t &pos, uint32_t &value)
+{
+    value = 0;
+    for (unsigned shift = 0; shift < 35; shift += 7) {
+        if (pos >= size) {
+            return false;
+        }
+        const uint8_t byte = data[pos++];
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return shift < 28 || (byte >> 4) == 0;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+static void append_le(std::string &out, T value)
+{
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+template <typename T>
+static T read_le(const char *data)
+{
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        value |= static_cast<T>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+uint32_t match_matrix_rows(const match_matrix &matrix)
+{
+    return static_cast<uint32_t>(matrix.row_nnz.size() - 1);
+}
+
+uint64_t match_matrix_nnz(const match_matrix &matrix)
+{
+    return matrix.row_nnz.back();
+}
+
+void match_matrix_append_row(match_matrix &matrix, const std::vector<uint32_t> &columns)
+{
+    uint32_t last = 0;
+    for (const uint32_t col : columns) {
+        append_varint(matrix.deltas, col - last);
+        last = col;
+    }
+    matrix.row_nnz.push_back(matrix.row_nnz.back() + columns.size());
+    matrix.row_bytes.push_back(matrix.deltas.size());
+}
+
+/**
+ * Calls `visit` for every column of a row, in ascending order. The matrix is
+ * assumed to be valid, see `match_matrix_deserialise`.
+ */
+template <typename Visitor>
+static void visit_row(const match_matrix &matrix, uint32_t row, Visitor visit)
+{
+    const uint8_t *data = matrix.deltas.data();
+    size_t pos = matrix.row_bytes[row];
+    const size_t end = matrix.row_bytes[row + 1];
+    uint32_t col = 0;
+    uint32_t delta = 0;
+    while (pos < end && read_varint(data, end, pos, delta)) {
+        col += delta;
+        visit(col);
+    }
+}
+
+std::vector<uint32_t> match_matrix_row(const match_matrix &matrix, uint32_t row)
+{
+    std::vector<uint32_t> columns;
+    columns.reserve(match_matrix_row_popcount(matrix, row));
+    visit_row(matrix, row, [&columns](uint32_t col) {
+        columns.push_back(col);
+    });
+    return columns;
+}
+
+uint64_t match_matrix_row_popcount(const match_matrix &matrix, uint32_t row)
+{
+    return matrix.row_nnz[row + 1] - matrix.row_nnz[row];
+}
+
+std::vector<uint32_t> match_matrix_column(const match_matrix &matrix, uint32_t col)
+{
+    std::vector<uint32_t> rows;
+    for (uint32_t row = 0; row < match_matrix_rows(matrix); ++row) {
+        bool found = false;
+        visit_row(matrix, row, [&found, col](uint32_t c) {
+            found = found || c == col;
+        });
+        if (found) {
+            rows.push_back(row);
+        }
+    }
+    return rows;
+}
+
+std::vector<uint64_t> match_matrix_column_popcounts(const match_matrix &matrix)
+{
+    std::vector<uint64_t> counts(matrix.cols, 0);
+    for (uint32_t row = 0; row < match_matrix_rows(matrix); ++row) {
+        visit_row(matrix, row, [&counts](uint32_t col) {
+            ++counts[col];
+        });
+    }
+    return counts;
+}
+
+match_matrix match_matrix_transpose(const match_matrix &matrix)
+{
+    std::vector<std::vector<uint32_t>> columns(matrix.cols);
+    for (uint32_t row = 0; row < match_matrix_rows(matrix); ++row) {
+        visit_row(matrix, row, [&columns, row](uint32_t col) {
+            columns[col].push_back(row);
+        });
+    }
+
+    match_matrix transposed;
+    transposed.cols = match_matrix_rows(matrix);
+    for (const std::vector<uint32_t> &rows : columns) {
+        match_matrix_append_row(transposed, rows);
+    }
+    return transposed;
+}
+
+void match_matrix_serialise(const match_matrix &matrix, std::string &out)
+{
+    out.append(MAGIC, sizeof(MAGIC));
+    append_le<uint32_t>(out, MATCH_MATRIX_VERSION);
+    append_le<uint32_t>(out, match_matrix_rows(matrix));
+    append_le<uint32_t>(out, matrix.cols);
+    append_le<uint32_t>(out, matrix.log_columns.size());
+    append_le<uint32_t>(out, 0);
+    for (const uint64_t nnz : matrix.row_nnz) {
+        append_le<uint64_t>(out, nnz);
+    }
+    for (const uint64_t bytes : matrix.row_bytes) {
+        append_le<uint64_t>(out, bytes);
+    }
+    for (const uint32_t col : matrix.log_columns) {
+        append_le<uint32_t>(out, col);
+    }
+    out.append(reinterpret_cast<const char *>(matrix.deltas.data()), matrix.deltas.size());
+}
+
+bool match_matrix_deserialise(const char *data, size_t size, match_matrix &matrix, std::string &error)
+{
+    const size_t header_size = sizeof(MAGIC) + 5 * sizeof(uint32_t);
+    if (size < header_size || memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+        error = "Not a match matrix";
+        return false;
+    }
+    const uint32_t version = read_le<uint32_t>(data + 4);
+    if (version != MATCH_MATRIX_VERSION) {
+        error = "Unsupported match matrix version " + std::to_string(version);
+        return false;
+    }
+    const uint64_t rows = read_le<uint32_t>(data + 8);
+    const uint32_t cols = read_le<uint32_t>(data + 12);
+    const uint64_t logs = read_le<uint32_t>(data + 16);
+
+    const uint64_t tables_size = 2 * (rows + 1) * sizeof(uint64_t) + logs * sizeof(uint32_t);
+    if (size - header_size < tables_size) {
+        error = "Truncated match matrix";
+        return false;
+    }
+
+    match_matrix parsed;
+    parsed.cols = cols;
+    parsed.row_nnz.resize(rows + 1);
+    parsed.row_bytes.resize(rows + 1);
+    parsed.log_columns.resize(logs);
+
+    const char *pos = data + header_size;
+    for (uint64_t &nnz : parsed.row_nnz) {
+        nnz = read_le<uint64_t>(pos);
+        pos += sizeof(uint64_t);
+    }
+    for (uint64_t &bytes : parsed.row_bytes) {
+        bytes = read_le<uint64_t>(pos);
+        pos += sizeof(uint64_t);
+    }
+    for (uint32_t &col : parsed.log_columns) {
+        col = read_le<uint32_t>(pos);
+        pos += sizeof(uint32_t);
+        if (col >= cols) {
+            error = "Log column out of range";
+            return false;
+        }
+    }
+
+    const size_t deltas_size = data + size - pos;
+    if (parsed.row_nnz[0] != 0 || parsed.row_bytes[0] != 0 || parsed.row_bytes[rows] != deltas_size) {
+        error = "Inconsistent match matrix tables";
+        return false;
+    }
+    parsed.deltas.assign(reinterpret_cast<const uint8_t *>(pos), reinterpret_cast<const uint8_t *>(pos) + deltas_size);
+
+    // Validate rows once, so queries can rely on them.
+    for (uint64_t row = 0; row < rows; ++row) {
+        const uint64_t begin = parsed.row_bytes[row];
+        const uint64_t end = parsed.row_bytes[row + 1];
+        if (end < begin || end > deltas_size || parsed.row_nnz[row + 1] < parsed.row_nnz[row]) {
+            error = "Inconsistent match matrix tables";
+            return false;
+        }
+        size_t offset = begin;
+        uint64_t count = 0;
+        uint64_t col = 0;
+        uint32_t delta = 0;
+        while (offset < end) {
+            if (!read_varint(parsed.deltas.data(), end, offset, delta)) {
+                error = "Malformed column delta in row " + std::to_string(row);
+                return false;
+            }
+            col += delta;
+            if (col >= cols || (count != 0 && delta == 0)) {
+                error = "Column out of range in row " + std::to_string(row);
+                return false;
+            }
+            ++count;
+        }
+        if (count != parsed.row_nnz[row + 1] - parsed.row_nnz[row]) {
+            error = "Inconsistent entry count in row " + std::to_string(row);
+            return false;
+        }
+    }
+
+    matrix = std::move(parsed);
+    return true;
+}
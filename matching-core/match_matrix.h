@@ -0,0 +1,91 @@
+#ifndef MATCH_MATRIX_H
+#define MATCH_MATRIX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Sparse matrix recording which rules of a profile match which log entries,
+ * independent of the rules' actions. Rows are rules, columns are unique
+ * (operation, argument) pairs of the logs. `log_columns` maps every log entry
+ * to its column.
+ *
+ * The matrix is stored in compressed sparse row form. The column indices of a
+ * row are ascending and delta-coded as LEB128 varints, the first relative to
+ * 0. `row_nnz` and `row_bytes` hold, for every row, the number of entries and
+ * the offset into `deltas` preceding it, plus a final total.
+ */
+struct match_matrix {
+    uint32_t cols = 0;
+    std::vector<uint64_t> row_nnz = {0};
+    std::vector<uint64_t> row_bytes = {0};
+    std::vector<uint8_t> deltas;
+    std::vector<uint32_t> log_columns;
+};
+
+/**
+ * Version of the binary format written by `match_matrix_serialise`.
+ *
+ * Layout, all integers little-endian:
+ *   char     magic[4] = "SBMX"
+ *   uint32_t version
+ *   uint32_t rows, cols, logs
+ *   uint32_t reserved (0)
+ *   uint64_t row_nnz[rows + 1]
+ *   uint64_t row_bytes[rows + 1]
+ *   uint32_t log_columns[logs]
+ *   uint8_t  deltas[row_bytes[rows]]
+ */
+#define MATCH_MATRIX_VERSION 1
+
+uint32_t match_matrix_rows(const match_matrix &matrix);
+
+uint64_t match_matrix_nnz(const match_matrix &matrix);
+
+/**
+ * Appends a row. `columns` has to be ascending and below `matrix.cols`.
+ */
+void match_matrix_append_row(match_matrix &matrix, const std::vector<uint32_t> &columns);
+
+/**
+ * Returns the columns of a row, i.e. the log columns a rule matches.
+ */
+std::vector<uint32_t> match_matrix_row(const match_matrix &matrix, uint32_t row);
+
+/**
+ * Returns the number of columns a rule matches, without decoding the row.
+ */
+uint64_t match_matrix_row_popcount(const match_matrix &matrix, uint32_t row);
+
+/**
+ * Returns the rows matching a column, i.e. the rules matching a log column.
+ * Decodes all rows; use `match_matrix_column_popcounts` or
+ * `match_matrix_transpose` for more than a few columns.
+ */
+std::vector<uint32_t> match_matrix_column(const match_matrix &matrix, uint32_t col);
+
+/**
+ * Returns the number of rules matching each column.
+ */
+std::vector<uint64_t> match_matrix_column_popcounts(const match_matrix &matrix);
+
+/**
+ * Returns the transposed matrix, in which rows are columns and vice versa.
+ * `log_columns` is left empty.
+ */
+match_matrix match_matrix_transpose(const match_matrix &matrix);
+
+/**
+ * Appends the binary representation of the matrix to `out`.
+ */
+void match_matrix_serialise(const match_matrix &matrix, std::string &out);
+
+/**
+ * Parses the binary representation of a matrix. Returns false and sets
+ * `error` if the data is malformed or of another version.
+ */
+bool match_matrix_deserialise(const char *data, size_t size, match_matrix &matrix, std::string &error);
+
+#endif
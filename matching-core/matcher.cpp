@@ -8,181 +8,153 @@
  * boolean values, indicating whether a sandbox decision derived from a
  * processed log entry leads to the same decision as the log entry itself.
  *
- * Here, we make use of sandbox interna:
- * We check using sandbox_check API whether the input is allowed or not. If
- * that is unsuccessful we try to perform selected actions and see whether these
- * are permitted.
+ * Options:
+ *   --workers N           Distribute the log entries across N sandboxed worker
+ *                         processes.
+ *   --entry-timeout MS    Give up on log entries taking longer than MS
+ *                         milliseconds to check and report them as unknown.
+ *   --run-timeout MS      Stop performing operations once checking all log
+ *                         entries took longer than MS milliseconds.
+ *   --stats               Output a JSON dictionary containing the results (as
+ *                         `matches`) and counters describing the run (as
+ *                         `stats`) instead.
+ *   --matrix PATH         Instead of checking the logs against the profile,
+ *                         write the matrix of which rules match which log
+ *                         entries to PATH, see match_matrix.h. Outputs a JSON
+ *                         dictionary describing its size.
+ *
+ * The actual checks are implemented in matching.cpp, which is shared with the
+ * `_matcher` Python extension module.
  */
 
-#include <cassert>
+#include <getopt.h>
+
+#include <climits>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 
-#include <sbpldump/convert.h>
-
-#include "sandbox_utils/sandbox_utils.h"
+#include "matching.h"
 
 using json = nlohmann::json;
 
-enum sandbox_match_status {
-    MATCH_CONSISTENT,
-    MATCH_INCONSISTENT,
-    MATCH_UNKNOWN
-};
-
-typedef decision (*sandbox_check_func)(const json &input);
-
-std::string get_argument(const json &log)
+static bool parse_timeout(const char *name, const char *value, unsigned &timeout_ms)
 {
-    if (log.find("argument") == log.end()) {
-        return "";
+    char *end = nullptr;
+    const long timeout = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || timeout < 0 || timeout > UINT_MAX) {
+        std::cerr << "Invalid " << name << ": " << value << std::endl;
+        return false;
     }
-    return log["argument"];
+    timeout_ms = timeout;
+    return true;
 }
 
-/**
- * Returns the filter type required for sandbox_check for
- * the specified operation. Generally and when defining
- * sandbox profiles, there is no such mapping, because
- * multiple types of filters can be specified for each
- * operation. However, logs of sandbox operations contain
- * a single type of resource for each operation only, and
- * that type of resource has to be given to sandbox_check
- * in order for sandbox_check to succeed.
- *
- * For file* operations, which make up the majority of
- * sandbox log output, we only want to check the PATH.
- * For all other operations, the mapping is not clear and
- * a result of SANDBOX_FILTER_UNKNOWN is returned, and the
- * resulting sandbox_check call should be repeated for each
- * and every filter type. It is worth noting that during testing,
- * quite a few operations could not be checked using sandbox_check,
- * because no matter the flags used, the result was not correct.
- * It is unknown if this is a limitation in Apple's API or if some
- * flags require more complex data structures that we do not construct here
- * (so far, everything is a string.)
- *
- * The performance impact of this measure should be acceptable,
- * because the majority of operations are file-* operations,
- * which we have already seen.
- */
-int sandbox_filter_type_for_op(const char *operation)
+static json stats_to_json(const match_stats &stats)
 {
-    if (!strncmp("file", operation, strlen("file")))
-        return SANDBOX_FILTER_PATH;
-
-    // It is possible to register both local and global names.
-    // However, we don't know which one was registered, because the log
-    // files do not contain that information. Since the default application
-    // profile always allows registering local names, we check only for
-    // global names, to reduce the number of false matches.
-    // Obviously, this increases the number of inconsistent matches (
-    // everything that was previously matched to the local version and
-    // that is not allowed to be global is now matched inconsistently.)
-    if (!strncmp(operation, "mach-register", strlen("mach-register")))
-        return SANDBOX_FILTER_GLOBAL_NAME;
-
-    return SANDBOX_FILTER_UNKNOWN;
+    return {
+        {"entries", stats.entries},
+        {"probes", stats.probes},
+        {"skipped_probes", stats.skipped_probes},
+        {"timeouts", stats.timeouts}
+    };
 }
 
 /**
- * Check whether the input rule is allowed in the current sandbox.
- * Similar functionality to the sandbox_check functionality, however
- * this function encapsulates much of the functionality of parameter
- * choice.
- *
+ * Builds the match matrix and writes it to `path`.
  */
-decision sandbox_check_custom(const json &log, const bool is_allow_default)
+static int write_matrix(const json &profile, const std::vector<log_entry> &logs, const match_options &options, const std::string &path)
 {
-    const std::string &operation = log["operation"];
-    const std::string &argument = get_argument(log);
-    const pid_t pid = getpid();
-    const int filter_type = sandbox_filter_type_for_op(operation.c_str());
-
-    if (argument != "") {
-        if (filter_type == SANDBOX_FILTER_UNKNOWN) {
-            // Try every filter type, return true if any one returned true.
-            // Note: This only works because the sandbox's default decision is deny!
-            // If the default decision were allow, this would basically always return true!
-            // Because, given the following excerpt of a profile:
-            // (allow default)
-            // (deny file* (subpath "/usr"))
-            // sandbox_check would return 0 for basically any invalid filter type
-            if (is_allow_default) {
-                return DECISION_UNKNOWN;
-            }
-
-            for (int current_filter = SANDBOX_FILTER_PATH;
-                 current_filter != SANDBOX_FILTER_UNKNOWN;
-                 ++current_filter) {
-                int res = sandbox_check(pid, operation.c_str(), SANDBOX_CHECK_NO_REPORT | current_filter, argument.c_str());
-                if (res == 0 /* allowed */) {
-                    return DECISION_ALLOW;
-                }
-            }
-
-            // sandbox_check never returned 0, so return false
-            return DECISION_DENY;
-        }
+    match_matrix matrix;
+    match_stats stats;
+    std::string error;
+    if (!matching_build_matrix(profile, logs, matrix, error, options, &stats)) {
+        std::cerr << error << std::endl;
+        return EXIT_FAILURE;
+    }
 
-        const int filter = SANDBOX_CHECK_NO_REPORT | filter_type;
-        const int rv = sandbox_check(pid, operation.c_str(), filter, argument.c_str());
-        if (!(rv == 0 || rv == 1)) {
-            std::cerr << "sandbox_check returned " << rv << ": " << operation << " " << filter << " " << argument << std::endl;
-            return DECISION_ERROR;
-        }
-        return rv == 0 ? DECISION_ALLOW : DECISION_DENY;
-    } else {
-        const int filter = SANDBOX_CHECK_NO_REPORT | SANDBOX_FILTER_NONE;
-        const int rv = sandbox_check(pid, operation.c_str(), filter);
-        if (!(rv == 0 || rv == 1)) {
-            std::cerr << "sandbox_check returned " << rv << ": " << operation << " " << filter << std::endl;
-            return DECISION_ERROR;
-        }
-        return rv == 0 ? DECISION_ALLOW : DECISION_DENY;
+    std::string serialised;
+    match_matrix_serialise(matrix, serialised);
+    std::ofstream out(path, std::ios::binary);
+    out.write(serialised.data(), serialised.size());
+    if (!out.flush()) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return EXIT_FAILURE;
     }
-}
 
-decision sandbox_check_perform(const json &log)
-{
-    const std::string &operation = log["operation"];
-    const std::string &argument = get_argument(log);
-    const pid_t pid = getpid();
-    return sandbox_check_perform(pid, operation.c_str(), 0 /* ignored */, argument.c_str());
+    const json description = {
+        {"rows", match_matrix_rows(matrix)},
+        {"cols", matrix.cols},
+        {"nnz", match_matrix_nnz(matrix)},
+        {"bytes", serialised.size()},
+        {"stats", stats_to_json(stats)}
+    };
+    std::cout << description.dump() << std::endl;
+    return EXIT_SUCCESS;
 }
 
-/**
- * Some operations are checked to leniently if just asking the kernel. Force
- * perfoming a recheck for those.
- */
-bool should_recheck(const json &log)
+static bool parse_options(int argc, char *argv[], match_options &options, bool &print_stats, std::string &matrix_path)
 {
-    const std::string &operation = log["operation"];
-    return operation == "mach_register";
-}
-
-/**
- * Gets the default rule. In case of multiple default rules, the first
- * one is returned.
- */
-json get_default(const json &rulebase)
-{
-    for (const json &rule : rulebase) {
-        for (const std::string &op : rule["operations"]) {
-            if (op == "default") {
-                return rule;
+    static const struct option long_options[] = {
+        {"workers", required_argument, nullptr, 'w'},
+        {"entry-timeout", required_argument, nullptr, 'e'},
+        {"run-timeout", required_argument, nullptr, 'r'},
+        {"stats", no_argument, nullptr, 's'},
+        {"matrix", required_argument, nullptr, 'm'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "w:e:r:sm:", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 'w': {
+                const int workers = atoi(optarg);
+                if (workers < 1 || workers > MATCHING_MAX_WORKERS) {
+                    std::cerr << "Invalid number of workers: " << optarg << std::endl;
+                    return false;
+                }
+                options.workers = workers;
+                break;
             }
+            case 'e':
+                if (!parse_timeout("entry timeout", optarg, options.entry_timeout_ms)) {
+                    return false;
+                }
+                break;
+            case 'r':
+                if (!parse_timeout("run timeout", optarg, options.run_timeout_ms)) {
+                    return false;
+                }
+                break;
+            case 's':
+                print_stats = true;
+                break;
+            case 'm':
+                matrix_path = optarg;
+                break;
+            default:
+                std::cerr << "Usage: " << argv[0]
+                          << " [--workers N] [--entry-timeout MS] [--run-timeout MS] [--stats] [--matrix PATH] < input.json"
+                          << std::endl;
+                return false;
         }
     }
-
-    return json();
+    return true;
 }
 
 int main(int argc, char *argv[])
 {
+    match_options options;
+    bool print_stats = false;
+    std::string matrix_path;
+    if (!parse_options(argc, argv, options, print_stats, matrix_path)) {
+        return EXIT_FAILURE;
+    }
+
     // Read JSON input
     std::string input_raw;
     std::string line;
@@ -201,69 +173,38 @@ int main(int argc, char *argv[])
     }
 
     const json profile = input["sandbox_profile"];
-    const json logs = input["processed_logs"];
+    const std::vector<log_entry> logs = log_entries_from_json(input["processed_logs"]);
+
+    if (!matrix_path.empty()) {
+        return write_matrix(profile, logs, options, matrix_path);
+    }
 
-    const json default_rule = get_default(profile);
-    const bool is_allow_default = !default_rule.is_null() && default_rule["action"] == "allow";
+    // Time budgets are enforced by killing workers, so the sandbox is then
+    // only installed in the workers, whatever the profile says about forking.
+    const bool isolated = options.entry_timeout_ms != 0 || options.run_timeout_ms != 0;
 
     // Setup sandbox
-    const char *sbpl = sandbox_rules_dump_scheme(profile.dump().c_str());
-    char *error = nullptr;
-    const int rv = sandbox_init_with_parameters(sbpl, 0, nullptr, &error);
-    if (rv != 0) {
-        std::cerr << "Failed to initialise sandbox: " << error << std::endl;
+    std::string error;
+    if (!isolated && !matching_install_profile(profile, error)) {
+        std::cerr << error << std::endl;
         return EXIT_FAILURE;
     }
-    assert(rv == 0);
-    assert(error == nullptr);
 
     // Batch process logs
-    std::vector<sandbox_match_status> matches;
-    matches.reserve(logs.size());
-    for (size_t i = 0; i < logs.size(); ++i) {
-        const json &log = logs[i];
-        const enum decision decision = sandbox_check_custom(log, is_allow_default);
-
-        if (decision == DECISION_ERROR) {
-            std::cerr << "Failed to check log entry #" << i << ":" << std::endl;
-            std::cerr << "  Log:       " << log.dump() << std::endl;
-            std::cerr << "  Last Rule: " << profile[profile.size() - 1].dump() << std::endl;
-            return EXIT_FAILURE;
-        }
-
-        auto is_consistent = [](const enum decision decision, const json &log) {
-            return (decision == DECISION_ALLOW && log["action"] == "allow")
-                || (decision == DECISION_DENY && log["action"] == "deny");
-        };
-
-        if (is_consistent(decision, log) && !should_recheck(log)) {
-            matches.push_back(MATCH_CONSISTENT);
-        } else {
-            // Actually try to perform operation with given arguments instead of
-            // asking the kernel whether the operation would be allowed.
-            const enum decision performed_decision = sandbox_check_perform(log);
-
-            if (performed_decision == DECISION_ERROR) {
-                std::cerr << "Failed to re-check log entry #" << i << ":" << std::endl;
-                std::cerr << "  Log:       " << log.dump() << std::endl;
-                std::cerr << "  Last Rule: " << profile[profile.size() - 1].dump() << std::endl;
-                return EXIT_FAILURE;
-            }
-
-            if (performed_decision == DECISION_UNKNOWN) {
-                if (decision == DECISION_UNKNOWN) {
-                    matches.push_back(MATCH_UNKNOWN);
-                } else {
-                    matches.push_back(is_consistent(decision, log) ? MATCH_CONSISTENT : MATCH_INCONSISTENT);
-                }
-            } else {
-                matches.push_back(is_consistent(performed_decision, log) ? MATCH_CONSISTENT : MATCH_INCONSISTENT);
-            }
-        }
-
+    std::vector<sandbox_match_status> matches(logs.size());
+    match_stats stats;
+    const bool checked = isolated
+        ? matching_check_logs_isolated(profile, logs, matches.data(), error, options, &stats)
+        : matching_check_logs(profile, logs, matches.data(), error, options, &stats);
+    if (!checked) {
+        std::cerr << error;
+        return EXIT_FAILURE;
     }
 
     // Output results
+    if (print_stats) {
+        std::cout << "{\"matches\":";
+    }
     std::cout << "[";
     for (std::vector<sandbox_match_status>::iterator it = matches.begin(); it != matches.end(); ++it) {
         if (it != matches.begin()) {
@@ -281,7 +222,11 @@ int main(int argc, char *argv[])
                 break;
         }
     }
-    std::cout << "]" << std::endl;
+    std::cout << "]";
+    if (print_stats) {
+        std::cout << ",\"stats\":" << stats_to_json(stats).dump() << "}";
+    }
+    std::cout << std::endl;
 
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,346 @@
+/**
+ * CPython extension module exposing the matcher to `sblogs/match.py`.
+ *
+ * The module is built from the same sources as the `matcher` executable, but
+ * avoids spawning a process and serialising the processed logs to JSON for
+ * every profile variant. Installing a sandbox profile cannot be undone, which
+ * is why checks are still performed in a forked child. Results are written to
+ * an anonymous shared mapping that is handed back to Python as a read-only
+ * buffer containing one `sandbox_match_status` per log entry.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "matching.h"
+
+using json = nlohmann::json;
+
+static PyObject *MatchError;
+
+/**
+ * Layout of the shared mapping. The result statuses directly follow this
+ * header.
+ */
+struct shared_results {
+    int success;
+    match_stats stats;
+    char error[4096];
+};
+
+typedef struct {
+    PyObject_HEAD
+    void *mapping;
+    size_t mapping_size;
+    sandbox_match_status *results;
+    Py_ssize_t count;
+    PyObject *stats;
+} MatchResultsObject;
+
+static void MatchResults_dealloc(MatchResultsObject *self)
+{
+    if (self->mapping != nullptr) {
+        munmap(self->mapping, self->mapping_size);
+    }
+    Py_XDECREF(self->stats);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int MatchResults_getbuffer(MatchResultsObject *self, Py_buffer *view, int flags)
+{
+    return PyBuffer_FillInfo(view, (PyObject *)self, self->results, self->count, 1 /* readonly */, flags);
+}
+
+static Py_ssize_t MatchResults_length(MatchResultsObject *self)
+{
+    return self->count;
+}
+
+static PyObject *MatchResults_get_stats(MatchResultsObject *self, void *closure)
+{
+    Py_INCREF(self->stats);
+    return self->stats;
+}
+
+static PyGetSetDef MatchResults_getset[] = {
+    {"stats", (getter)MatchResults_get_stats, nullptr, "Counters describing the run, as a dict.", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr}
+};
+
+static PyBufferProcs MatchResults_as_buffer = {
+    (getbufferproc)MatchResults_getbuffer,
+    nullptr,
+};
+
+static PySequenceMethods MatchResults_as_sequence = {
+    (lenfunc)MatchResults_length,
+};
+
+static PyTypeObject MatchResultsType = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+    "_matcher.MatchResults",
+};
+
+/**
+ * Reads a string value from a processed log entry. Missing optional values
+ * are returned as empty strings.
+ */
+static bool log_string(PyObject *log, const char *key, bool required, std::string &out)
+{
+    PyObject *value = PyMapping_GetItemString(log, key);
+    if (value == nullptr) {
+        if (!required && PyErr_ExceptionMatches(PyExc_KeyError)) {
+            PyErr_Clear();
+            out.clear();
+            return true;
+        }
+        return false;
+    }
+
+    Py_ssize_t size = 0;
+    const char *data = PyUnicode_AsUTF8AndSize(value, &size);
+    if (data != nullptr) {
+        out.assign(data, size);
+    }
+    Py_DECREF(value);
+    return data != nullptr;
+}
+
+static bool log_entries_from_python(PyObject *logs, std::vector<log_entry> &entries)
+{
+    PyObject *sequence = PySequence_Fast(logs, "processed logs have to be a sequence");
+    if (sequence == nullptr) {
+        return false;
+    }
+
+    const Py_ssize_t count = PySequence_Fast_GET_SIZE(sequence);
+    entries.resize(count);
+    for (Py_ssize_t i = 0; i < count; ++i) {
+        PyObject *log = PySequence_Fast_GET_ITEM(sequence, i);
+        log_entry &entry = entries[i];
+        if (!log_string(log, "action", true, entry.action)
+            || !log_string(log, "operation", true, entry.operation)
+            || !log_string(log, "argument", false, entry.argument)) {
+            Py_DECREF(sequence);
+            return false;
+        }
+    }
+
+    Py_DECREF(sequence);
+    return true;
+}
+
+/**
+ * Parses a profile passed either as str or as a bytes-like object.
+ */
+static bool profile_from_python(PyObject *obj, json &profile)
+{
+    Py_buffer view;
+    const char *data = nullptr;
+    Py_ssize_t size = 0;
+    bool has_view = false;
+
+    if (PyUnicode_Check(obj)) {
+        data = PyUnicode_AsUTF8AndSize(obj, &size);
+        if (data == nullptr) {
+            return false;
+        }
+    } else {
+        if (PyObject_GetBuffer(obj, &view, PyBUF_SIMPLE) != 0) {
+            return false;
+        }
+        data = static_cast<const char *>(view.buf);
+        size = view.len;
+        has_view = true;
+    }
+
+    bool success = true;
+    try {
+        profile = json::parse(data, data + size);
+    } catch (const json::exception &e) {
+        PyErr_Format(PyExc_ValueError, "Invalid sandbox profile: %s", e.what());
+        success = false;
+    }
+
+    if (has_view) {
+        PyBuffer_Release(&view);
+    }
+    return success;
+}
+
+/**
+ * Runs in the forked child: installs the profile and checks all logs.
+ */
+static void match_child(
+    const json &profile,
+    const std::vector<log_entry> &logs,
+    const match_options &options,
+    shared_results *shared)
+{
+    std::string error;
+    sandbox_match_status *results = reinterpret_cast<sandbox_match_status *>(shared + 1);
+
+    // With time budgets, the child only supervises workers installing the
+    // profile, as it could not fork them once sandboxed itself.
+    const bool isolated = options.entry_timeout_ms != 0 || options.run_timeout_ms != 0;
+    const bool success = isolated
+        ? matching_check_logs_isolated(profile, logs, results, error, options, &shared->stats)
+        : matching_install_profile(profile, error)
+            && matching_check_logs(profile, logs, results, error, options, &shared->stats);
+    if (success) {
+        shared->success = 1;
+        return;
+    }
+    strncpy(shared->error, error.c_str(), sizeof(shared->error) - 1);
+}
+
+static PyObject *matcher_match(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static const char *keywords[] = {"profile", "logs", "workers", "entry_timeout", "run_timeout", nullptr};
+    PyObject *profile_obj = nullptr;
+    PyObject *logs_obj = nullptr;
+    unsigned int workers = 1;
+    unsigned int entry_timeout = 0;
+    unsigned int run_timeout = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|III:match", const_cast<char **>(keywords),
+                                     &profile_obj, &logs_obj, &workers, &entry_timeout, &run_timeout)) {
+        return nullptr;
+    }
+    if (workers < 1 || workers > MATCHING_MAX_WORKERS) {
+        PyErr_Format(PyExc_ValueError, "workers has to be between 1 and %d", MATCHING_MAX_WORKERS);
+        return nullptr;
+    }
+    match_options options;
+    options.workers = workers;
+    options.entry_timeout_ms = entry_timeout;
+    options.run_timeout_ms = run_timeout;
+
+    json profile;
+    std::vector<log_entry> logs;
+    if (!profile_from_python(profile_obj, profile) || !log_entries_from_python(logs_obj, logs)) {
+        return nullptr;
+    }
+
+    const size_t mapping_size = sizeof(shared_results) + logs.size() * sizeof(sandbox_match_status);
+    void *mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_SHARED, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    shared_results *shared = static_cast<shared_results *>(mapping);
+
+    const pid_t pid = fork();
+    if (pid == -1) {
+        munmap(mapping, mapping_size);
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    if (pid == 0) {
+        match_child(profile, logs, options, shared);
+        _exit(shared->success ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    int status = 0;
+    pid_t waited = -1;
+    Py_BEGIN_ALLOW_THREADS
+    do {
+        waited = waitpid(pid, &status, 0);
+    } while (waited == -1 && errno == EINTR);
+    Py_END_ALLOW_THREADS
+
+    if (waited == -1 || !WIFEXITED(status) || !shared->success) {
+        if (shared->error[0] != '\0') {
+            PyErr_SetString(MatchError, shared->error);
+        } else {
+            PyErr_Format(MatchError, "Matcher child terminated abnormally (status %d)", status);
+        }
+        munmap(mapping, mapping_size);
+        return nullptr;
+    }
+
+    PyObject *stats = Py_BuildValue(
+        "{s:K,s:K,s:K,s:K}",
+        "entries", (unsigned long long)shared->stats.entries,
+        "probes", (unsigned long long)shared->stats.probes,
+        "skipped_probes", (unsigned long long)shared->stats.skipped_probes,
+        "timeouts", (unsigned long long)shared->stats.timeouts
+    );
+    if (stats == nullptr) {
+        munmap(mapping, mapping_size);
+        return nullptr;
+    }
+
+    MatchResultsObject *results = PyObject_New(MatchResultsObject, &MatchResultsType);
+    if (results == nullptr) {
+        Py_DECREF(stats);
+        munmap(mapping, mapping_size);
+        return nullptr;
+    }
+    results->mapping = mapping;
+    results->mapping_size = mapping_size;
+    results->results = reinterpret_cast<sandbox_match_status *>(shared + 1);
+    results->count = logs.size();
+    results->stats = stats;
+    return (PyObject *)results;
+}
+
+static PyMethodDef matcher_methods[] = {
+    {
+        "match", (PyCFunction)(void (*)(void))matcher_match, METH_VARARGS | METH_KEYWORDS,
+        "match(profile, logs, workers=1, entry_timeout=0, run_timeout=0) -> MatchResults\n\n"
+        "Check processed logs against a JSON sandbox profile (str or bytes),\n"
+        "distributed across the given number of worker processes. Timeouts\n"
+        "are given in milliseconds, 0 meaning no limit.\n"
+        "The result is a buffer of one MATCH_* status per log entry."
+    },
+    {nullptr, nullptr, 0, nullptr}
+};
+
+static struct PyModuleDef matcher_module = {
+    PyModuleDef_HEAD_INIT,
+    "_matcher",
+    "Native interface to the sandbox matcher.",
+    -1,
+    matcher_methods,
+};
+
+PyMODINIT_FUNC PyInit__matcher(void)
+{
+    MatchResultsType.tp_basicsize = sizeof(MatchResultsObject);
+    MatchResultsType.tp_dealloc = (destructor)MatchResults_dealloc;
+    MatchResultsType.tp_flags = Py_TPFLAGS_DEFAULT;
+    MatchResultsType.tp_doc = "Read-only buffer of match statuses.";
+    MatchResultsType.tp_as_buffer = &MatchResults_as_buffer;
+    MatchResultsType.tp_as_sequence = &MatchResults_as_sequence;
+    MatchResultsType.tp_getset = MatchResults_getset;
+    if (PyType_Ready(&MatchResultsType) < 0) {
+        return nullptr;
+    }
+
+    PyObject *module = PyModule_Create(&matcher_module);
+    if (module == nullptr) {
+        return nullptr;
+    }
+
+    MatchError = PyErr_NewException("_matcher.MatchError", PyExc_RuntimeError, nullptr);
+    Py_INCREF(MatchError);
+    PyModule_AddObject(module, "MatchError", MatchError);
+
+    Py_INCREF(&MatchResultsType);
+    PyModule_AddObject(module, "MatchResults", (PyObject *)&MatchResultsType);
+
+    PyModule_AddIntConstant(module, "MATCH_CONSISTENT", MATCH_CONSISTENT);
+    PyModule_AddIntConstant(module, "MATCH_INCONSISTENT", MATCH_INCONSISTENT);
+    PyModule_AddIntConstant(module, "MATCH_UNKNOWN", MATCH_UNKNOWN);
+
+    return module;
+}
@@ -0,0 +1,768 @@
+/**
+ * Checks whether input log rules are consistent with a given ruleset.
+ *
+ * Here, we make use of sandbox interna:
+ * We check using sandbox_check API whether the input is allowed or not. If
+ * that is unsuccessful we try to perform selected actions and see whether these
+ * are permitted.
+ */
+
+#include "matching.h"
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <iostream>
+#include <new>
+#include <sstream>
+
+#include <sbpldump/convert.h>
+
+#include "sandbox_utils/sandbox_utils.h"
+
+using json = nlohmann::json;
+
+std::vector<log_entry> log_entries_from_json(const json &logs)
+{
+    std::vector<log_entry> entries;
+    entries.reserve(logs.size());
+    for (const json &log : logs) {
+        log_entry entry;
+        entry.action = log["action"];
+        entry.operation = log["operation"];
+        if (log.find("argument") != log.end()) {
+            entry.argument = log["argument"];
+        }
+        entries.push_back(std::move(entry));
+    }
+    return entries;
+}
+
+/**
+ * Returns the filter type required for sandbox_check for
+ * the specified operation. Generally and when defining
+ * sandbox profiles, there is no such mapping, because
+ * multiple types of filters can be specified for each
+ * operation. However, logs of sandbox operations contain
+ * a single type of resource for each operation only, and
+ * that type of resource has to be given to sandbox_check
+ * in order for sandbox_check to succeed.
+ *
+ * For file* operations, which make up the majority of
+ * sandbox log output, we only want to check the PATH.
+ * For all other operations, the mapping is not clear and
+ * a result of SANDBOX_FILTER_UNKNOWN is returned, and the
+ * resulting sandbox_check call should be repeated for each
+ * and every filter type. It is worth noting that during testing,
+ * quite a few operations could not be checked using sandbox_check,
+ * because no matter the flags used, the result was not correct.
+ * It is unknown if this is a limitation in Apple's API or if some
+ * flags require more complex data structures that we do not construct here
+ * (so far, everything is a string.)
+ *
+ * The performance impact of this measure should be acceptable,
+ * because the majority of operations are file-* operations,
+ * which we have already seen.
+ */
+static int sandbox_filter_type_for_op(const char *operation)
+{
+    if (!strncmp("file", operation, strlen("file")))
+        return SANDBOX_FILTER_PATH;
+
+    // It is possible to register both local and global names.
+    // However, we don't know which one was registered, because the log
+    // files do not contain that information. Since the default application
+    // profile always allows registering local names, we check only for
+    // global names, to reduce the number of false matches.
+    // Obviously, this increases the number of inconsistent matches (
+    // everything that was previously matched to the local version and
+    // that is not allowed to be global is now matched inconsistently.)
+    if (!strncmp(operation, "mach-register", strlen("mach-register")))
+        return SANDBOX_FILTER_GLOBAL_NAME;
+
+    return SANDBOX_FILTER_UNKNOWN;
+}
+
+/**
+ * Check whether the input rule is allowed in the current sandbox.
+ * Similar functionality to the sandbox_check functionality, however
+ * this function encapsulates much of the functionality of parameter
+ * choice.
+ *
+ */
+static decision sandbox_check_custom(const log_entry &log, const bool is_allow_default)
+{
+    const std::string &operation = log.operation;
+    const std::string &argument = log.argument;
+    const pid_t pid = getpid();
+    const int filter_type = sandbox_filter_type_for_op(operation.c_str());
+
+    if (argument != "") {
+        if (filter_type == SANDBOX_FILTER_UNKNOWN) {
+            // Try every filter type, return true if any one returned true.
+            // Note: This only works because the sandbox's default decision is deny!
+            // If the default decision were allow, this would basically always return true!
+            // Because, given the following excerpt of a profile:
+            // (allow default)
+            // (deny file* (subpath "/usr"))
+            // sandbox_check would return 0 for basically any invalid filter type
+            if (is_allow_default) {
+                return DECISION_UNKNOWN;
+            }
+
+            for (int current_filter = SANDBOX_FILTER_PATH;
+                 current_filter != SANDBOX_FILTER_UNKNOWN;
+                 ++current_filter) {
+                int res = sandbox_check(pid, operation.c_str(), SANDBOX_CHECK_NO_REPORT | current_filter, argument.c_str());
+                if (res == 0 /* allowed */) {
+                    return DECISION_ALLOW;
+                }
+            }
+
+            // sandbox_check never returned 0, so return false
+            return DECISION_DENY;
+        }
+
+        const int filter = SANDBOX_CHECK_NO_REPORT | filter_type;
+        const int rv = sandbox_check(pid, operation.c_str(), filter, argument.c_str());
+        if (!(rv == 0 || rv == 1)) {
+            std::cerr << "sandbox_check returned " << rv << ": " << operation << " " << filter << " " << argument << std::endl;
+            return DECISION_ERROR;
+        }
+        return rv == 0 ? DECISION_ALLOW : DECISION_DENY;
+    } else {
+        const int filter = SANDBOX_CHECK_NO_REPORT | SANDBOX_FILTER_NONE;
+        const int rv = sandbox_check(pid, operation.c_str(), filter);
+        if (!(rv == 0 || rv == 1)) {
+            std::cerr << "sandbox_check returned " << rv << ": " << operation << " " << filter << std::endl;
+            return DECISION_ERROR;
+        }
+        return rv == 0 ? DECISION_ALLOW : DECISION_DENY;
+    }
+}
+
+/**
+ * Process-shared locks serialising probes that create, modify or remove named
+ * objects. Workers checking log entries for the same name would otherwise
+ * interfere with each other, e.g. by unlinking a semaphore another worker just
+ * created. Names are mapped to stripes by their hash. Each stripe records the
+ * PID of its owner, so that the locks of a worker killed by the watchdog can be
+ * released again.
+ */
+#define NAME_LOCK_STRIPES 64
+
+struct name_locks {
+    std::atomic<pid_t> owners[NAME_LOCK_STRIPES];
+};
+
+static std::atomic<pid_t> &name_lock_for(name_locks *locks, const std::string &name)
+{
+    return locks->owners[std::hash<std::string>()(name) % NAME_LOCK_STRIPES];
+}
+
+static void name_lock_acquire(std::atomic<pid_t> &owner)
+{
+    const pid_t self = getpid();
+    pid_t expected = 0;
+    while (!owner.compare_exchange_weak(expected, self)) {
+        expected = 0;
+        usleep(100);
+    }
+}
+
+static void name_lock_release(std::atomic<pid_t> &owner)
+{
+    owner.store(0);
+}
+
+static void name_locks_release_all(name_locks *locks, pid_t pid)
+{
+    for (size_t i = 0; i < NAME_LOCK_STRIPES; ++i) {
+        pid_t expected = pid;
+        locks->owners[i].compare_exchange_strong(expected, 0);
+    }
+}
+
+/**
+ * Whether performing the operation touches state that is shared between
+ * processes under the name given as argument.
+ */
+static bool performs_on_global_name(const log_entry &log)
+{
+    return !strncmp(log.operation.c_str(), "ipc-posix-", strlen("ipc-posix-"))
+        || !strncmp(log.operation.c_str(), "mach-register", strlen("mach-register"));
+}
+
+static decision sandbox_check_perform(const log_entry &log, name_locks *locks)
+{
+    const pid_t pid = getpid();
+
+    if (locks == nullptr || !performs_on_global_name(log)) {
+        return sandbox_check_perform(pid, log.operation.c_str(), 0 /* ignored */, log.argument.c_str());
+    }
+
+    std::atomic<pid_t> &lock = name_lock_for(locks, log.argument);
+    name_lock_acquire(lock);
+    const decision result = sandbox_check_perform(pid, log.operation.c_str(), 0 /* ignored */, log.argument.c_str());
+    name_lock_release(lock);
+    return result;
+}
+
+/**
+ * Some operations are checked to leniently if just asking the kernel. Force
+ * perfoming a recheck for those.
+ */
+static bool should_recheck(const log_entry &log)
+{
+    return log.operation == "mach_register";
+}
+
+/**
+ * Gets the default rule. In case of multiple default rules, the first
+ * one is returned.
+ */
+static json get_default(const json &rulebase)
+{
+    for (const json &rule : rulebase) {
+        for (const std::string &op : rule["operations"]) {
+            if (op == "default") {
+                return rule;
+            }
+        }
+    }
+
+    return json();
+}
+
+static std::string describe_failure(const char *what, size_t idx, const log_entry &log, const json &profile)
+{
+    std::ostringstream out;
+    out << what << " #" << idx << ":" << std::endl;
+    out << "  Log:       " << log.action << " " << log.operation << " " << log.argument << std::endl;
+    if (!profile.empty()) {
+        out << "  Last Rule: " << profile[profile.size() - 1].dump() << std::endl;
+    }
+    return out.str();
+}
+
+bool matching_install_profile(const json &profile, std::string &error)
+{
+    const char *sbpl = sandbox_rules_dump_scheme(profile.dump().c_str());
+    char *sandbox_error = nullptr;
+    const int rv = sandbox_init_with_parameters(sbpl, 0, nullptr, &sandbox_error);
+    if (rv != 0) {
+        error = std::string("Failed to initialise sandbox: ") + (sandbox_error ? sandbox_error : "unknown error");
+        return false;
+    }
+    return true;
+}
+
+static bool is_consistent(const enum decision decision, const log_entry &log)
+{
+    return (decision == DECISION_ALLOW && log.action == "allow")
+        || (decision == DECISION_DENY && log.action == "deny");
+}
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+static int64_t ms_to_ns(unsigned ms)
+{
+    return static_cast<int64_t>(ms) * 1000000;
+}
+
+/**
+ * Statuses are packed into two bits each. Shards start at multiples of four
+ * entries, so that no two workers ever write to the same byte.
+ */
+#define STATUSES_PER_BYTE 4
+
+static void pack_status(uint8_t *packed, size_t idx, sandbox_match_status status)
+{
+    const unsigned shift = 2 * (idx % STATUSES_PER_BYTE);
+    uint8_t &byte = packed[idx / STATUSES_PER_BYTE];
+    byte = (byte & ~(0x3 << shift)) | (status << shift);
+}
+
+static sandbox_match_status unpack_status(const uint8_t *packed, size_t idx)
+{
+    return static_cast<sandbox_match_status>((packed[idx / STATUSES_PER_BYTE] >> (2 * (idx % STATUSES_PER_BYTE))) & 0x3);
+}
+
+/**
+ * Per-worker area of the shared mapping. While checking an entry, the worker
+ * publishes its index and start time, which the watchdog in the parent uses
+ * to detect entries exceeding their budget.
+ */
+struct worker_state {
+    std::atomic<int64_t> current;
+    std::atomic<int64_t> started_ns;
+    match_stats stats;
+    int success;
+    char error[1024];
+};
+
+/**
+ * Everything needed to check a range of log entries, either in the calling
+ * process or in a worker.
+ */
+struct check_context {
+    const json &profile;
+    const std::vector<log_entry> &logs;
+    bool is_allow_default;
+    // No operations are performed after this point in time, if not 0.
+    int64_t deadline_ns;
+    match_stats &stats;
+    // Profile each worker installs after forking, if the calling process is
+    // not sandboxed itself.
+    const json *install;
+    // Only set when running in a worker process.
+    name_locks *locks;
+    worker_state *worker;
+    uint8_t *packed;
+};
+
+static void store_status(check_context &ctx, sandbox_match_status *results, size_t idx, sandbox_match_status status)
+{
+    if (ctx.packed != nullptr) {
+        pack_status(ctx.packed, idx, status);
+    } else {
+        results[idx] = status;
+    }
+}
+
+/**
+ * Checks the log entries in [begin, end) and stores their status in `results`,
+ * or in the packed statuses when running in a worker.
+ */
+static bool check_log_range(check_context &ctx, size_t begin, size_t end, sandbox_match_status *results, std::string &error)
+{
+    for (size_t i = begin; i < end; ++i) {
+        const log_entry &log = ctx.logs[i];
+
+        if (ctx.worker != nullptr) {
+            ctx.worker->started_ns.store(now_ns());
+            ctx.worker->current.store(i);
+        }
+        ++ctx.stats.entries;
+
+        const enum decision decision = sandbox_check_custom(log, ctx.is_allow_default);
+
+        if (decision == DECISION_ERROR) {
+            error = describe_failure("Failed to check log entry", i, log, ctx.profile);
+            return false;
+        }
+
+        if (is_consistent(decision, log) && !should_recheck(log)) {
+            store_status(ctx, results, i, MATCH_CONSISTENT);
+            continue;
+        }
+
+        // Actually try to perform operation with given arguments instead of
+        // asking the kernel whether the operation would be allowed. Once the
+        // time budget for the run is exhausted, we rely on the kernel alone.
+        enum decision performed_decision = DECISION_UNKNOWN;
+        if (ctx.deadline_ns == 0 || now_ns() < ctx.deadline_ns) {
+            ++ctx.stats.probes;
+            performed_decision = sandbox_check_perform(log, ctx.locks);
+        } else {
+            ++ctx.stats.skipped_probes;
+        }
+
+        if (performed_decision == DECISION_ERROR) {
+            error = describe_failure("Failed to re-check log entry", i, log, ctx.profile);
+            return false;
+        }
+
+        if (performed_decision == DECISION_UNKNOWN) {
+            if (decision == DECISION_UNKNOWN) {
+                store_status(ctx, results, i, MATCH_UNKNOWN);
+            } else {
+                store_status(ctx, results, i, is_consistent(decision, log) ? MATCH_CONSISTENT : MATCH_INCONSISTENT);
+            }
+        } else {
+            store_status(ctx, results, i, is_consistent(performed_decision, log) ? MATCH_CONSISTENT : MATCH_INCONSISTENT);
+        }
+    }
+
+    if (ctx.worker != nullptr) {
+        ctx.worker->current.store(-1);
+    }
+    return true;
+}
+
+/**
+ * Forking while the sandbox denies it gets us killed, see sandbox_utils/signal.c
+ */
+static bool fork_allowed()
+{
+    return sandbox_check(getpid(), "process-fork", SANDBOX_CHECK_NO_REPORT | SANDBOX_FILTER_NONE) == 0;
+}
+
+static void add_stats(match_stats &total, const match_stats &stats)
+{
+    total.entries += stats.entries;
+    total.probes += stats.probes;
+    total.skipped_probes += stats.skipped_probes;
+    total.timeouts += stats.timeouts;
+}
+
+/**
+ * Bookkeeping of the parent for each worker.
+ */
+struct worker_slot {
+    pid_t pid;
+    size_t end;
+};
+
+/**
+ * Forks a worker checking the log entries in [begin, end). Returns the PID of
+ * the worker or -1 if forking failed.
+ */
+static pid_t spawn_worker(check_context &ctx, worker_state *worker, size_t begin, size_t end, sandbox_match_status *results)
+{
+    worker->current.store(-1);
+    worker->stats = match_stats();
+    worker->success = 0;
+    worker->error[0] = '\0';
+
+    const pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+
+    // Statistics are kept in the shared mapping, so that those of a killed
+    // worker are not lost.
+    check_context worker_ctx = {
+        ctx.profile, ctx.logs, ctx.is_allow_default, ctx.deadline_ns, worker->stats, nullptr, ctx.locks, worker, ctx.packed
+    };
+    std::string worker_error;
+    const bool success = (ctx.install == nullptr || matching_install_profile(*ctx.install, worker_error))
+        && check_log_range(worker_ctx, begin, end, results, worker_error);
+    if (!success) {
+        strncpy(worker->error, worker_error.c_str(), sizeof(worker->error) - 1);
+        _exit(EXIT_FAILURE);
+    }
+    worker->success = 1;
+    _exit(EXIT_SUCCESS);
+}
+
+/**
+ * How often the parent looks after its workers.
+ */
+#define WATCHDOG_INTERVAL_US 2000
+
+static bool check_logs_in_workers(
+    check_context &ctx,
+    sandbox_match_status *results,
+    std::string &error,
+    unsigned n_workers,
+    int64_t entry_timeout_ns)
+{
+    const size_t n_logs = ctx.logs.size();
+    const size_t packed_size = (n_logs + STATUSES_PER_BYTE - 1) / STATUSES_PER_BYTE;
+    // Every worker gets at least one byte of statuses.
+    n_workers = std::max<size_t>(1, std::min<size_t>(n_workers, packed_size));
+    const size_t mapping_size = sizeof(name_locks) + n_workers * sizeof(worker_state) + packed_size;
+
+    void *mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_SHARED, -1, 0);
+    if (mapping == MAP_FAILED) {
+        error = std::string("Failed to map shared results: ") + strerror(errno);
+        return false;
+    }
+    ctx.locks = new (mapping) name_locks();
+    worker_state *workers = reinterpret_cast<worker_state *>(ctx.locks + 1);
+    for (unsigned worker = 0; worker < n_workers; ++worker) {
+        new (&workers[worker]) worker_state();
+    }
+    ctx.packed = reinterpret_cast<uint8_t *>(workers + n_workers);
+
+    const size_t shard_bytes = (packed_size + n_workers - 1) / n_workers;
+    const size_t shard_size = shard_bytes * STATUSES_PER_BYTE;
+
+    bool success = true;
+    std::vector<worker_slot> slots(n_workers, worker_slot{-1, 0});
+    for (unsigned worker = 0; success && worker < n_workers; ++worker) {
+        const size_t begin = std::min(n_logs, worker * shard_size);
+        const size_t end = std::min(n_logs, begin + shard_size);
+
+        slots[worker].end = end;
+        slots[worker].pid = spawn_worker(ctx, &workers[worker], begin, end, results);
+        if (slots[worker].pid == -1) {
+            error = std::string("Failed to fork worker: ") + strerror(errno);
+            success = false;
+        }
+    }
+
+    // Wait for the workers, killing those exceeding their budget. A killed
+    // worker is replaced by a new one continuing after the entry it was stuck
+    // at, which is reported as unknown.
+    size_t running = 0;
+    do {
+        running = 0;
+        for (unsigned worker = 0; worker < n_workers; ++worker) {
+            worker_slot &slot = slots[worker];
+            worker_state &state = workers[worker];
+            if (slot.pid == -1) {
+                continue;
+            }
+
+            int status = 0;
+            const pid_t waited = waitpid(slot.pid, &status, WNOHANG);
+            if (waited == -1 && errno == EINTR) {
+                ++running;
+                continue;
+            }
+            if (waited != 0) {
+                slot.pid = -1;
+                add_stats(ctx.stats, state.stats);
+                if (success && (waited == -1 || !WIFEXITED(status) || !state.success)) {
+                    success = false;
+                    error = state.error[0] != '\0'
+                        ? std::string(state.error)
+                        : "Worker " + std::to_string(worker) + " terminated abnormally";
+                }
+                continue;
+            }
+
+            const int64_t current = state.current.load();
+            const int64_t now = now_ns();
+            const bool entry_exceeded = entry_timeout_ns != 0 && now - state.started_ns.load() > entry_timeout_ns;
+            // Entries started after the deadline are not performed and hence
+            // finish quickly; only interrupt probes still running from before.
+            const bool run_exceeded = ctx.deadline_ns != 0 && now > ctx.deadline_ns
+                && state.started_ns.load() < ctx.deadline_ns;
+            if (success && current >= 0 && (entry_exceeded || run_exceeded)) {
+                kill(slot.pid, SIGKILL);
+                while (waitpid(slot.pid, &status, 0) == -1 && errno == EINTR) {
+                }
+                name_locks_release_all(ctx.locks, slot.pid);
+
+                // The worker might have moved on in the meantime
+                const int64_t stuck = state.current.load();
+                if (stuck >= 0) {
+                    pack_status(ctx.packed, stuck, MATCH_UNKNOWN);
+                    ++ctx.stats.timeouts;
+                }
+                add_stats(ctx.stats, state.stats);
+                slot.pid = -1;
+
+                const size_t next = stuck >= 0 ? stuck + 1 : slot.end;
+                if (next < slot.end) {
+                    slot.pid = spawn_worker(ctx, &state, next, slot.end, results);
+                    if (slot.pid == -1) {
+                        error = std::string("Failed to fork worker: ") + strerror(errno);
+                        success = false;
+                    }
+                }
+            }
+
+            if (slot.pid != -1) {
+                ++running;
+            }
+        }
+
+        if (!success) {
+            for (worker_slot &slot : slots) {
+                if (slot.pid != -1) {
+                    kill(slot.pid, SIGKILL);
+                }
+            }
+        }
+        if (running != 0) {
+            usleep(WATCHDOG_INTERVAL_US);
+        }
+    } while (running != 0);
+
+    if (success) {
+        for (size_t i = 0; i < n_logs; ++i) {
+            results[i] = unpack_status(ctx.packed, i);
+        }
+    }
+
+    munmap(mapping, mapping_size);
+    return success;
+}
+
+static check_context make_context(
+    const json &profile,
+    const std::vector<log_entry> &logs,
+    const match_options &options,
+    match_stats &stats)
+{
+    const json default_rule = get_default(profile);
+    const bool is_allow_default = !default_rule.is_null() && default_rule["action"] == "allow";
+    const int64_t deadline_ns = options.run_timeout_ms != 0 ? now_ns() + ms_to_ns(options.run_timeout_ms) : 0;
+
+    return check_context{
+        profile, logs, is_allow_default, deadline_ns, stats, nullptr, nullptr, nullptr, nullptr
+    };
+}
+
+static unsigned worker_count(const match_options &options)
+{
+    return std::max(1u, std::min<unsigned>(options.workers, MATCHING_MAX_WORKERS));
+}
+
+bool matching_check_logs(
+    const json &profile,
+    const std::vector<log_entry> &logs,
+    sandbox_match_status *results,
+    std::string &error,
+    const match_options &options,
+    match_stats *stats)
+{
+    match_stats local_stats;
+    check_context ctx = make_context(profile, logs, options, stats != nullptr ? *stats : local_stats);
+
+    // The watchdog needs worker processes it can kill, even for one worker.
+    const bool watchdog = options.entry_timeout_ms != 0 || options.run_timeout_ms != 0;
+    const unsigned n_workers = worker_count(options);
+
+    if (logs.empty() || (n_workers == 1 && !watchdog)) {
+        return check_log_range(ctx, 0, logs.size(), results, error);
+    }
+
+    if (!fork_allowed()) {
+        if (watchdog) {
+            error = "Time budgets require worker processes, but the installed profile does not allow forking";
+            return false;
+        }
+        return check_log_range(ctx, 0, logs.size(), results, error);
+    }
+
+    return check_logs_in_workers(ctx, results, error, n_workers, ms_to_ns(options.entry_timeout_ms));
+}
+
+bool matching_check_logs_isolated(
+    const json &profile,
+    const std::vector<log_entry> &logs,
+    sandbox_match_status *results,
+    std::string &error,
+    const match_options &options,
+    match_stats *stats)
+{
+    if (logs.empty()) {
+        return true;
+    }
+
+    match_stats local_stats;
+    check_context ctx = make_context(profile, logs, options, stats != nullptr ? *stats : local_stats);
+    ctx.install = &profile;
+
+    return check_logs_in_workers(ctx, results, error, worker_count(options), ms_to_ns(options.entry_timeout_ms));
+}
+
+/**
+ * Mirrors `operation_applies` in sblogs/match.py.
+ */
+static bool operation_applies(const std::string &rule_operation, const std::string &log_operation)
+{
+    if (rule_operation == "default") {
+        return true;
+    }
+    const size_t prefix_size = rule_operation.find_last_not_of('*') + 1;
+    return log_operation.compare(0, prefix_size, rule_operation, 0, prefix_size) == 0;
+}
+
+/**
+ * A profile denying everything but what `rule` matches. Modifiers that are
+ * only valid for deny rules are dropped, see `invert_rule` in sblogs/match.py.
+ */
+static json probe_profile_for_rule(const json &rule)
+{
+    json probe_rule = rule;
+    probe_rule["action"] = "allow";
+    if (probe_rule.count("modifiers")) {
+        json modifiers = json::array();
+        for (const json &modifier : probe_rule["modifiers"]) {
+            if (modifier["name"] != "no-report") {
+                modifiers.push_back(modifier);
+            }
+        }
+        probe_rule["modifiers"] = modifiers;
+    }
+
+    json probe = json::array();
+    probe.push_back({{"action", "deny"}, {"operations", {"default"}}});
+    probe.push_back(probe_rule);
+    return probe;
+}
+
+bool matching_build_matrix(
+    const json &profile,
+    const std::vector<log_entry> &logs,
+    match_matrix &matrix,
+    std::string &error,
+    const match_options &options,
+    match_stats *stats)
+{
+    // Columns are unique (operation, argument) pairs, probed as allowed.
+    std::map<std::pair<std::string, std::string>, uint32_t> column_ids;
+    std::vector<log_entry> columns;
+    matrix = match_matrix();
+    matrix.log_columns.reserve(logs.size());
+    for (const log_entry &log : logs) {
+        const auto inserted = column_ids.emplace(std::make_pair(log.operation, log.argument), columns.size());
+        if (inserted.second) {
+            columns.push_back({"allow", log.operation, log.argument});
+        }
+        matrix.log_columns.push_back(inserted.first->second);
+    }
+    matrix.cols = columns.size();
+
+    // Operations allowed even though everything is denied cannot be
+    // attributed to any rule.
+    std::vector<sandbox_match_status> baseline(columns.size());
+    const json deny_all = json::array({{{"action", "deny"}, {"operations", {"default"}}}});
+    if (!matching_check_logs_isolated(deny_all, columns, baseline.data(), error, options, stats)) {
+        return false;
+    }
+
+    for (const json &rule : profile) {
+        const std::vector<std::string> operations = rule["operations"];
+        std::vector<uint32_t> candidates;
+        std::vector<log_entry> candidate_logs;
+        for (uint32_t col = 0; col < columns.size(); ++col) {
+            if (baseline[col] != MATCH_INCONSISTENT) {
+                continue;
+            }
+            for (const std::string &operation : operations) {
+                if (operation_applies(operation, columns[col].operation)) {
+                    candidates.push_back(col);
+                    candidate_logs.push_back(columns[col]);
+                    break;
+                }
+            }
+        }
+
+        std::vector<uint32_t> matched;
+        if (!candidates.empty()) {
+            std::vector<sandbox_match_status> results(candidates.size());
+            if (!matching_check_logs_isolated(probe_profile_for_rule(rule), candidate_logs, results.data(), error, options, stats)) {
+                return false;
+            }
+            for (size_t i = 0; i < candidates.size(); ++i) {
+                if (results[i] == MATCH_CONSISTENT) {
+                    matched.push_back(candidates[i]);
+                }
+            }
+        }
+        match_matrix_append_row(matrix, matched);
+    }
+
+    return true;
+}
@@ -0,0 +1,146 @@
+#ifndef MATCHING_H
+#define MATCHING_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "match_matrix.h"
+
+enum sandbox_match_status : uint8_t {
+    MATCH_CONSISTENT,
+    MATCH_INCONSISTENT,
+    MATCH_UNKNOWN
+};
+
+/**
+ * A processed log entry, as produced by `sblogs/process.py`. The argument is
+ * empty for operations that were logged without one.
+ */
+struct log_entry {
+    std::string action;
+    std::string operation;
+    std::string argument;
+};
+
+/**
+ * Options controlling how log entries are checked.
+ */
+struct match_options {
+    /**
+     * Number of worker processes the log entries are distributed across. The
+     * workers are forked after the profile has been installed and inherit it.
+     */
+    unsigned workers = 1;
+
+    /**
+     * Time in milliseconds a single log entry may take to be checked, or 0 for
+     * no limit. Entries exceeding it are reported as MATCH_UNKNOWN. Requires
+     * checks to run in workers, which are killed and replaced if they get stuck.
+     */
+    unsigned entry_timeout_ms = 0;
+
+    /**
+     * Time in milliseconds all log entries may take to be checked, or 0 for no
+     * limit. Once exceeded, operations are no longer performed and entries are
+     * only checked by asking the kernel.
+     */
+    unsigned run_timeout_ms = 0;
+};
+
+/**
+ * Counters describing a call to `matching_check_logs`.
+ */
+struct match_stats {
+    // Log entries checked
+    uint64_t entries = 0;
+    // Log entries for which the operation was actually performed
+    uint64_t probes = 0;
+    // Operations not performed because the run timeout was exceeded
+    uint64_t skipped_probes = 0;
+    // Log entries that exceeded their timeout
+    uint64_t timeouts = 0;
+};
+
+/**
+ * Upper bound for `match_options::workers`.
+ */
+#define MATCHING_MAX_WORKERS 64
+
+/**
+ * Converts processed logs in their JSON representation into log entries.
+ */
+std::vector<log_entry> log_entries_from_json(const nlohmann::json &logs);
+
+/**
+ * Installs the given JSON sandbox profile for the current process. Note that
+ * this cannot be undone: every subsequent check is performed against this
+ * profile. Returns false and sets `error` on failure.
+ */
+bool matching_install_profile(const nlohmann::json &profile, std::string &error);
+
+/**
+ * Checks whether the decisions of the installed sandbox profile are consistent
+ * with the decisions recorded in `logs`. `profile` has to be the profile that
+ * was previously passed to `matching_install_profile`. One status per log
+ * entry is written to `results`, which has to provide room for `logs.size()`
+ * entries.
+ *
+ * If more than one worker is requested, each worker checks a contiguous shard
+ * of the log entries. Results are reported in the order of `logs` regardless.
+ * If a timeout is set, checks always run in at least one supervised worker.
+ * Checks fall back to the calling process if the installed profile does not
+ * allow forking, unless a timeout is set, in which case the call fails. Use
+ * `matching_check_logs_isolated` to enforce timeouts for such profiles.
+ *
+ * If `stats` is given, the counters of this call are added to it.
+ *
+ * Returns false and sets `error` if a log entry could not be checked.
+ */
+bool matching_check_logs(
+    const nlohmann::json &profile,
+    const std::vector<log_entry> &logs,
+    sandbox_match_status *results,
+    std::string &error,
+    const match_options &options = match_options(),
+    match_stats *stats = nullptr
+);
+
+/**
+ * Like `matching_check_logs`, but for a calling process that is not sandboxed:
+ * the profile is installed by the workers after forking, so the calling
+ * process can always supervise them. At least one worker is used.
+ */
+bool matching_check_logs_isolated(
+    const nlohmann::json &profile,
+    const std::vector<log_entry> &logs,
+    sandbox_match_status *results,
+    std::string &error,
+    const match_options &options = match_options(),
+    match_stats *stats = nullptr
+);
+
+/**
+ * Builds the matrix of which rules of `profile` match which unique
+ * (operation, argument) pairs of `logs`, regardless of the rules' actions.
+ *
+ * Each rule is probed on its own in a child process, by installing a profile
+ * denying everything except what the rule matches. Log entries are only
+ * checked against rules applying to their operation. Pairs allowed even when
+ * everything is denied, as well as pairs whose check is unknown, are not
+ * attributed to any rule. The calling process is not sandboxed.
+ *
+ * Returns false and sets `error` if a probe failed.
+ */
+bool matching_build_matrix(
+    const nlohmann::json &profile,
+    const std::vector<log_entry> &logs,
+    match_matrix &matrix,
+    std::string &error,
+    const match_options &options = match_options(),
+    match_stats *stats = nullptr
+);
+
+#endif
@@ -0,0 +1,143 @@
+/**
+ * Single-pass multi-pattern replacement.
+ *
+ * Applying replacements one after another with `str.replace` rescans the
+ * text once per pattern, and the result depends on the order of the patterns
+ * if they overlap. The Aho-Corasick automaton finds all patterns in one scan.
+ */
+
+#include "replacer.h"
+
+#include <algorithm>
+#include <deque>
+
+static const size_t NO_MATCH = static_cast<size_t>(-1);
+
+static uint32_t find_child(const replacer::node &node, uint8_t byte)
+{
+    const auto it = std::lower_bound(
+        node.children.begin(), node.children.end(), std::make_pair(byte, static_cast<uint32_t>(0)));
+    if (it != node.children.end() && it->first == byte) {
+        return it->second;
+    }
+    return 0;
+}
+
+static uint32_t next_state(const replacer &r, uint32_t state, uint8_t byte)
+{
+    while (true) {
+        const uint32_t child = find_child(r.nodes[state], byte);
+        if (child != 0 || state == 0) {
+            return child;
+        }
+        state = r.nodes[state].fail;
+    }
+}
+
+replacer replacer_build(const std::vector<std::pair<std::string, std::string>> &patterns)
+{
+    replacer r;
+    r.nodes.emplace_back();
+
+    for (const auto &pattern : patterns) {
+        if (pattern.first.empty()) {
+            continue;
+        }
+        uint32_t state = 0;
+        for (const char c : pattern.first) {
+            const uint8_t byte = static_cast<uint8_t>(c);
+            uint32_t child = find_child(r.nodes[state], byte);
+            if (child == 0) {
+                child = r.nodes.size();
+                r.nodes.emplace_back();
+                r.nodes[child].depth = r.nodes[state].depth + 1;
+                auto &children = r.nodes[state].children;
+                children.insert(
+                    std::lower_bound(children.begin(), children.end(), std::make_pair(byte, child)),
+                    std::make_pair(byte, child));
+            }
+            state = child;
+        }
+        if (r.nodes[state].output == -1) {
+            r.nodes[state].output = r.patterns.size();
+            r.patterns.push_back(pattern);
+        }
+    }
+
+    // Failure links, breadth first so that those of shallower nodes are known.
+    std::deque<uint32_t> pending;
+    for (const auto &child : r.nodes[0].children) {
+        pending.push_back(child.second);
+    }
+    while (!pending.empty()) {
+        const uint32_t state = pending.front();
+        pending.pop_front();
+        for (const auto &child : r.nodes[state].children) {
+            replacer::node &node = r.nodes[child.second];
+            node.fail = next_state(r, r.nodes[state].fail, child.first);
+            if (node.output == -1) {
+                node.output = r.nodes[node.fail].output;
+            }
+            pending.push_back(child.second);
+        }
+    }
+
+    return r;
+}
+
+size_t replacer_apply(const replacer &r, const char *text, size_t size, std::string &out)
+{
+    size_t replaced = 0;
+    // Start of the text not yet appended to `out`
+    size_t emitted = 0;
+    size_t pos = 0;
+    uint32_t state = 0;
+
+    size_t best_start = NO_MATCH;
+    size_t best_pattern = 0;
+
+    out.reserve(out.size() + size);
+    while (true) {
+        if (pos < size) {
+            state = next_state(r, state, static_cast<uint8_t>(text[pos++]));
+            const int32_t output = r.nodes[state].output;
+            if (output != -1) {
+                const size_t start = pos - r.patterns[output].first.size();
+                // Of matches with the same start, later ones are longer.
+                if (best_start == NO_MATCH || start <= best_start) {
+                    best_start = start;
+                    best_pattern = output;
+                }
+            }
+        }
+
+        // Matches found later start after the text the current state stands
+        // for, so once that is past the best match, it is final.
+        const bool at_end = pos == size;
+        if (best_start != NO_MATCH && (at_end || pos - r.nodes[state].depth > best_start)) {
+            const auto &pattern = r.patterns[best_pattern];
+            out.append(text + emitted, best_start - emitted);
+            out.append(pattern.second);
+            ++replaced;
+
+            // Overlapping matches are dropped, so rescan after this one.
+            emitted = pos = best_start + pattern.first.size();
+            state = 0;
+            best_start = NO_MATCH;
+            continue;
+        }
+        if (at_end) {
+            break;
+        }
+    }
+
+    out.append(text + emitted, size - emitted);
+    return replaced;
+}
+
+std::string replacer_apply(const replacer &r, const std::string &text)
+{
+    std::string out;
+    replacer_apply(r, text.data(), text.size(), out);
+    return out;
+}
@@ -0,0 +1,53 @@
+#ifndef REPLACER_H
+#define REPLACER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Replaces many strings in a single pass, such as the placeholders of
+ * `normalisation_replacements` by their values or vice versa.
+ *
+ * Patterns are found using an Aho-Corasick automaton over bytes. Matches are
+ * chosen leftmost-longest: of all matches, the one starting first wins, and
+ * of those starting at the same position, the longest. Scanning continues
+ * after the replaced text, so replacements are never themselves replaced.
+ */
+struct replacer {
+    struct node {
+        // Sorted (byte, node) transitions of the trie
+        std::vector<std::pair<uint8_t, uint32_t>> children;
+        // Longest proper suffix that is a prefix of some pattern
+        uint32_t fail = 0;
+        // Length of the text leading to this node
+        uint32_t depth = 0;
+        // Pattern ending here, or the longest one ending in a suffix of it.
+        // -1 if there is none.
+        int32_t output = -1;
+    };
+
+    std::vector<node> nodes;
+    std::vector<std::pair<std::string, std::string>> patterns;
+};
+
+/**
+ * Builds a replacer for (pattern, replacement) pairs. Empty patterns are
+ * ignored. Of duplicate patterns, the first one is used.
+ */
+replacer replacer_build(const std::vector<std::pair<std::string, std::string>> &patterns);
+
+/**
+ * Appends `size` bytes of `text` to `out`, with all patterns replaced.
+ * Returns the number of replacements made.
+ */
+size_t replacer_apply(const replacer &r, const char *text, size_t size, std::string &out);
+
+/**
+ * Returns `text` with all patterns replaced.
+ */
+std::string replacer_apply(const replacer &r, const std::string &text);
+
+#endif
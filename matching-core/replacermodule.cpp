@@ -0,0 +1,191 @@
+/**
+ * CPython extension module exposing the multi-pattern replacer to
+ * `sbprofiles/replace.py`.
+ *
+ * Unlike `_matcher`, this module does not depend on the sandbox and can be
+ * built on any platform. Strings are replaced in their UTF-8 encoding, in
+ * which patterns can only match at character boundaries.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "replacer.h"
+
+typedef struct {
+    PyObject_HEAD
+    replacer *r;
+} ReplacerObject;
+
+static void Replacer_dealloc(ReplacerObject *self)
+{
+    delete self->r;
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static bool utf8_string(PyObject *obj, std::string &out)
+{
+    Py_ssize_t size = 0;
+    const char *data = PyUnicode_AsUTF8AndSize(obj, &size);
+    if (data == nullptr) {
+        return false;
+    }
+    out.assign(data, size);
+    return true;
+}
+
+static int Replacer_init(ReplacerObject *self, PyObject *args, PyObject *kwargs)
+{
+    static const char *keywords[] = {"patterns", nullptr};
+    PyObject *patterns_obj = nullptr;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O:Replacer", const_cast<char **>(keywords), &patterns_obj)) {
+        return -1;
+    }
+
+    PyObject *sequence = PySequence_Fast(patterns_obj, "patterns have to be a sequence of (pattern, replacement) pairs");
+    if (sequence == nullptr) {
+        return -1;
+    }
+    std::vector<std::pair<std::string, std::string>> patterns(PySequence_Fast_GET_SIZE(sequence));
+    for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(sequence); ++i) {
+        PyObject *pattern = nullptr;
+        PyObject *replacement = nullptr;
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(sequence, i), "UU:Replacer", &pattern, &replacement)
+            || !utf8_string(pattern, patterns[i].first)
+            || !utf8_string(replacement, patterns[i].second)) {
+            Py_DECREF(sequence);
+            return -1;
+        }
+    }
+    Py_DECREF(sequence);
+
+    replacer *r = new (std::nothrow) replacer(replacer_build(patterns));
+    if (r == nullptr) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    delete self->r;
+    self->r = r;
+    return 0;
+}
+
+static PyObject *replace_string(const replacer &r, PyObject *text, std::string &out)
+{
+    Py_ssize_t size = 0;
+    const char *data = PyUnicode_AsUTF8AndSize(text, &size);
+    if (data == nullptr) {
+        return nullptr;
+    }
+    out.clear();
+    if (replacer_apply(r, data, size, out) == 0) {
+        Py_INCREF(text);
+        return text;
+    }
+    return PyUnicode_DecodeUTF8(out.data(), out.size(), "strict");
+}
+
+static PyObject *Replacer_replace(ReplacerObject *self, PyObject *text)
+{
+    if (self->r == nullptr) {
+        PyErr_SetString(PyExc_RuntimeError, "Replacer not initialised");
+        return nullptr;
+    }
+    if (!PyUnicode_Check(text)) {
+        PyErr_SetString(PyExc_TypeError, "text has to be a str");
+        return nullptr;
+    }
+    std::string out;
+    return replace_string(*self->r, text, out);
+}
+
+static PyObject *Replacer_replace_all(ReplacerObject *self, PyObject *texts)
+{
+    if (self->r == nullptr) {
+        PyErr_SetString(PyExc_RuntimeError, "Replacer not initialised");
+        return nullptr;
+    }
+    PyObject *sequence = PySequence_Fast(texts, "texts have to be a sequence");
+    if (sequence == nullptr) {
+        return nullptr;
+    }
+
+    const Py_ssize_t count = PySequence_Fast_GET_SIZE(sequence);
+    PyObject *result = PyList_New(count);
+    std::string out;
+    for (Py_ssize_t i = 0; result != nullptr && i < count; ++i) {
+        PyObject *text = PySequence_Fast_GET_ITEM(sequence, i);
+        PyObject *replaced = nullptr;
+        if (text == Py_None) {
+            // Log entries without argument
+            Py_INCREF(text);
+            replaced = text;
+        } else if (PyUnicode_Check(text)) {
+            replaced = replace_string(*self->r, text, out);
+        } else {
+            PyErr_SetString(PyExc_TypeError, "texts have to be str or None");
+        }
+        if (replaced == nullptr) {
+            Py_CLEAR(result);
+        } else {
+            PyList_SET_ITEM(result, i, replaced);
+        }
+    }
+    Py_DECREF(sequence);
+    return result;
+}
+
+static PyMethodDef Replacer_methods[] = {
+    {
+        "replace", (PyCFunction)Replacer_replace, METH_O,
+        "replace(text) -> str\n\nReturn text with all patterns replaced."
+    },
+    {
+        "replace_all", (PyCFunction)Replacer_replace_all, METH_O,
+        "replace_all(texts) -> list\n\n"
+        "Return the texts with all patterns replaced. None is passed through."
+    },
+    {nullptr, nullptr, 0, nullptr}
+};
+
+static PyTypeObject ReplacerType = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+    "_replacer.Replacer",
+};
+
+static struct PyModuleDef replacer_module = {
+    PyModuleDef_HEAD_INIT,
+    "_replacer",
+    "Native single-pass multi-pattern replacement.",
+    -1,
+    nullptr,
+};
+
+PyMODINIT_FUNC PyInit__replacer(void)
+{
+    ReplacerType.tp_basicsize = sizeof(ReplacerObject);
+    ReplacerType.tp_dealloc = (destructor)Replacer_dealloc;
+    ReplacerType.tp_flags = Py_TPFLAGS_DEFAULT;
+    ReplacerType.tp_doc =
+        "Replacer(patterns)\n\n"
+        "Replaces (pattern, replacement) pairs in a single pass, choosing\n"
+        "leftmost-longest matches.";
+    ReplacerType.tp_methods = Replacer_methods;
+    ReplacerType.tp_init = (initproc)Replacer_init;
+    ReplacerType.tp_new = PyType_GenericNew;
+    if (PyType_Ready(&ReplacerType) < 0) {
+        return nullptr;
+    }
+
+    PyObject *module = PyModule_Create(&replacer_module);
+    if (module == nullptr) {
+        return nullptr;
+    }
+    Py_INCREF(&ReplacerType);
+    PyModule_AddObject(module, "Replacer", (PyObject *)&ReplacerType);
+    return module;
+}
@@ -0,0 +1,145 @@
+/**
+ * This program converts raw sandbox logs, as output by
+ * `log show --style json`, into processed log entries for a single process.
+ *
+ * The raw logs are read from the file given as argument, which is memory
+ * mapped, or from standard input if the file is `-`. Processed log entries are
+ * written to standard output as newline delimited JSON, one dictionary per
+ * line, in the format produced by `sblogs/process.py`.
+ *
+ * Options:
+ *   --pid PID   Process whose sandbox messages are converted. Required.
+ *
+ * Does not depend on the sandbox and hence also runs on other platforms.
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include "log_ingest.h"
+
+/**
+ * Output is flushed whenever this many bytes are buffered.
+ */
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+static bool parse_options(int argc, char *argv[], long &pid, const char *&path)
+{
+    static const struct option long_options[] = {
+        {"pid", required_argument, nullptr, 'p'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    pid = -1;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 'p': {
+                char *end = nullptr;
+                pid = strtol(optarg, &end, 10);
+                if (*optarg == '\0' || *end != '\0' || pid < 0) {
+                    std::cerr << "Invalid PID: " << optarg << std::endl;
+                    return false;
+                }
+                break;
+            }
+            default:
+                pid = -1;
+                break;
+        }
+    }
+
+    if (pid < 0 || optind + 1 != argc) {
+        std::cerr << "Usage: " << argv[0] << " --pid PID <raw_logs.json | ->" << std::endl;
+        return false;
+    }
+    path = argv[optind];
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    long pid = -1;
+    const char *path = nullptr;
+    if (!parse_options(argc, argv, pid, path)) {
+        return EXIT_FAILURE;
+    }
+
+    std::string input;
+    const char *data = nullptr;
+    size_t size = 0;
+    void *mapping = MAP_FAILED;
+
+    if (!strcmp(path, "-")) {
+        // Read in large blocks, which is much faster than through std::cin.
+        char buffer[1 << 16];
+        ssize_t count = 0;
+        while ((count = read(STDIN_FILENO, buffer, sizeof(buffer))) != 0) {
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "Failed to read standard input: " << strerror(errno) << std::endl;
+                return EXIT_FAILURE;
+            }
+            input.append(buffer, count);
+        }
+        data = input.data();
+        size = input.size();
+    } else {
+        const int fd = open(path, O_RDONLY);
+        struct stat st;
+        if (fd == -1 || fstat(fd, &st) != 0) {
+            std::cerr << "Failed to open " << path << ": " << strerror(errno) << std::endl;
+            return EXIT_FAILURE;
+        }
+        size = st.st_size;
+        if (size != 0) {
+            mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                std::cerr << "Failed to map " << path << ": " << strerror(errno) << std::endl;
+                close(fd);
+                return EXIT_FAILURE;
+            }
+            madvise(mapping, size, MADV_SEQUENTIAL);
+            data = static_cast<const char *>(mapping);
+        }
+        close(fd);
+    }
+
+    std::string output;
+    output.reserve(OUTPUT_BUFFER_SIZE + 4096);
+    const processed_log_handler write_log = [&output](const processed_log &log) {
+        append_processed_log_json(log, output);
+        if (output.size() >= OUTPUT_BUFFER_SIZE) {
+            fwrite(output.data(), 1, output.size(), stdout);
+            output.clear();
+        }
+    };
+
+    std::string error;
+    const bool success = ingest_raw_logs(data, size, pid, write_log, error);
+    fwrite(output.data(), 1, output.size(), stdout);
+    fflush(stdout);
+
+    if (mapping != MAP_FAILED) {
+        munmap(mapping, size);
+    }
+
+    if (!success) {
+        std::cerr << error << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
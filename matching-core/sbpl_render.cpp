@@ -0,0 +1,78 @@
+#include "sbpl_render.h"
+
+#include <sbpldump/convert.h>
+
+using json = nlohmann::json;
+
+/**
+ * Renders a JSON list of rules. `sbpldump` does not specify who owns the
+ * returned text, so it is copied and not freed, as in
+ * `matching_install_profile`.
+ */
+static bool dump_scheme(const std::string &rules, std::string &out)
+{
+    const char *sbpl = sandbox_rules_dump_scheme(rules.c_str());
+    if (sbpl == nullptr) {
+        return false;
+    }
+    out.assign(sbpl);
+    return true;
+}
+
+static size_t trimmed_size(const std::string &text, size_t offset)
+{
+    size_t end = text.size();
+    while (end > offset && text[end - 1] == '\n') {
+        --end;
+    }
+    return end - offset;
+}
+
+/**
+ * Returns the SBPL preceding the rules in every rendering, i.e. the version
+ * statement, or the empty string if it cannot be rendered.
+ */
+static const std::string &version_statement()
+{
+    static const std::string header = []() {
+        std::string sbpl;
+        return dump_scheme("[]", sbpl) ? sbpl : std::string();
+    }();
+    return header;
+}
+
+bool sbpl_render_profile(const json &profile, sbpl_rendering &out, std::string &error)
+{
+    if (!profile.is_array()) {
+        error = "Profile is not a list of rules";
+        return false;
+    }
+    const std::string &header = version_statement();
+    if (header.empty()) {
+        error = "Failed to render an empty profile";
+        return false;
+    }
+
+    out.text = header;
+    out.spans.assign(1, sbpl_span{0, trimmed_size(header, 0)});
+    out.spans.reserve(profile.size() + 1);
+
+    std::string sbpl;
+    for (size_t i = 0; i < profile.size(); ++i) {
+        if (!dump_scheme(json::array({profile[i]}).dump(), sbpl)
+            || sbpl.compare(0, header.size(), header) != 0) {
+            error = "Failed to render rule " + std::to_string(i);
+            return false;
+        }
+        const size_t offset = out.text.size();
+        out.text.append(sbpl, header.size(), std::string::npos);
+        out.spans.push_back(sbpl_span{offset, trimmed_size(out.text, offset)});
+    }
+    return true;
+}
+
+std::string sbpl_render_rule(const sbpl_rendering &rendering, size_t i)
+{
+    const sbpl_span &span = rendering.spans.at(i);
+    return rendering.text.substr(span.offset, span.size);
+}
@@ -0,0 +1,47 @@
+#ifndef SBPL_RENDER_H
+#define SBPL_RENDER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+/**
+ * Renders profiles as output by `sbpldump` to SBPL in-process, using the
+ * `sbpldump` library instead of spawning `sbpldump` for every profile.
+ *
+ * Rules are rendered one at a time, so the extent of every rule in the text
+ * is known and the text does not have to be split into rules again, which
+ * is ambiguous for rules spanning several lines.
+ */
+
+/**
+ * Extent of a rule in `sbpl_rendering::text`, without trailing newlines.
+ */
+struct sbpl_span {
+    size_t offset;
+    size_t size;
+};
+
+/**
+ * SBPL of a profile. The first span is the version statement, followed by
+ * one span per rule, so rule `i` of the profile is span `i + 1`.
+ */
+struct sbpl_rendering {
+    std::string text;
+    std::vector<sbpl_span> spans;
+};
+
+/**
+ * Renders a profile. Returns false and sets `error` if the profile is not a
+ * list of rules, or a rule is not rendered as expected.
+ */
+bool sbpl_render_profile(const nlohmann::json &profile, sbpl_rendering &out, std::string &error);
+
+/**
+ * Returns the text of span `i`.
+ */
+std::string sbpl_render_rule(const sbpl_rendering &rendering, size_t i);
+
+#endif
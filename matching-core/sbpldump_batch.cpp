@@ -0,0 +1,53 @@
+/**
+ * This program renders many sandbox profiles to SBPL in a single process,
+ * see sbpl_render.h.
+ *
+ * Profiles as output by `sbpldump` are read from standard input, one JSON
+ * document per line. For every profile, a JSON list of its rules' SBPL is
+ * written as a line to standard output, starting with the version statement.
+ * Used by `sbprofiles/render.py` if the `_sbpl` module is not available.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "sbpl_render.h"
+
+using json = nlohmann::json;
+
+int main(int argc, char *argv[])
+{
+    if (argc != 1) {
+        std::cerr << "Usage: " << argv[0] << " < profiles.ndjson" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string line;
+    sbpl_rendering rendering;
+    std::string error;
+    for (size_t line_idx = 1; std::getline(std::cin, line); ++line_idx) {
+        if (line.empty()) {
+            continue;
+        }
+        const json profile = json::parse(line, nullptr, false);
+        if (profile.is_discarded()) {
+            std::cerr << "Failed to parse profile on line " << line_idx << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (!sbpl_render_profile(profile, rendering, error)) {
+            std::cerr << error << " of profile on line " << line_idx << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        json rules = json::array();
+        for (size_t i = 0; i < rendering.spans.size(); ++i) {
+            rules.push_back(sbpl_render_rule(rendering, i));
+        }
+        std::cout << rules.dump() << '\n';
+    }
+    std::cout.flush();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+/**
+ * CPython extension module exposing batch SBPL rendering to
+ * `sbprofiles/render.py`, see sbpl_render.h.
+ *
+ * Profiles are passed as JSON text, as they would be to `sbpldump`.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "sbpl_render.h"
+
+using json = nlohmann::json;
+
+static PyObject *rendered_rules(const sbpl_rendering &rendering)
+{
+    PyObject *rules = PyList_New(rendering.spans.size());
+    for (size_t i = 0; rules != nullptr && i < rendering.spans.size(); ++i) {
+        const sbpl_span &span = rendering.spans[i];
+        PyObject *rule = PyUnicode_DecodeUTF8(rendering.text.data() + span.offset, span.size, "strict");
+        if (rule == nullptr) {
+            Py_CLEAR(rules);
+        } else {
+            PyList_SET_ITEM(rules, i, rule);
+        }
+    }
+    return rules;
+}
+
+static PyObject *sbpl_render(PyObject *self, PyObject *profiles)
+{
+    PyObject *sequence = PySequence_Fast(profiles, "profiles have to be a sequence of JSON strings");
+    if (sequence == nullptr) {
+        return nullptr;
+    }
+
+    const Py_ssize_t count = PySequence_Fast_GET_SIZE(sequence);
+    PyObject *result = PyList_New(count);
+    sbpl_rendering rendering;
+    std::string error;
+    for (Py_ssize_t i = 0; result != nullptr && i < count; ++i) {
+        Py_ssize_t size = 0;
+        const char *data = PyUnicode_AsUTF8AndSize(PySequence_Fast_GET_ITEM(sequence, i), &size);
+        if (data == nullptr) {
+            Py_CLEAR(result);
+            break;
+        }
+        const json profile = json::parse(data, data + size, nullptr, false);
+        if (profile.is_discarded()) {
+            PyErr_Format(PyExc_ValueError, "Failed to parse profile %zd", i);
+            Py_CLEAR(result);
+            break;
+        }
+
+        if (!sbpl_render_profile(profile, rendering, error)) {
+            PyErr_Format(PyExc_ValueError, "%s of profile %zd", error.c_str(), i);
+            Py_CLEAR(result);
+            break;
+        }
+
+        PyObject *rules = rendered_rules(rendering);
+        if (rules == nullptr) {
+            Py_CLEAR(result);
+        } else {
+            PyList_SET_ITEM(result, i, rules);
+        }
+    }
+    Py_DECREF(sequence);
+    return result;
+}
+
+static PyMethodDef sbpl_methods[] = {
+    {
+        "render", (PyCFunction)sbpl_render, METH_O,
+        "render(profiles) -> list\n\n"
+        "Render profiles, given as JSON strings, to SBPL. Returns a list of the\n"
+        "rules' SBPL per profile, starting with the version statement."
+    },
+    {nullptr, nullptr, 0, nullptr}
+};
+
+static struct PyModuleDef sbpl_module = {
+    PyModuleDef_HEAD_INIT,
+    "_sbpl",
+    "Native SBPL rendering of many profiles.",
+    -1,
+    sbpl_methods,
+};
+
+PyMODINIT_FUNC PyInit__sbpl(void)
+{
+    return PyModule_Create(&sbpl_module);
+}
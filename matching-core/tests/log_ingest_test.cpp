@@ -0,0 +1,104 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+
+#include "../log_ingest.h"
+
+static std::string read_file(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    assert(in);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void test_find_substring()
+{
+    std::mt19937 rng(42);
+    std::string haystack;
+    for (size_t size = 0; size < 200; ++size) {
+        haystack.assign(size, 'a');
+        for (char &c : haystack) {
+            c = "ab()"[rng() % 4];
+        }
+        for (size_t needle_size = 1; needle_size < 6; ++needle_size) {
+            std::string needle(needle_size, 'a');
+            for (char &c : needle) {
+                c = "ab()"[rng() % 4];
+            }
+            const char *found = find_substring(haystack.data(), haystack.size(), needle.data(), needle.size());
+            const size_t expected = haystack.find(needle);
+            if (expected == std::string::npos) {
+                assert(found == nullptr);
+            } else {
+                assert(found == haystack.data() + expected);
+            }
+        }
+    }
+}
+
+static processed_log convert(const std::string &msg)
+{
+    processed_log log;
+    std::string error;
+    assert(convert_log_message(msg, log, error));
+    return log;
+}
+
+static void test_convert_log_message()
+{
+    processed_log log = convert("Sandbox: App(1) deny(1) file-read-data /a b");
+    assert(log.action == "deny" && log.operation == "file-read-data" && log.has_argument && log.argument == "/a b");
+
+    log = convert("Sandbox: App(1) allow process-fork");
+    assert(log.action == "allow" && log.operation == "process-fork" && !log.has_argument);
+
+    log = convert("Sandbox: App(1) allow network-inbound*:80");
+    assert(log.operation == "network-inbound" && log.argument == "*:80");
+
+    log = convert("Sandbox: App(1) allow file-issue-extension target:/a class:b");
+    assert(log.argument == "target: /a class: b");
+
+    log = convert("Sandbox: App(1) allowed(x) mach-lookup a");
+    assert(log.action.empty());
+
+    std::string error;
+    assert(!convert_log_message("Sandbox: App(1) allow x (2) deny y", log, error));
+    assert(!convert_log_message("Sandbox: App(1) allow", log, error));
+    assert(!convert_log_message("Sandbox: App(1) allow network-bind*:1 extra", log, error));
+    assert(!convert_log_message("Sandbox: App(1) allow file-issue-extension target:/a", log, error));
+}
+
+static void test_ingest_raw_logs()
+{
+    const std::string raw = read_file(FIXTURES_DIR "/raw_logs.json");
+    const std::string expected = read_file(FIXTURES_DIR "/processed_logs.ndjson");
+
+    std::string output;
+    std::string error;
+    assert(ingest_raw_logs(raw.data(), raw.size(), 402, [&output](const processed_log &log) {
+        append_processed_log_json(log, output);
+    }, error));
+    assert(output == expected);
+
+    output.clear();
+    assert(ingest_raw_logs(raw.data(), raw.size(), 40, [&output](const processed_log &log) {
+        append_processed_log_json(log, output);
+    }, error));
+    assert(output.empty());
+
+    const std::string truncated = raw.substr(0, raw.find("Helvetica"));
+    assert(!ingest_raw_logs(truncated.data(), truncated.size(), 402, [](const processed_log &) {}, error));
+}
+
+int main(int argc, char *argv[])
+{
+    test_find_substring();
+    test_convert_log_message();
+    test_ingest_raw_logs();
+
+    return EXIT_SUCCESS;
+}
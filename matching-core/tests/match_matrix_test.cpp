@@ -0,0 +1,117 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../match_matrix.h"
+
+static std::vector<std::vector<uint32_t>> random_rows(std::mt19937 &rng, uint32_t rows, uint32_t cols)
+{
+    std::vector<std::vector<uint32_t>> result(rows);
+    for (std::vector<uint32_t> &row : result) {
+        const unsigned density = rng() % 4;
+        for (uint32_t col = 0; col < cols; ++col) {
+            if (density != 0 && rng() % (density * density * 8) == 0) {
+                row.push_back(col);
+            }
+        }
+    }
+    return result;
+}
+
+static void test_queries()
+{
+    std::mt19937 rng(7);
+    const uint32_t cols = 100000;
+    const std::vector<std::vector<uint32_t>> rows = random_rows(rng, 40, cols);
+
+    match_matrix matrix;
+    matrix.cols = cols;
+    uint64_t nnz = 0;
+    for (const std::vector<uint32_t> &row : rows) {
+        match_matrix_append_row(matrix, row);
+        nnz += row.size();
+    }
+    assert(match_matrix_rows(matrix) == rows.size());
+    assert(match_matrix_nnz(matrix) == nnz);
+
+    std::vector<uint64_t> counts(cols, 0);
+    for (uint32_t row = 0; row < rows.size(); ++row) {
+        assert(match_matrix_row(matrix, row) == rows[row]);
+        assert(match_matrix_row_popcount(matrix, row) == rows[row].size());
+        for (const uint32_t col : rows[row]) {
+            ++counts[col];
+        }
+    }
+    assert(match_matrix_column_popcounts(matrix) == counts);
+
+    const match_matrix transposed = match_matrix_transpose(matrix);
+    assert(match_matrix_rows(transposed) == cols && transposed.cols == rows.size());
+    for (const uint32_t col : {0u, 1u, 77u, cols - 1}) {
+        std::vector<uint32_t> expected;
+        for (uint32_t row = 0; row < rows.size(); ++row) {
+            if (std::find(rows[row].begin(), rows[row].end(), col) != rows[row].end()) {
+                expected.push_back(row);
+            }
+        }
+        assert(match_matrix_column(matrix, col) == expected);
+        assert(match_matrix_row(transposed, col) == expected);
+    }
+}
+
+static void test_serialisation()
+{
+    std::mt19937 rng(11);
+    match_matrix matrix;
+    matrix.cols = 5000;
+    for (const std::vector<uint32_t> &row : random_rows(rng, 20, matrix.cols)) {
+        match_matrix_append_row(matrix, row);
+    }
+    for (uint32_t i = 0; i < 7000; ++i) {
+        matrix.log_columns.push_back(rng() % matrix.cols);
+    }
+
+    std::string serialised;
+    match_matrix_serialise(matrix, serialised);
+    // Mostly single byte deltas
+    assert(matrix.deltas.size() < 2 * match_matrix_nnz(matrix));
+
+    match_matrix parsed;
+    std::string error;
+    assert(match_matrix_deserialise(serialised.data(), serialised.size(), parsed, error));
+    assert(parsed.cols == matrix.cols);
+    assert(parsed.row_nnz == matrix.row_nnz && parsed.row_bytes == matrix.row_bytes);
+    assert(parsed.deltas == matrix.deltas && parsed.log_columns == matrix.log_columns);
+
+    match_matrix empty;
+    std::string empty_serialised;
+    match_matrix_serialise(empty, empty_serialised);
+    assert(match_matrix_deserialise(empty_serialised.data(), empty_serialised.size(), parsed, error));
+    assert(match_matrix_rows(parsed) == 0 && match_matrix_nnz(parsed) == 0);
+
+    assert(!match_matrix_deserialise(serialised.data(), serialised.size() - 1, parsed, error));
+    assert(!match_matrix_deserialise(serialised.data(), 10, parsed, error));
+
+    std::string corrupted = serialised;
+    corrupted[4] = 2;
+    assert(!match_matrix_deserialise(corrupted.data(), corrupted.size(), parsed, error));
+
+    // A column beyond the last one
+    match_matrix wide;
+    wide.cols = 10;
+    match_matrix_append_row(wide, {3, 12});
+    std::string wide_serialised;
+    match_matrix_serialise(wide, wide_serialised);
+    assert(!match_matrix_deserialise(wide_serialised.data(), wide_serialised.size(), parsed, error));
+}
+
+int main(int argc, char *argv[])
+{
+    test_queries();
+    test_serialisation();
+
+    return EXIT_SUCCESS;
+}
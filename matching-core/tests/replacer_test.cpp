@@ -0,0 +1,111 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../replacer.h"
+
+typedef std::vector<std::pair<std::string, std::string>> pattern_list;
+
+/**
+ * Leftmost-longest replacement by trying all patterns at every position.
+ */
+static std::string replace_naive(const pattern_list &patterns, const std::string &text)
+{
+    std::string out;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        const std::pair<std::string, std::string> *best = nullptr;
+        for (const auto &pattern : patterns) {
+            if (!pattern.first.empty()
+                && text.compare(pos, pattern.first.size(), pattern.first) == 0
+                && (best == nullptr || pattern.first.size() > best->first.size())) {
+                best = &pattern;
+            }
+        }
+        if (best == nullptr) {
+            out.push_back(text[pos++]);
+        } else {
+            out.append(best->second);
+            pos += best->first.size();
+        }
+    }
+    return out;
+}
+
+static void test_placeholders()
+{
+    const replacer r = replacer_build({
+        {"/Users/user", "/$_HOME$"},
+        {"user", "$_USER$"},
+        {"com.example.App", "$APPLICATION_BUNDLE_ID$"},
+    });
+
+    assert(replacer_apply(r, "") == "");
+    assert(replacer_apply(r, "/private/tmp") == "/private/tmp");
+    assert(replacer_apply(r, "/Users/user/Library/Containers/com.example.App/Data")
+           == "/$_HOME$/Library/Containers/$APPLICATION_BUNDLE_ID$/Data");
+    assert(replacer_apply(r, "/Users/username") == "/$_HOME$name");
+    assert(replacer_apply(r, "/Users/use user") == "/Users/use $_USER$");
+
+    std::string out = "prefix:";
+    assert(replacer_apply(r, "user user", 9, out) == 2);
+    assert(out == "prefix:$_USER$ $_USER$");
+}
+
+static void test_leftmost_longest()
+{
+    const replacer r = replacer_build({{"b", "1"}, {"abc", "2"}, {"bcd", "3"}, {"", "4"}, {"b", "5"}});
+
+    // The earlier match wins, even if a shorter one is found first.
+    assert(replacer_apply(r, "abcd") == "2d");
+    assert(replacer_apply(r, "xbcd") == "x3");
+    assert(replacer_apply(r, "xbc") == "x1c");
+    // Replacements are not scanned again.
+    const replacer recursive = replacer_build({{"a", "aa"}, {"aa", "b"}});
+    assert(replacer_apply(recursive, "aaa") == "baa");
+}
+
+static void test_random()
+{
+    std::mt19937 rng(11);
+    const std::string alphabet = "ab/$";
+    auto random_string = [&rng, &alphabet](size_t max_size) {
+        std::string s(rng() % (max_size + 1), ' ');
+        for (char &c : s) {
+            c = alphabet[rng() % alphabet.size()];
+        }
+        return s;
+    };
+
+    for (int round = 0; round < 2000; ++round) {
+        pattern_list patterns;
+        for (unsigned i = rng() % 6; i > 0; --i) {
+            const std::string pattern = random_string(4);
+            bool duplicate = false;
+            for (const auto &existing : patterns) {
+                duplicate = duplicate || existing.first == pattern;
+            }
+            if (!duplicate) {
+                patterns.emplace_back(pattern, std::to_string(i));
+            }
+        }
+        const replacer r = replacer_build(patterns);
+        for (int i = 0; i < 10; ++i) {
+            const std::string text = random_string(20);
+            assert(replacer_apply(r, text) == replace_naive(patterns, text));
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    test_placeholders();
+    test_leftmost_longest();
+    test_random();
+
+    return EXIT_SUCCESS;
+}
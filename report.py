@@ -3,22 +3,47 @@
 import argparse
 import json
 import os
-import subprocess
 import sys
 
 from collections import defaultdict
+from concurrent.futures import ProcessPoolExecutor, as_completed
 from dataclasses import dataclass
-from typing import Any, Dict, List, Optional
+from itertools import islice
+from typing import Any, Dict, Iterable, Iterator, List, Mapping, Optional, Set, Tuple, TypeVar
 
 import jinja2 as jj
-from pygments import highlight
-from pygments.lexers import SchemeLexer
-from pygments.formatters import HtmlFormatter
 
+from sbprofiles.highlight import HIGHLIGHT_DIR, HighlightCache, highlight_css
+from sbprofiles.render import RuleSBPL, render_profile, render_profiles
+from sbresults.container import MAGIC, RESULT_NAMES, ResultsContainer, find_results, load_results
+from sbresults.store import PROFILE_STORE_NAME, find_profile_store
 
-PROJECT_DIR = os.path.dirname(os.path.abspath(__file__))
-HELPER_DIR = os.path.join(PROJECT_DIR, 'matching-core', 'build', 'bin')
-SBPLDUMP = os.path.join(HELPER_DIR, 'sbpldump')
+
+# Batches of result directories per process when aggregating
+AGGREGATION_BATCHES = 4
+
+# Profiles rendered to SBPL at once for tabular reports
+RENDER_BATCH = 64
+
+# Items, i.e. apps or rules, per shard of paged reports
+CHUNK_SIZE = 500
+
+# Directory of the shards of a paged report, next to its index page
+SHARDS_SUFFIX = '_shards'
+
+T = TypeVar('T')
+
+
+def chunks(items: Iterable[T], size: int) -> Iterator[List[T]]:
+    """
+    Yields lists of `size` consecutive items, the last one possibly shorter.
+    """
+    iterator = iter(items)
+    while True:
+        chunk = list(islice(iterator, size))
+        if not chunk:
+            return
+        yield chunk
 
 
 @dataclass(frozen=True)
@@ -87,60 +112,24 @@ class Result:
         hits: Dict[int, int],
         redundant_hits: Dict[int, int],
         redundancy_sources: Dict[int, List[Optional[int]]],
+        sbpl: Optional[RuleSBPL] = None,
     ) -> 'Result':
-        # Dump SBPL profile
-        sbpldump = subprocess.run(
-            [SBPLDUMP, '-'],
-            check=True,
-            capture_output=True,
-            input=json.dumps(profile),
-            text=True,
-        )
-        sbpl = sbpldump.stdout
-
-        # Detect rules
-        rules: List[Rule] = []
-        rule_sbpl: List[str] = []
-        for line_idx, line in enumerate(sbpl.splitlines()):
-            if line.startswith('('):
-                if 0 < line_idx:
-                    rule_idx = len(rules)
-                    rule = Rule(
-                        sbpl='\n'.join(rule_sbpl),
-                        hits=hits[rule_idx],
-                        redundant_hits=redundant_hits[rule_idx],
-                        redundancy_sources=redundancy_sources[rule_idx],
-                    )
-                    rules.append(rule)
-                    rule_sbpl = []
-            rule_sbpl.append(line)
-        rule_idx = len(rules)
-        rule = Rule(
-            sbpl='\n'.join(rule_sbpl),
-            hits=hits[rule_idx],
-            redundant_hits=redundant_hits[rule_idx],
-            redundancy_sources=redundancy_sources[rule_idx],
-        )
-        rules.append(rule)
-        return cls(info, rules)
-
-    def with_manual_results(
-        self,
-        info: AppInfo,
-        hits: Dict[int, int],
-        redundant_hits: Dict[int, int],
-        redundancy_sources: Dict[int, List[Optional[int]]],
-    ) -> 'Result':
+        """
+        Returns the result for a profile with the given hits by SBPL rule
+        index. `sbpl` is the rendering of the profile, if already rendered.
+        """
+        if sbpl is None:
+            sbpl = render_profile(profile)
         rules = [
             Rule(
-                self.rules[i].sbpl,
-                hits[i],
-                redundant_hits[i],
-                redundancy_sources[i],
+                sbpl=rule_sbpl,
+                hits=hits[rule_idx],
+                redundant_hits=redundant_hits[rule_idx],
+                redundancy_sources=redundancy_sources[rule_idx],
             )
-            for i in range(len(self.rules))
+            for rule_idx, rule_sbpl in enumerate(sbpl)
         ]
-        return self.__class__(info, rules)
+        return cls(info, rules)
 
     @property
     def rule_count(self) -> int:
@@ -203,10 +192,25 @@ class Result:
         return len(self.only_redundant_deny_rules) / self.rule_count * 100.0
 
 
+# Hits, redundant hits and redundancy sources by SBPL rule index
+RuleHits = Tuple[Dict[int, int], Dict[int, int], Dict[int, List[Optional[int]]]]
+
+
+def deciding_rules(decisions: Dict[int, List[int]]) -> Dict[int, List[int]]:
+    """
+    Inverts decisions, mapping log entries to the rules deciding them.
+    """
+    deciding: Dict[int, List[int]] = defaultdict(list)
+    for rule_idx, log_idxs in decisions.items():
+        for log_idx in log_idxs:
+            deciding[log_idx].append(rule_idx)
+    return deciding
+
+
 @dataclass(frozen=True)
 class App:
     source_path: str
-    sandbox_coverage: Dict[str, Any]
+    sandbox_coverage: Mapping[str, Any]
 
     @property
     def normalisation_replacements(self) -> Dict[str, str]:
@@ -290,30 +294,52 @@ class App:
     @property
     def original(self) -> Result:
         profile: List[Dict[str, Any]] = self.sandbox_profiles['original']
+        return self.result_for(profile, self.decisions, self.redundants)
+
+    def result_for(
+        self,
+        profile: List[Dict[str, Any]],
+        decisions: Dict[int, List[int]],
+        redundants: Dict[int, List[int]],
+        sbpl: Optional[RuleSBPL] = None,
+    ) -> Result:
+        """
+        Returns the result for match results obtained for `profile` itself.
+        """
+        return Result.from_profile(
+            self.info,
+            profile,
+            *self.hits_for(decisions, redundants),
+            sbpl=sbpl,
+        )
 
+    def hits_for(
+        self,
+        decisions: Dict[int, List[int]],
+        redundants: Dict[int, List[int]],
+    ) -> RuleHits:
+        """
+        Returns hits, redundant hits and redundancy sources by SBPL rule
+        index, for match results obtained for a profile itself.
+        """
         hits: Dict[int, int] = defaultdict(int)
-        for original_rule_idx, log_idxs in self.decisions.items():
+        for original_rule_idx, log_idxs in decisions.items():
             rule_idx = self.add_offset(original_rule_idx)
             hits[rule_idx] += len(log_idxs)
 
+        deciding = deciding_rules(decisions)
         redundant_hits: Dict[int, int] = defaultdict(int)
         redundancy_sources: Dict[int, List[Optional[int]]] = defaultdict(list)
-        for original_rule_idx, log_idxs in self.redundants.items():
+        for original_rule_idx, log_idxs in redundants.items():
             rule_idx = self.add_offset(original_rule_idx)
-            sources = self.redundancy_sources(original_rule_idx)
+            sources = self.redundancy_sources(original_rule_idx, decisions, redundants, deciding)
             redundant_hits[rule_idx] += len(log_idxs)
             redundancy_sources[rule_idx] = [
                 self.maybe_add_offset(original_source_idx)
                 for original_source_idx in sources
             ]
 
-        return Result.from_profile(
-            self.info,
-            profile,
-            hits,
-            redundant_hits,
-            redundancy_sources,
-        )
+        return hits, redundant_hits, redundancy_sources
 
     @property
     def normalised(self) -> Result:
@@ -357,12 +383,45 @@ class App:
             redundancy_sources,
         )
 
+    @property
+    def generic_decisions(self) -> Dict[int, List[int]]:
+        d: Dict[str, List[int]] = self.sandbox_coverage['generic_match_results'][
+            'rule_deciding_for_log_entries'
+        ]
+        return {int(idx): logs for idx, logs in d.items()}
+
+    @property
+    def generic_redundants(self) -> Dict[int, List[int]]:
+        d: Dict[str, List[int]] = self.sandbox_coverage['generic_match_results'][
+            'rule_redundant_for_log_entries'
+        ]
+        return {int(idx): logs for idx, logs in d.items()}
+
     @property
     def generalised(self) -> Result:
         profile: List[Dict[str, Any]] = self.sandbox_profiles['general']
+        return Result.from_profile(
+            self.info,
+            profile,
+            *self.generalised_hits(),
+        )
+
+    def generalised_hits(self) -> RuleHits:
+        """
+        Returns hits, redundant hits and redundancy sources by SBPL rule index
+        of the generic profile. Only needs the match results and the rule
+        mapping, not the profiles.
+        """
+        if 'generic_match_results' in self.sandbox_coverage:
+            # Log entries were matched against the generic profile directly
+            return self.hits_for(self.generic_decisions, self.generic_redundants)
+
+        decisions = self.decisions
+        redundants = self.redundants
+        deciding = deciding_rules(decisions)
 
         hits: Dict[int, int] = defaultdict(int)
-        for original_rule_idx, log_idxs in self.decisions.items():
+        for original_rule_idx, log_idxs in decisions.items():
             rule_idx = self.maybe_add_offset(
                 self.generalised_rule_idx(original_rule_idx)
             )
@@ -372,13 +431,13 @@ class App:
 
         redundant_hits: Dict[int, int] = defaultdict(int)
         redundancy_sources: Dict[int, List[Optional[int]]] = defaultdict(list)
-        for original_rule_idx, log_idxs in self.redundants.items():
+        for original_rule_idx, log_idxs in redundants.items():
             rule_idx = self.maybe_add_offset(
                 self.generalised_rule_idx(original_rule_idx)
             )
             if rule_idx is None:
                 continue
-            sources = self.redundancy_sources(original_rule_idx)
+            sources = self.redundancy_sources(original_rule_idx, decisions, redundants, deciding)
             redundant_hits[rule_idx] += len(log_idxs)
             redundancy_sources[rule_idx] = []
             for original_source_idx in sources:
@@ -391,50 +450,191 @@ class App:
                     if source_idx is not None:
                         redundancy_sources[rule_idx].append(source_idx)
 
-        return Result.from_profile(
-            self.info,
-            profile,
-            hits,
-            redundant_hits,
-            redundancy_sources,
-        )
+        return hits, redundant_hits, redundancy_sources
 
-    def redundancy_sources(self, rule_idx: int) -> List[Optional[int]]:
+    def redundancy_sources(
+        self,
+        rule_idx: int,
+        decisions: Optional[Dict[int, List[int]]] = None,
+        redundants: Optional[Dict[int, List[int]]] = None,
+        deciding: Optional[Dict[int, List[int]]] = None,
+    ) -> List[Optional[int]]:
         """
         Returns indexes of rules actually leading to the decision instead of
         the given redundant rule. If the given rule is not redundant, an empty
         list is returned. If a rule is redundant to an implicit default
         decision (not the default rule added at the beginning!), None is added
-        to the result set.
+        to the result set. By default, the match results for the original
+        profile are used. `deciding` is `deciding_rules(decisions)`, if
+        already computed.
         """
+        if decisions is None:
+            decisions = self.decisions
+        if redundants is None:
+            redundants = self.redundants
+        if deciding is None:
+            deciding = deciding_rules(decisions)
+
+        related = set()
+        implicit = False
+        for log in redundants[rule_idx]:
+            if log in deciding:
+                related.update(deciding[log])
+            else:
+                implicit = True
+
+        result: List[Optional[int]] = sorted(related)
+        if implicit:
+            result.append(None)
 
-        result: List[Optional[int]] = []
-        logs = self.redundants[rule_idx]
-        logs_identified = logs.copy()
-
-        for related_rule_idx, decision_logs in self.decisions.items():
-            for log in logs:
-                if log in decision_logs:
-                    if related_rule_idx not in result:
-                        result.append(related_rule_idx)
-                    logs_identified.remove(log)
+        return result
 
-        result = sorted(result)
 
-        if 0 < len(logs_identified):
+class GeneralisedTotals:
+    """
+    Generalised hits of apps sharing a generic profile with `rule_count`
+    rules, folded per rule. Memory is bounded by the number of rules, not by
+    the number of apps.
+    """
+
+    def __init__(self, rule_count: int) -> None:
+        self.rule_count = rule_count
+        self.apps = 0
+        self.first_path: Optional[str] = None
+        # By SBPL rule index, including the version statement
+        self.hits = [0] * (rule_count + 1)
+        self.redundant_hits = [0] * (rule_count + 1)
+        self.redundancy_sources: List[Set[Optional[int]]] = [set() for _ in range(rule_count + 1)]
+
+    def add(self, path: str, rule_hits: RuleHits) -> None:
+        hits, redundant_hits, redundancy_sources = rule_hits
+        self.apps += 1
+        if self.first_path is None or path < self.first_path:
+            self.first_path = path
+        for rule_idx, count in hits.items():
+            if rule_idx < len(self.hits):
+                self.hits[rule_idx] += count
+        for rule_idx, count in redundant_hits.items():
+            if rule_idx < len(self.redundant_hits):
+                self.redundant_hits[rule_idx] += count
+        for rule_idx, sources in redundancy_sources.items():
+            if rule_idx < len(self.redundancy_sources):
+                self.redundancy_sources[rule_idx].update(sources)
+
+    def merge(self, other: 'GeneralisedTotals') -> None:
+        self.apps += other.apps
+        if self.first_path is None or (other.first_path is not None and other.first_path < self.first_path):
+            self.first_path = other.first_path
+        for rule_idx in range(len(self.hits)):
+            self.hits[rule_idx] += other.hits[rule_idx]
+            self.redundant_hits[rule_idx] += other.redundant_hits[rule_idx]
+            self.redundancy_sources[rule_idx] |= other.redundancy_sources[rule_idx]
+
+    def sources(self, rule_idx: int) -> List[Optional[int]]:
+        """
+        Returns the redundancy sources of a rule, ascending, with None for
+        implicit decisions last.
+        """
+        sources = self.redundancy_sources[rule_idx]
+        result: List[Optional[int]] = sorted(source for source in sources if source is not None)
+        if None in sources:
             result.append(None)
-
         return result
 
 
-@jj.environmentfilter
-def pygmentize(env: jj.Environment, sbpl: str) -> str:
-    assert env.autoescape
+class CoverageAggregate:
+    """
+    Generalised hits of many apps, by the number of rules of their generic
+    profile. Aggregates of parts of the results are merged.
+    """
+
+    def __init__(self) -> None:
+        self.totals: Dict[int, GeneralisedTotals] = dict()
+
+    def add_app(self, app: App) -> None:
+        rule_count = len(app.sandbox_profiles['general'])
+        if rule_count not in self.totals:
+            self.totals[rule_count] = GeneralisedTotals(rule_count)
+        self.totals[rule_count].add(app.source_path, app.generalised_hits())
 
-    lexer = SchemeLexer(stripall=True)
-    formatter = HtmlFormatter()
-    html = highlight(sbpl, lexer, formatter)
-    return jj.Markup(html)
+    def merge(self, other: 'CoverageAggregate') -> None:
+        for rule_count, totals in other.totals.items():
+            if rule_count in self.totals:
+                self.totals[rule_count].merge(totals)
+            else:
+                self.totals[rule_count] = totals
+
+    def reference(self) -> Optional[GeneralisedTotals]:
+        """
+        Returns the totals of the apps sharing the generic profile of the
+        first app, by path. Other apps are incompatible.
+        """
+        return min(self.totals.values(), key=lambda totals: totals.first_path, default=None)
+
+
+def aggregate_paths(paths: List[str]) -> CoverageAggregate:
+    """
+    Folds the generalised hits of the given results, and of all results in
+    the given directories, into a new aggregate.
+    """
+    aggregate = CoverageAggregate()
+    for path in paths:
+        for result_path in find_results(path) if os.path.isdir(path) else [path]:
+            # Only the match results and the rule mapping are decoded from
+            # containers, the generic profile is shared.
+            abs_path = os.path.abspath(result_path)
+            aggregate.add_app(App(abs_path, load_results(abs_path)))
+    return aggregate
+
+
+def aggregate_results(results_dir: str, jobs: int) -> CoverageAggregate:
+    """
+    Aggregates the generalised hits of all results below `results_dir`. The
+    directories below it are walked and folded by `jobs` processes, each
+    into aggregates of its own, which are merged as they complete.
+    """
+    paths: List[str] = []
+    for fn in reversed(list(RESULT_NAMES.values())):
+        if os.path.isfile(os.path.join(results_dir, fn)):
+            paths.append(os.path.join(results_dir, fn))
+            break
+    for entry in sorted(os.scandir(results_dir), key=lambda entry: entry.name):
+        if entry.is_dir() and entry.name != PROFILE_STORE_NAME:
+            paths.append(entry.path)
+
+    if jobs <= 1:
+        return aggregate_paths(paths)
+
+    # Several batches per process balance apps with many results.
+    batch_count = AGGREGATION_BATCHES * jobs
+    batches = [paths[i::batch_count] for i in range(min(batch_count, len(paths)))]
+    aggregate = CoverageAggregate()
+    with ProcessPoolExecutor(max_workers=jobs) as executor:
+        for future in as_completed([executor.submit(aggregate_paths, batch) for batch in batches]):
+            aggregate.merge(future.result())
+    return aggregate
+
+
+def highlight_cache_for(path: str, cache_dir: Optional[str] = None) -> HighlightCache:
+    """
+    Returns a cache of highlighted rules for the results at `path`, kept in
+    `cache_dir` or else in the profile store of the results, if any.
+    """
+    if cache_dir is not None:
+        return HighlightCache(cache_dir)
+    if path == '-':
+        return HighlightCache()
+    store = find_profile_store(path if os.path.isdir(path) else os.path.dirname(os.path.abspath(path)))
+    return HighlightCache(os.path.join(store.path, HIGHLIGHT_DIR) if store is not None else None)
+
+
+def pygmentize_with(highlights: HighlightCache) -> Any:
+    @jj.environmentfilter
+    def pygmentize(env: jj.Environment, sbpl: str) -> str:
+        assert env.autoescape
+        return jj.Markup(highlights.highlight(sbpl))
+
+    return pygmentize
 
 
 @jj.environmentfilter
@@ -446,113 +646,113 @@ def num(env: jj.Environment, value: int) -> str:
     return '\u2009'.join(parts[::-1])
 
 
-def generate_single_app_report(
-    app: App,
-    report_type: str,
-    title: str,
-) -> str:
-    if report_type == 'original':
-        result = app.original
-    elif report_type == 'normalised':
-        result = app.normalised
-    elif report_type == 'generalised':
-        result = app.generalised
-    else:
-        assert False, f"Unhandled single-app report type: {report_type}"
-
+def report_environment(highlights: Optional[HighlightCache] = None) -> jj.Environment:
     env = jj.Environment(
         loader=jj.FileSystemLoader(os.path.join(
             os.path.dirname(os.path.abspath(__file__)), 'data', 'templates',
         )),
         autoescape=jj.select_autoescape(['html', 'xml']),
     )
-    env.filters['pygmentize'] = pygmentize
+    env.filters['pygmentize'] = pygmentize_with(highlights if highlights is not None else HighlightCache())
     env.filters['num'] = num
+    return env
+
+
+def single_app_result(app: App, report_type: str) -> Result:
+    if report_type == 'original':
+        return app.original
+    elif report_type == 'normalised':
+        return app.normalised
+    elif report_type == 'generalised':
+        return app.generalised
+    else:
+        assert False, f"Unhandled single-app report type: {report_type}"
+
+
+def generate_single_app_report(
+    app: App,
+    report_type: str,
+    title: str,
+    highlights: Optional[HighlightCache] = None,
+) -> str:
+    result = single_app_result(app, report_type)
+
+    env = report_environment(highlights)
     template = env.get_template('report_profile.htm')
     html = template.render(
         title=title,
-        pygments_css=HtmlFormatter().get_style_defs(),
+        pygments_css=highlight_css(),
         app=result,
     )
     return html
 
 
-def generate_aggregated_report(
-    apps: List[App],
-    title: str,
-) -> str:
-    assert 0 < len(apps)
-
-    results: List[Result] = [app.generalised for app in apps]
+def aggregated_result(aggregate: CoverageAggregate) -> Result:
+    reference = aggregate.reference()
+    assert reference is not None
 
     # TODO Sanity check that all apps use the same generalised profile
-
-    # Calculate total generalised hits
-    hits: Dict[int, int] = defaultdict(int)
-    redundant_hits: Dict[int, int] = defaultdict(int)
-    redundancy_sources: Dict[int, List[Optional[int]]] = defaultdict(list)
-    rule_count = results[0].rule_count
-    for app, result in zip(apps, results):
-        if rule_count != result.rule_count:
+    for totals in aggregate.totals.values():
+        if totals is not reference:
             print(
-                f"Skipped incompatible report: {app.source_path}",
+                f"Skipped {totals.apps} incompatible reports, e.g. {totals.first_path}",
                 file=sys.stderr,
             )
-        for rule_idx, rule in enumerate(result.rules):
-            hits[rule_idx] += rule.hits
-            redundant_hits[rule_idx] += rule.redundant_hits
-            for source in rule.redundancy_sources:
-                if source not in redundancy_sources[rule_idx]:
-                    redundancy_sources[rule_idx].append(source)
-            has_implicit = None in redundancy_sources[rule_idx]
-            redundancy_sources[rule_idx] = sorted([
-                s for s in redundancy_sources[rule_idx] if s is not None
-            ])
-            if has_implicit:
-                redundancy_sources[rule_idx].append(None)
-    aggregated = results[0].with_manual_results(
+
+    # Only the profile of a single app is rendered.
+    app = App(reference.first_path, load_results(reference.first_path))
+    aggregated = Result.from_profile(
         AppInfo.empty('Generalised Results'),
-        hits,
-        redundant_hits,
-        redundancy_sources,
+        app.sandbox_profiles['general'],
+        dict(enumerate(reference.hits)),
+        dict(enumerate(reference.redundant_hits)),
+        {rule_idx: reference.sources(rule_idx) for rule_idx in range(len(reference.hits))},
     )
+    return aggregated
+
+
+def generate_aggregated_report(
+    aggregate: CoverageAggregate,
+    title: str,
+    highlights: Optional[HighlightCache] = None,
+) -> str:
+    aggregated = aggregated_result(aggregate)
 
     # Render HTML
-    env = jj.Environment(
-        loader=jj.FileSystemLoader(os.path.join(
-            os.path.dirname(os.path.abspath(__file__)), 'data', 'templates',
-        )),
-        autoescape=jj.select_autoescape(['html', 'xml']),
-    )
-    env.filters['pygmentize'] = pygmentize
-    env.filters['num'] = num
+    env = report_environment(highlights)
     template = env.get_template('report_profile.htm')
     html = template.render(
         title=title,
-        pygments_css=HtmlFormatter().get_style_defs(),
+        pygments_css=highlight_css(),
         app=aggregated,
     )
     return html
 
 
+def tabular_results(apps: List[App]) -> List[Result]:
+    """
+    Returns the results for the original profiles of the apps. Profiles are
+    rendered in batches, not one process per app.
+    """
+    results: List[Result] = []
+    for batch in chunks(apps, RENDER_BATCH):
+        profiles = [app.sandbox_profiles['original'] for app in batch]
+        for app, profile, sbpl in zip(batch, profiles, render_profiles(profiles)):
+            results.append(app.result_for(profile, app.decisions, app.redundants, sbpl))
+    return results
+
+
 def generate_tabular_report(
     apps: List[App],
     title: str,
 ) -> Optional[str]:
     assert 0 < len(apps)
 
-    results = [app.original for app in apps]
+    results = tabular_results(apps)
     average_coverage = sum(app.coverage for app in results) / len(results)
 
     # Render HTML
-    env = jj.Environment(
-        loader=jj.FileSystemLoader(os.path.join(
-            os.path.dirname(os.path.abspath(__file__)), 'data', 'templates',
-        )),
-        autoescape=jj.select_autoescape(['html', 'xml']),
-    )
-    env.filters['pygmentize'] = pygmentize
-    env.filters['num'] = num
+    env = report_environment()
     template = env.get_template('report_tabular.htm')
     html = template.render(
         title=title,
@@ -562,6 +762,90 @@ def generate_tabular_report(
     return html
 
 
+class ReportShards:
+    """
+    Shards of a paged report, written to a directory next to its index page
+    as they are rendered. Each shard is a script passing the JSON of its
+    items' HTML to `loadReportShard`, see `shard_loader` in
+    data/templates/report_items.htm, so reports also load from local files.
+    """
+
+    def __init__(self, report_path: str) -> None:
+        self.directory = os.path.splitext(report_path)[0] + SHARDS_SUFFIX
+        # Relative to the index page
+        self.paths: List[str] = []
+        os.makedirs(self.directory, exist_ok=True)
+
+    def write(self, html: str) -> None:
+        name = f'shard-{len(self.paths):05d}.js'
+        with open(os.path.join(self.directory, name), 'w') as fp:
+            fp.write('loadReportShard(')
+            json.dump({'index': len(self.paths), 'html': html}, fp)
+            fp.write(');\n')
+        self.paths.append(f'{os.path.basename(self.directory)}/{name}')
+
+
+def write_paged_profile_report(
+    result: Result,
+    title: str,
+    report_path: str,
+    chunk_size: int,
+    highlights: Optional[HighlightCache] = None,
+) -> None:
+    """
+    Writes a profile report whose rules are loaded in shards of `chunk_size`
+    rules.
+    """
+    env = report_environment(highlights)
+    items = env.get_template('report_items.htm').module
+    shards = ReportShards(report_path)
+    for start in range(0, len(result.rules), chunk_size):
+        rules = enumerate(result.rules[start:start + chunk_size], start)
+        shards.write(''.join(str(items.rule_item(rule, rule_idx)) for rule_idx, rule in rules))
+
+    template = env.get_template('report_profile_paged.htm')
+    template.stream(
+        title=title,
+        pygments_css=highlight_css(),
+        app=result,
+        shards=shards.paths,
+        items_per_shard=chunk_size,
+    ).dump(report_path)
+
+
+def write_paged_tabular_report(
+    apps: Iterable[App],
+    title: str,
+    report_path: str,
+    chunk_size: int,
+) -> None:
+    """
+    Writes a tabular report whose rows are loaded in shards of `chunk_size`
+    apps. Apps are consumed and rendered one shard at a time, so only the
+    results of a single shard are held in memory.
+    """
+    env = report_environment()
+    items = env.get_template('report_items.htm').module
+    shards = ReportShards(report_path)
+    app_count = 0
+    total_coverage = 0.0
+    for batch in chunks(apps, chunk_size):
+        results = tabular_results(batch)
+        shards.write(''.join(str(items.app_row(result)) for result in results))
+        app_count += len(results)
+        total_coverage += sum(result.coverage for result in results)
+    assert 0 < app_count
+
+    template = env.get_template('report_tabular_paged.htm')
+    template.stream(
+        title=title,
+        average_coverage=total_coverage / app_count,
+        app_count=app_count,
+        shards=shards.paths,
+        items_per_shard=chunk_size,
+    ).dump(report_path)
+
+
 def main():
     parser = argparse.ArgumentParser(
         "Create a HTML report for covered sandbox rules."
@@ -597,44 +881,97 @@ def main():
     parser.add_argument(
         'coverage_result',
         help="""
-        Results generated by the sandbox_coverage script. Can be set to - to
-        read from standard input. This will be interpreted as a result for the
-        report types 'aggregated' and 'tabular' (see --type).
+        Results generated by the sandbox_coverage script, as JSON or results
+        container. Can be set to - to read from standard input. This will be
+        interpreted as a result for the report types 'aggregated' and
+        'tabular' (see --type).
+        """,
+    )
+    parser.add_argument(
+        '-j', '--jobs',
+        type=int,
+        default=os.cpu_count(),
+        help="""
+        Number of processes aggregating results for the 'aggregated' report.
+        (default: number of CPUs)
+        """,
+    )
+    parser.add_argument(
+        '--highlight-cache',
+        default=None,
+        help=f"""
+        Directory highlighted rules are cached in, shared by reports.
+        (default: {HIGHLIGHT_DIR} in the profile store of the results, if
+        any)
+        """,
+    )
+    parser.add_argument(
+        '--paged',
+        action='store_true',
+        help=f"""
+        Write a small index page, which loads the rules or applications in
+        shards as it is scrolled. The shards are written to a directory
+        named after the report with the suffix {SHARDS_SUFFIX}. Use this for
+        large corpora.
+        """,
+    )
+    parser.add_argument(
+        '--chunk-size',
+        type=int,
+        default=CHUNK_SIZE,
+        help=f"""
+        Number of rules or applications per shard of a paged report.
+        (default: {CHUNK_SIZE})
         """,
     )
     parser.add_argument('report', help="The generated HTML report.")
 
     args = parser.parse_args()
 
-    if args.report_type in ['aggregated', 'tabular']:
-        apps: List[App] = []
-        for root, dirs, files in os.walk(args.coverage_result):
-            for fn in files:
-                if fn == 'sandbox_coverage.json':
-                    abs_path = os.path.abspath(os.path.join(root, fn))
-                    with open(abs_path, 'r') as fp:
-                        sandbox_coverage: Dict[str, Any] = json.load(fp)
-                    app = App(abs_path, sandbox_coverage)
-                    apps.append(app)
-        if args.report_type == 'aggregated':
-            html = generate_aggregated_report(apps, args.title)
-        elif args.report_type == 'tabular':
-            html = generate_tabular_report(apps, args.title)
-        else:
-            assert False, "Unhandled multi-app report type: {args.report_type}"
+    if args.report_type == 'aggregated':
+        aggregate = aggregate_results(args.coverage_result, args.jobs)
+        highlights = highlight_cache_for(args.coverage_result, args.highlight_cache)
+        if args.paged:
+            write_paged_profile_report(
+                aggregated_result(aggregate), args.title, args.report, args.chunk_size, highlights,
+            )
+            return
+        html = generate_aggregated_report(aggregate, args.title, highlights)
+
+    elif args.report_type == 'tabular':
+        # Containers are decoded lazily, so only the parts of the results a
+        # report shows are read.
+        apps = (
+            App(os.path.abspath(path), load_results(os.path.abspath(path)))
+            for path in find_results(args.coverage_result)
+        )
+        if args.paged:
+            write_paged_tabular_report(apps, args.title, args.report, args.chunk_size)
+            return
+        html = generate_tabular_report(list(apps), args.title)
 
     else:
         if args.coverage_result == '-':
-            sandbox_coverage: Dict[str, Any] = json.load(sys.stdin)
+            data = sys.stdin.buffer.read()
+            if data.startswith(MAGIC):
+                sandbox_coverage = ResultsContainer(data).state()
+            else:
+                sandbox_coverage = json.loads(data)
         else:
-            with open(args.coverage_result, 'r') as fp:
-                sandbox_coverage: Dict[str, Any] = json.load(fp)
+            sandbox_coverage = load_results(args.coverage_result)
         abs_path = os.path.abspath(args.coverage_result)
         app = App(abs_path, sandbox_coverage)
+        highlights = highlight_cache_for(args.coverage_result, args.highlight_cache)
+        if args.paged:
+            write_paged_profile_report(
+                single_app_result(app, args.report_type), args.title, args.report, args.chunk_size, highlights,
+            )
+            return
         html = generate_single_app_report(
             app,
             args.report_type,
             args.title,
+            highlights,
         )
 
     with open(args.report, 'w') as fp:
@@ -11,7 +11,6 @@ import argparse
 import os
 import sys
 import json
-import base64
 
 from typing import Any, Dict, List
 
@@ -19,11 +18,13 @@ sys.path.append(os.path.join(os.path.dirname(__file__), "maap"))
 
 from maap.misc.logger import create_logger
 
-from sblogs.gather import gather_logs
+from sblogs.gather import gather_logs, COLLECTION_MODES
 from sblogs.process import process_logs
-from sblogs.match import perform_matching
+from sblogs.match import perform_matching, MATCHING_STRATEGIES
+from sblogs.generic import perform_generic_matching
 from sbprofiles.normalise import normalise_profile, Platform
 from sbprofiles.generalise import generalise_results
+from sbresults.container import serialise
 
 logger = create_logger('sandbox_coverage')
 
@@ -37,32 +38,7 @@ def get_generic_profile() -> List[Dict[str, Any]]:
 
 
 def dump_state(state: dict, fp=sys.stdout):
-    def serialise(input):
-        """
-        Serialise byte strings. First try decoding them as JSON, if that does not work out
-        encode the byte string as base64.
-        This function traverses lists and dicts, modifying their items as required.
-        """
-        if isinstance(input, dict):
-            serialised = [(serialise(k), serialise(v)) for (k, v) in input.items()]
-            return dict(serialised)
-        elif isinstance(input, list):
-            return [serialise(x) for x in input]
-        elif isinstance(input, bytes):
-            # Try decoding as JSON
-            try:
-                d = json.loads(input)
-                return serialise(d)
-            except (json.JSONDecodeError, UnicodeError):
-                pass
-
-            # Not valid JSON: Fall back to base64
-            return serialise(base64.encodebytes(input).decode())
-        else:
-            return input
-
-    new_state = serialise(state)
-    json.dump(new_state, fp, indent=4, sort_keys=True)
+    json.dump(serialise(state), fp, indent=4, sort_keys=True)
 
 
 def main():
@@ -71,12 +47,35 @@ def main():
                         help='Path to the app for which to compute sandbox coverage data.')
     parser.add_argument('--timeout', required=False, default=None, type=int,
                         help='Number of seconds to wait before killing the program. Leave unspecified to not kill the program at all.')
+    parser.add_argument('--strategy', required=False, default='linear', choices=MATCHING_STRATEGIES,
+                        help='Strategy for attributing log entries to rules. "bisect" needs fewer matcher runs, but does not detect redundant rules.')
+    parser.add_argument('--keep-shadowed', required=False, action='store_true',
+                        help='Also attribute log entries to rules fully shadowed by later rules, which never decide.')
+    parser.add_argument('--match-generic', required=False, action='store_true',
+                        help='Also match log entries against the generic profile directly, with the concrete values of the app substituted for its placeholders. Always uses the portable evaluator.')
+    parser.add_argument('--workers', required=False, default=1, type=int,
+                        help='Number of sandboxed worker processes checking log entries in parallel.')
+    parser.add_argument('--collection', required=False, default='show', choices=COLLECTION_MODES,
+                        help='How sandbox logs are collected. "stream" processes logs while the app is running instead of dumping them afterwards.')
+    parser.add_argument('--saturation-window', required=False, default=None, type=float,
+                        help='Stop the app once no new log entry appeared for this many seconds. Implies "--collection stream".')
+    parser.add_argument('--entry-timeout', required=False, default=0, type=int,
+                        help='Number of milliseconds a single log entry may take to be checked. Slower entries are left unmatched. 0 means no limit.')
+    parser.add_argument('--run-timeout', required=False, default=0, type=int,
+                        help='Number of milliseconds a single matcher run may spend performing operations. 0 means no limit.')
     args = parser.parse_args()
 
     state = {
         'arguments': {
             'app': args.app,
-            'timeout': args.timeout
+            'timeout': args.timeout,
+            'collection': args.collection,
+            'saturation_window': args.saturation_window,
+            'strategy': args.strategy,
+            'skip_shadowed': not args.keep_shadowed,
+            'workers': args.workers,
+            'entry_timeout': args.entry_timeout,
+            'run_timeout': args.run_timeout
         },
         'sandbox_profiles': {
             'general': get_generic_profile()
@@ -113,6 +112,13 @@ def main():
         dump_state(state, fp=sys.stderr)
         return
 
+    if args.match_generic:
+        success, state = perform_generic_matching(state)
+        if not success:
+            print("Could not match against the generic profile.", file=sys.stderr)
+            dump_state(state, fp=sys.stderr)
+            return
+
     dump_state(state)
 
 if __name__ == "__main__":
@@ -12,11 +12,11 @@ sys.path.append(os.path.join(os.path.dirname(__file__), "maap"))
 from maap import driver
 from maap.bundle.bundle import Bundle
 from sandbox_coverage import dump_state, get_generic_profile
-from sblogs.gather import gather_logs
-from sblogs.process import process_logs
-from sblogs.match import perform_matching
-from sbprofiles.normalise import normalise_profile
-from sbprofiles.generalise import generalise_results
+from sandbox_coverage_pipeline import AnalysisPipeline, DEFAULT_STAGES, analyse_collected
+from sblogs.gather import gather_logs, COLLECTION_MODES
+from sblogs.match import MATCHING_STRATEGIES
+from sbresults.container import OUTPUT_FORMATS, RESULT_NAMES
+from sbresults.store import PROFILE_STORE_NAME
 
 
 class SandboxCoverageDriver(driver.Driver):
@@ -25,10 +25,34 @@ class SandboxCoverageDriver(driver.Driver):
         self,
         profile: dict,
         timeout: Optional[int] = None,
+        collection: str = 'show',
+        saturation_window: Optional[float] = None,
+        strategy: str = 'linear',
+        skip_shadowed: bool = True,
+        match_generic: bool = False,
+        workers: int = 1,
+        entry_timeout: int = 0,
+        run_timeout: int = 0,
+        pipeline: Optional[AnalysisPipeline] = None,
+        output_format: str = 'json',
+        profile_store: Optional[str] = None,
     ) -> None:
         super().__init__('sandbox_coverage_driver')
         self.profile = profile
         self.timeout = timeout
+        self.collection = collection
+        self.saturation_window = saturation_window
+        self.strategy = strategy
+        self.skip_shadowed = skip_shadowed
+        self.stages = list(DEFAULT_STAGES)
+        if match_generic:
+            self.stages.append('match_generic')
+        self.workers = workers
+        self.entry_timeout = entry_timeout
+        self.run_timeout = run_timeout
+        self.pipeline = pipeline
+        self.output_format = output_format
+        self.profile_store = profile_store
 
     def error(self, app: Bundle, msg: str, state: dict) -> None:
         with io.StringIO() as fp:
@@ -37,7 +61,7 @@ class SandboxCoverageDriver(driver.Driver):
         self.logger.error(f"{app.filepath}: {msg}: {s}")
 
     def analyse(self, app: Bundle, out_dir: str) -> driver.Result:
-        out_fn = os.path.join(out_dir, 'sandbox_coverage.json')
+        out_fn = os.path.join(out_dir, RESULT_NAMES[self.output_format])
 
         # Skip application if we already obtained results
         if os.path.exists(out_fn):
@@ -49,6 +73,13 @@ class SandboxCoverageDriver(driver.Driver):
             'arguments': {
                 'app': app.filepath,
                 'timeout': self.timeout,
+                'collection': self.collection,
+                'saturation_window': self.saturation_window,
+                'strategy': self.strategy,
+                'skip_shadowed': self.skip_shadowed,
+                'workers': self.workers,
+                'entry_timeout': self.entry_timeout,
+                'run_timeout': self.run_timeout,
             },
             'sandbox_profiles': {
                 'general': self.profile,
@@ -60,29 +91,18 @@ class SandboxCoverageDriver(driver.Driver):
             self.error(app, "Could not gather logs", state)
             return driver.Result.ERROR
 
-        success, state = process_logs(state)
-        if not success:
-            self.error(app, "Could not process logs", state)
-            return driver.Result.ERROR
-
-        success, state = perform_matching(state)
-        if not success:
-            self.error(app, "Could not perform matching", state)
-            return driver.Result.ERROR
-
-        success, state = normalise_profile(state)
-        if not success:
-            self.error(app, "Could not normalise sandbox profiles", state)
-            return driver.Result.ERROR
+        # Further stages run in the background, while the next app is
+        # collected. OK only means that the logs were collected; apps whose
+        # analysis fails are reported when the pipeline is closed.
+        if self.pipeline is not None:
+            self.pipeline.submit(app.filepath, state, out_fn)
+            return driver.Result.OK
 
-        success, state = generalise_results(state)
+        success, error = analyse_collected(state, out_fn, self.stages, self.profile_store)
         if not success:
-            self.error(app, "Could not generalise results", state)
+            self.logger.error(f"{app.filepath}: {error}")
             return driver.Result.ERROR
 
-        with open(out_fn, 'w') as fp:
-            dump_state(state, fp)
-
         self.logger.info(f"{app.filepath}: Successfully analysed.")
         return driver.Result.OK
 
@@ -96,6 +116,107 @@ def main() -> None:
         default=driver.Selection.ALL,
         help="Only analyse applications specified by type. (default 'all')",
     )
+    parser.add_argument(
+        '-c', '--collection',
+        choices=COLLECTION_MODES,
+        default='show',
+        help="""
+            How sandbox logs are collected. 'stream' processes logs while the
+            app is running instead of dumping them afterwards. (default 'show')
+        """,
+    )
+    parser.add_argument(
+        '--saturation-window',
+        type=float,
+        default=None,
+        help="""
+            Stop apps once no new log entry appeared for this many seconds,
+            instead of always running them until the timeout. Implies
+            '--collection stream'.
+        """,
+    )
+    parser.add_argument(
+        '-s', '--strategy',
+        choices=MATCHING_STRATEGIES,
+        default='linear',
+        help="""
+            Strategy for attributing log entries to rules. 'bisect' needs
+            fewer matcher runs, but does not detect redundant rules.
+            (default 'linear')
+        """,
+    )
+    parser.add_argument(
+        '--keep-shadowed',
+        action='store_true',
+        help="""
+            Also attribute log entries to rules fully shadowed by later rules.
+            Such rules never decide and are skipped by default.
+        """,
+    )
+    parser.add_argument(
+        '--match-generic',
+        action='store_true',
+        help="""
+            Also match log entries against the generic profile directly, with
+            the app's concrete values substituted for its placeholders.
+        """,
+    )
+    parser.add_argument(
+        '-w', '--workers',
+        type=int,
+        default=1,
+        help="""
+            Number of sandboxed worker processes checking log entries in
+            parallel. (default 1)
+        """,
+    )
+    parser.add_argument(
+        '--entry-timeout',
+        type=int,
+        default=0,
+        help="""
+            Number of milliseconds a single log entry may take to be checked.
+            Slower entries are left unmatched. (default 0, no limit)
+        """,
+    )
+    parser.add_argument(
+        '--run-timeout',
+        type=int,
+        default=0,
+        help="""
+            Number of milliseconds a single matcher run may spend performing
+            operations. (default 0, no limit)
+        """,
+    )
+    parser.add_argument(
+        '-j', '--jobs',
+        type=int,
+        default=0,
+        help="""
+            Number of worker processes analysing collected logs, while the
+            next app is collected. 0 analyses each app right after collecting
+            its logs. (default 0)
+        """,
+    )
+    parser.add_argument(
+        '-q', '--queue-size',
+        type=int,
+        default=None,
+        help="""
+            Number of collected apps waiting for or undergoing analysis before
+            collection blocks. (default: twice the number of jobs)
+        """,
+    )
+    parser.add_argument(
+        '--output-format',
+        choices=OUTPUT_FORMATS,
+        default='json',
+        help="""
+            Write results as JSON or as compact results containers, which
+            reports read without decoding unused parts. Containers share a
+            profile store in the output directory. (default 'json')
+        """,
+    )
     parser.add_argument(
         'applications',
         help="""
@@ -116,8 +237,41 @@ def main() -> None:
 
     profile = get_generic_profile()
 
-    sbc = SandboxCoverageDriver(profile=profile, timeout=60)
-    sbc.run(apps_dir, out_dir, selection)
+    # Containers share a profile store at the root of the results.
+    profile_store = None
+    if args.output_format == 'container':
+        profile_store = os.path.join(out_dir, PROFILE_STORE_NAME)
+
+    pipeline = None
+    if 0 < args.jobs:
+        stages = list(DEFAULT_STAGES)
+        if args.match_generic:
+            stages.append('match_generic')
+        pipeline = AnalysisPipeline(args.jobs, args.queue_size, stages, profile_store)
+
+    sbc = SandboxCoverageDriver(
+        profile=profile,
+        timeout=60,
+        collection=args.collection,
+        saturation_window=args.saturation_window,
+        strategy=args.strategy,
+        skip_shadowed=not args.keep_shadowed,
+        match_generic=args.match_generic,
+        workers=args.workers,
+        entry_timeout=args.entry_timeout,
+        run_timeout=args.run_timeout,
+        pipeline=pipeline,
+        output_format=args.output_format,
+        profile_store=profile_store,
+    )
+    failures = []
+    try:
+        sbc.run(apps_dir, out_dir, selection)
+    finally:
+        if pipeline is not None:
+            failures = pipeline.close()
+    if failures:
+        sys.exit(1)
 
 
 if __name__ == '__main__':
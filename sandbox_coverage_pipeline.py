@@ -0,0 +1,325 @@
+#!/usr/bin/env python3
+
+"""
+Pipelined analysis of multiple apps.
+
+Collecting logs has to happen one app at a time, because it patches the
+`Container.plist` of the app under test and runs the app. The remaining
+stages are independent per app and mostly CPU bound. The pipeline therefore
+hands collected states to a pool of worker processes, which process the logs,
+perform matching and normalise and generalise the results, while the next app
+is already being collected.
+
+At most `queue_size` collected states wait for or undergo analysis. Once that
+many are in flight, submitting another state blocks collection until a worker
+finishes, so memory usage stays bounded. Progress and the time collection
+spent blocked are logged. The apps whose analysis failed are reported once
+the pipeline is closed, and the scripts exit with a non-zero status.
+
+In replay mode, recorded states are fed into the pipeline instead of
+collecting logs, which allows running the pipeline without macOS. Only the
+outputs of the selected stages are discarded, so e.g. matching can be
+repeated with `--stages process,match,generalise`, reusing the recorded
+normalisation. The optional `match_generic` stage matches log entries against
+the generic profile directly, always with the portable evaluator, see
+`sblogs/generic.py`. Where the sandbox is not available, log entries are
+matched using the portable evaluator, see `sblogs/evaluate.py`.
+
+Results are written as JSON, or as compact results containers with
+`--output-format container`, see `sbresults/container.py`. Containers
+reference their profiles in a store shared by all apps, see
+`sbresults/store.py`. Both formats can be replayed.
+
+With a checkpoint interval, matching progress is saved next to the results of
+each app, so replaying again after an interruption resumes matching instead of
+starting over.
+"""
+import argparse
+import io
+import os
+import sys
+import threading
+import time
+
+from concurrent.futures import Future, ProcessPoolExecutor
+from typing import List, Optional, Tuple
+
+sys.path.append(os.path.join(os.path.dirname(__file__), "maap"))
+
+from maap.misc.logger import create_logger
+
+from sandbox_coverage import dump_state
+from sblogs.process import process_logs
+from sblogs.match import MATCHING_EVALUATORS, perform_matching
+from sblogs.generic import perform_generic_matching
+from sbprofiles.normalise import normalise_profile
+from sbprofiles.generalise import generalise_results
+from sbresults.container import RESULT_NAMES, OUTPUT_FORMATS, find_results, load_results, restore_state, write_container
+from sbresults.store import PROFILE_STORE_NAME, open_profile_store
+
+logger = create_logger('sandbox_coverage_pipeline')
+
+# Stages following log collection, in order, with the message logged if they
+# fail.
+STAGES = {
+    'process': (process_logs, "Could not process logs"),
+    'match': (perform_matching, "Could not perform matching"),
+    'normalise': (normalise_profile, "Could not normalise sandbox profiles"),
+    'generalise': (generalise_results, "Could not generalise results"),
+    'match_generic': (perform_generic_matching, "Could not match against the generic profile"),
+}
+
+# Stages run unless selected otherwise. Matching against the generic profile
+# is optional.
+DEFAULT_STAGES = ['process', 'match', 'normalise', 'generalise']
+
+# Parts of the state produced by each of the stages above, as paths of keys.
+# Removed from recorded states before the stage is replayed.
+STAGE_OUTPUTS = {
+    'process': [('logs', 'processed')],
+    'match': [('match_results',), ('match_stats',)],
+    'normalise': [('sandbox_profiles', 'normalised'), ('normalisation_replacements',)],
+    'generalise': [('rule_mapping',)],
+    'match_generic': [('generic_match_results',), ('generic_match_stats',)],
+}
+
+
+# Name of the matching checkpoint file in each app's output directory
+CHECKPOINT_NAME = 'matching.checkpoint'
+
+
+def discard_outputs(state: dict, stages: List[str]) -> None:
+    for stage in stages:
+        for path in STAGE_OUTPUTS[stage]:
+            parent = state
+            for key in path[:-1]:
+                parent = parent.get(key, {})
+            parent.pop(path[-1], None)
+
+
+def analyse_collected(
+    state: dict,
+    out_fn: str,
+    stages: List[str],
+    profile_store: Optional[str] = None,
+) -> Tuple[bool, str]:
+    """
+    Runs the given stages on a state containing collected logs and writes the
+    resulting state to `out_fn`, as a results container if it is named like
+    one. Profiles of containers are added to `profile_store`, if given.
+    Returns whether all stages succeeded and, if not, an error message
+    including the state.
+    """
+    for stage in stages:
+        run_stage, error = STAGES[stage]
+        success, state = run_stage(state)
+        if not success:
+            with io.StringIO() as fp:
+                dump_state(state, fp)
+                return False, f"{error}: {fp.getvalue()}"
+
+    if os.path.basename(out_fn) == RESULT_NAMES['container']:
+        store = None if profile_store is None else open_profile_store(profile_store)
+        with open(out_fn, 'wb') as fp:
+            write_container(state, fp, store)
+    else:
+        with open(out_fn, 'w') as fp:
+            dump_state(state, fp)
+
+    return True, ""
+
+
+class AnalysisPipeline:
+
+    def __init__(
+        self,
+        workers: int,
+        queue_size: Optional[int] = None,
+        stages: Optional[List[str]] = None,
+        profile_store: Optional[str] = None,
+    ) -> None:
+        self.stages = list(DEFAULT_STAGES) if stages is None else stages
+        self.profile_store = profile_store
+        self.queue_size = 2 * workers if queue_size is None else queue_size
+        self.executor = ProcessPoolExecutor(max_workers=workers)
+        self.slots = threading.BoundedSemaphore(self.queue_size)
+        self.lock = threading.Lock()
+        self.submitted = 0
+        self.succeeded = 0
+        self.failed = 0
+        self.failures: List[str] = []
+        self.blocked_time = 0.0
+
+    def submit(self, name: str, state: dict, out_fn: str) -> None:
+        """
+        Hands a collected state to the workers. Blocks while the queue is full.
+        """
+        start = time.monotonic()
+        if not self.slots.acquire(blocking=False):
+            logger.info(f"{name}: Waiting for a free slot. {self.progress()}")
+            self.slots.acquire()
+        blocked = time.monotonic() - start
+
+        with self.lock:
+            self.submitted += 1
+            self.blocked_time += blocked
+
+        future = self.executor.submit(analyse_collected, state, out_fn, self.stages, self.profile_store)
+        future.add_done_callback(lambda f: self._done(name, f))
+
+    def _done(self, name: str, future: Future) -> None:
+        try:
+            success, error = future.result()
+        except Exception as e:
+            success, error = False, f"Analysis failed: {e!r}"
+
+        with self.lock:
+            if success:
+                self.succeeded += 1
+            else:
+                self.failed += 1
+                self.failures.append(name)
+        self.slots.release()
+
+        if success:
+            logger.info(f"{name}: Successfully analysed. {self.progress()}")
+        else:
+            logger.error(f"{name}: {error}")
+            logger.info(self.progress())
+
+    def progress(self) -> str:
+        with self.lock:
+            done = self.succeeded + self.failed
+            return (
+                f"[{done}/{self.submitted} analysed, {self.failed} failed, "
+                f"{self.submitted - done}/{self.queue_size} in flight, "
+                f"collection blocked for {self.blocked_time:.1f}s]"
+            )
+
+    def close(self) -> List[str]:
+        """
+        Waits for all submitted states to be analysed. Returns the names of
+        those whose analysis failed.
+        """
+        self.executor.shutdown(wait=True)
+        logger.info(f"Pipeline finished. {self.progress()}")
+        with self.lock:
+            failures = list(self.failures)
+        if failures:
+            logger.error(f"Analysis failed for {len(failures)} of {self.submitted}: {', '.join(failures)}")
+        return failures
+
+
+def replay(
+    pipeline: AnalysisPipeline,
+    states_dir: str,
+    out_dir: str,
+    evaluator: Optional[str] = None,
+    checkpoint_interval: Optional[float] = None,
+    output_format: str = 'json',
+) -> None:
+    """
+    Feeds the states recorded in `states_dir`, one `sandbox_coverage.json` or
+    results container per app directory, into the pipeline. Results are
+    written to the corresponding directories in `out_dir`, in the given
+    format. If given, `evaluator` overrides the recorded matching evaluator
+    and matching progress is saved every `checkpoint_interval` seconds.
+    """
+    for in_fn in sorted(find_results(states_dir)):
+        rel_dir = os.path.relpath(os.path.dirname(in_fn), states_dir)
+        app_out_dir = os.path.join(out_dir, rel_dir)
+        out_fn = os.path.join(app_out_dir, RESULT_NAMES[output_format])
+        if os.path.exists(out_fn):
+            logger.warning(f"{rel_dir}: Already analysed. Skipping.")
+            continue
+
+        state = restore_state(load_results(in_fn, lazy=False))
+        if 'raw' not in state['logs'] and 'process' in pipeline.stages:
+            # Streamed logs cannot be processed again
+            discard_outputs(state, [stage for stage in pipeline.stages if stage != 'process'])
+        else:
+            discard_outputs(state, pipeline.stages)
+        if evaluator is not None:
+            state['arguments']['evaluator'] = evaluator
+        if checkpoint_interval is not None:
+            state['arguments']['checkpoint'] = os.path.join(app_out_dir, CHECKPOINT_NAME)
+            state['arguments']['checkpoint_interval'] = checkpoint_interval
+
+        os.makedirs(app_out_dir, exist_ok=True)
+        pipeline.submit(rel_dir, state, out_fn)
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description='Replay recorded states through the analysis pipeline')
+    parser.add_argument(
+        '-j', '--jobs',
+        type=int,
+        default=os.cpu_count(),
+        help="Number of worker processes analysing states. (default: number of CPUs)",
+    )
+    parser.add_argument(
+        '-q', '--queue-size',
+        type=int,
+        default=None,
+        help="Number of states in flight before blocking. (default: twice the number of jobs)",
+    )
+    parser.add_argument(
+        '--stages',
+        default=','.join(DEFAULT_STAGES),
+        help=f"Comma separated stages to run, out of '{','.join(STAGES)}'. (default '{','.join(DEFAULT_STAGES)}')",
+    )
+    parser.add_argument(
+        '--evaluator',
+        choices=MATCHING_EVALUATORS,
+        default=None,
+        help="How profiles are evaluated when matching. (default: as recorded, or 'auto')",
+    )
+    parser.add_argument(
+        '--checkpoint-interval',
+        type=float,
+        default=None,
+        help="Save matching progress every this many seconds, to resume after an interruption. (default: never)",
+    )
+    parser.add_argument(
+        '--output-format',
+        choices=OUTPUT_FORMATS,
+        default='json',
+        help="Write results as JSON or as compact results containers. (default 'json')",
+    )
+    parser.add_argument(
+        'states',
+        help="Directory containing recorded sandbox_coverage.json files or results containers, one per app directory.",
+    )
+    parser.add_argument(
+        'output',
+        help="Path to where the results should be stored",
+    )
+    args = parser.parse_args()
+
+    stages = args.stages.split(',')
+    for stage in stages:
+        if stage not in STAGES:
+            parser.error(f"Invalid stage: {stage}")
+
+    out_dir = os.path.expanduser(args.output)
+    # Containers share a profile store at the root of the results.
+    profile_store = os.path.join(out_dir, PROFILE_STORE_NAME) if args.output_format == 'container' else None
+    pipeline = AnalysisPipeline(args.jobs, args.queue_size, stages, profile_store)
+    failures: List[str] = []
+    try:
+        replay(
+            pipeline,
+            os.path.expanduser(args.states),
+            out_dir,
+            args.evaluator,
+            args.checkpoint_interval,
+            args.output_format,
+        )
+    finally:
+        failures = pipeline.close()
+    if failures:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,107 @@
+"""
+Compressed sets of log entry indices.
+
+Attribution repeatedly intersects the log entries still consistent with the
+reduced profile with those a rule applies to, and removes those whose result
+changed. `LogSet` stores indices as bitmaps split into chunks of 2^16 entries,
+similar to roaring bitmaps. Empty chunks are not stored, so sparse sets stay
+small and operations skip them. Each chunk is a Python integer, whose bitwise
+operators work on whole machine words at a time.
+"""
+from itertools import compress
+from typing import Dict, Iterable, Iterator
+
+CHUNK_BITS = 16
+CHUNK_SIZE = 1 << CHUNK_BITS
+CHUNK_MASK = CHUNK_SIZE - 1
+
+# Translates the digits of a binary number into bytes 0 and 1
+BIT_SELECTORS = bytes.maketrans(b'01', b'\x00\x01')
+
+
+def popcount(value: int) -> int:
+    return bin(value).count('1')
+
+
+class LogSet:
+    """
+    An immutable set of non-negative integers.
+    """
+    __slots__ = ('chunks',)
+
+    def __init__(self, chunks: Dict[int, int] = None) -> None:
+        # Maps the high bits of indices to a bitmap of their low bits. Chunks
+        # are never 0.
+        self.chunks: Dict[int, int] = chunks if chunks is not None else dict()
+
+    @classmethod
+    def from_indices(cls, idxs: Iterable[int]) -> 'LogSet':
+        chunks: Dict[int, int] = dict()
+        for idx in idxs:
+            key = idx >> CHUNK_BITS
+            chunks[key] = chunks.get(key, 0) | (1 << (idx & CHUNK_MASK))
+        return cls(chunks)
+
+    @classmethod
+    def full(cls, size: int) -> 'LogSet':
+        """
+        Returns the set of all indices below `size`.
+        """
+        chunks: Dict[int, int] = dict()
+        for key in range((size + CHUNK_MASK) >> CHUNK_BITS):
+            chunk_size = min(CHUNK_SIZE, size - (key << CHUNK_BITS))
+            chunks[key] = (1 << chunk_size) - 1
+        return cls(chunks)
+
+    def __and__(self, other: 'LogSet') -> 'LogSet':
+        if len(other.chunks) < len(self.chunks):
+            self, other = other, self
+        chunks: Dict[int, int] = dict()
+        for key, bits in self.chunks.items():
+            bits &= other.chunks.get(key, 0)
+            if bits:
+                chunks[key] = bits
+        return LogSet(chunks)
+
+    def __or__(self, other: 'LogSet') -> 'LogSet':
+        chunks = dict(self.chunks)
+        for key, bits in other.chunks.items():
+            chunks[key] = chunks.get(key, 0) | bits
+        return LogSet(chunks)
+
+    def __sub__(self, other: 'LogSet') -> 'LogSet':
+        chunks = dict(self.chunks)
+        for key, bits in other.chunks.items():
+            if key in chunks:
+                remaining = chunks[key] & ~bits
+                if remaining:
+                    chunks[key] = remaining
+                else:
+                    del chunks[key]
+        return LogSet(chunks)
+
+    def __contains__(self, idx: int) -> bool:
+        return bool((self.chunks.get(idx >> CHUNK_BITS, 0) >> (idx & CHUNK_MASK)) & 1)
+
+    def __bool__(self) -> bool:
+        return bool(self.chunks)
+
+    def __len__(self) -> int:
+        return sum(popcount(bits) for bits in self.chunks.values())
+
+    def __eq__(self, other: object) -> bool:
+        return isinstance(other, LogSet) and self.chunks == other.chunks
+
+    def __iter__(self) -> Iterator[int]:
+        """
+        Yields the indices in ascending order.
+        """
+        for key in sorted(self.chunks):
+            base = key << CHUNK_BITS
+            # One byte per bit, lowest bit first. Selecting the indices of set
+            # bytes happens in C, which is much faster than testing each bit.
+            selectors = bin(self.chunks[key])[:1:-1].encode().translate(BIT_SELECTORS)
+            yield from compress(range(base, base + len(selectors)), selectors)
+
+    def __repr__(self) -> str:
+        return f"LogSet({list(self)!r})"
@@ -0,0 +1,149 @@
+"""
+Checkpoints of long running matching runs.
+
+`linear_attribution` removes one rule after another from the profile, which
+takes hours for large profiles and many log entries. A checkpoint records the
+progress after a reduction step: the length of the profile prefix last
+matched, the log entries still consistent with it and the partial mappings.
+Matching resumes from the checkpoint after it was interrupted.
+
+Checkpoints are gzip-compressed JSON files. The set of consistent log entries
+is stored as a bitmap, one bit per log entry. Checkpoints are bound to the
+profile, log entries and matching options they were made for, and ignored for
+any other input.
+"""
+import base64
+import gzip
+import hashlib
+import json
+import os
+import time
+
+from typing import Any, Dict, Iterable, List, Optional
+
+CHECKPOINT_VERSION = 1
+
+# Default number of seconds between checkpoints
+CHECKPOINT_INTERVAL = 300.0
+
+
+def input_key(
+    profile: List[Dict[str, Any]],
+    logs: List[Dict[str, str]],
+    options: Dict[str, Any],
+) -> str:
+    """
+    Identifies the input of a matching run. `options` are the matching options
+    that change its results, e.g. the evaluator and timeouts.
+    """
+    digest = hashlib.sha256()
+    digest.update(json.dumps(options, sort_keys=True).encode())
+    digest.update(json.dumps(profile, sort_keys=True).encode())
+    for log in logs:
+        digest.update(json.dumps(log, sort_keys=True).encode())
+    return digest.hexdigest()
+
+
+def encode_bitmap(idxs: Iterable[int], size: int) -> str:
+    bitmap = bytearray((size + 7) // 8)
+    for idx in idxs:
+        bitmap[idx >> 3] |= 1 << (idx & 7)
+    return base64.b64encode(bytes(bitmap)).decode()
+
+
+def decode_bitmap(encoded: str) -> List[int]:
+    bitmap = base64.b64decode(encoded)
+    return [
+        (byte_idx << 3) + bit
+        for byte_idx, byte in enumerate(bitmap) if byte
+        for bit in range(8) if byte & (1 << bit)
+    ]
+
+
+def encode_mapping(mapping: Dict[int, List[int]]) -> Dict[str, List[int]]:
+    return {str(rule_idx): idxs for rule_idx, idxs in mapping.items()}
+
+
+def decode_mapping(mapping: Dict[str, List[int]]) -> Dict[int, List[int]]:
+    return {int(rule_idx): idxs for rule_idx, idxs in mapping.items()}
+
+
+class MatchingCheckpoint:
+    """
+    Saves and restores the progress of `linear_attribution` in the file at
+    `path`, for the matching `options` given, see `input_key`. Progress is
+    saved at most every `interval` seconds.
+    """
+
+    def __init__(
+        self,
+        path: str,
+        profile: List[Dict[str, Any]],
+        logs: List[Dict[str, str]],
+        options: Dict[str, Any],
+        interval: float = CHECKPOINT_INTERVAL,
+    ) -> None:
+        self.path = path
+        self.interval = interval
+        self.num_logs = len(logs)
+        self.key = input_key(profile, logs, options)
+        self.last_saved = time.monotonic()
+
+    def load(self) -> Optional[Dict[str, Any]]:
+        """
+        Returns the saved progress, if there is any for the current input. The
+        result contains the prefix length last matched (`prefix`), the log
+        entries consistent with that prefix (`surviving`) and the partial
+        `decisions` and `redundancy` mappings.
+        """
+        try:
+            with gzip.open(self.path, 'rt') as infile:
+                checkpoint = json.load(infile)
+        except (OSError, EOFError, ValueError):
+            return None
+
+        if checkpoint.get('version') != CHECKPOINT_VERSION or checkpoint.get('key') != self.key:
+            return None
+
+        return {
+            'prefix': checkpoint['prefix'],
+            'surviving': decode_bitmap(checkpoint['surviving']),
+            'decisions': decode_mapping(checkpoint['decisions']),
+            'redundancy': decode_mapping(checkpoint['redundancy']),
+        }
+
+    def due(self) -> bool:
+        return time.monotonic() - self.last_saved >= self.interval
+
+    def save(
+        self,
+        prefix: int,
+        surviving: Iterable[int],
+        decisions: Dict[int, List[int]],
+        redundancy: Dict[int, List[int]],
+    ) -> None:
+        """
+        Saves the progress after matching the profile prefix of length
+        `prefix`. The file is replaced atomically, so a crash while saving
+        leaves the previous checkpoint intact.
+        """
+        checkpoint = {
+            'version': CHECKPOINT_VERSION,
+            'key': self.key,
+            'prefix': prefix,
+            'surviving': encode_bitmap(surviving, self.num_logs),
+            'decisions': encode_mapping(decisions),
+            'redundancy': encode_mapping(redundancy),
+        }
+
+        tmp_path = self.path + '.tmp'
+        with gzip.open(tmp_path, 'wt') as outfile:
+            json.dump(checkpoint, outfile, separators=(',', ':'))
+        os.replace(tmp_path, self.path)
+        self.last_saved = time.monotonic()
+
+    def remove(self) -> None:
+        try:
+            os.remove(self.path)
+        except FileNotFoundError:
+            pass
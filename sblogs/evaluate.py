@@ -0,0 +1,295 @@
+"""
+Portable evaluation of JSON sandbox profiles.
+
+The matcher asks the kernel whether the sandbox allows a logged operation,
+which is only possible on macOS. This module approximates those decisions
+in Python, so that matching can be repeated elsewhere, e.g. when replaying
+saved results on Linux.
+
+Rules are evaluated with last-match semantics, except that rules for specific
+operations take precedence over `default` rules regardless of their order, see
+`precedence_order`: the last rule for the operation whose filters match the
+argument decides, otherwise the last matching `default` rule. Without such a
+rule, the operation is allowed, as is the case for an empty profile. Filters
+that cannot be evaluated from a log entry alone, such as `process-attribute`
+or `file-mode`, are unknown. Unknown filters only leave the decision unknown
+if they could change it.
+"""
+import json
+import re
+
+from typing import Any, Dict, List, Optional, Tuple
+
+from sbprofiles.automata import regex_matches
+
+SandboxRule = Dict[str, Any]
+SandboxProfile = List[SandboxRule]
+ProcessedLogs = List[Dict[str, str]]
+
+# Filters matching the path of file operations
+PATH_FILTERS = {'path', 'literal', 'subpath', 'path-prefix', 'path-regex'}
+
+# Filters matching names, by their base name. Each comes in an exact, a
+# -prefix and a -regex variant.
+NAME_FILTERS = {
+    'appleevent-destination',
+    'extension-class',
+    'global-name',
+    'iokit-connection',
+    'iokit-registry-entry-class',
+    'iokit-user-client-class',
+    'ipc-posix-name',
+    'local-name',
+    'notification-name',
+    'preference-domain',
+    'right-name',
+    'sysctl-name',
+    'xpc-service-name',
+}
+
+
+def operation_matches(rule_operation: str, log_operation: str) -> bool:
+    """
+    Returns whether a rule for `rule_operation` decides log entries for
+    `log_operation`. Wildcard operations such as `file-read*` match the
+    family of operations sharing their prefix and `default` matches every
+    operation, other operations only themselves. Unlike
+    `sblogs.match.operation_applies`, used for pruning, this does not err on
+    the side of matching.
+    """
+    if rule_operation == 'default':
+        return True
+    if rule_operation.endswith('*'):
+        return log_operation.startswith(rule_operation[:-1])
+    return log_operation == rule_operation
+
+
+def is_default_rule(rule: SandboxRule) -> bool:
+    return 'default' in rule['operations']
+
+
+def precedence_order(profile: SandboxProfile) -> List[int]:
+    """
+    Returns the indices of the rules of the profile in the order they are
+    tried: rules for specific operations from last to first, followed by
+    `default` rules from last to first. The first of them matching decides.
+    `default` rules only decide operations no other rule matches, so they
+    never shadow, and are never shadowed by, rules for specific operations.
+    """
+    specific = [idx for idx in reversed(range(len(profile))) if not is_default_rule(profile[idx])]
+    defaults = [idx for idx in reversed(range(len(profile))) if is_default_rule(profile[idx])]
+    return specific + defaults
+
+
+def split_extension_argument(argument: str) -> Tuple[str, str]:
+    """
+    Splits the argument of a processed file-issue-extension log entry into
+    the target path and the extension class.
+    """
+    m = re.match(r'target: (.*) class: (.*)', argument)
+    if not m:
+        return argument, ''
+    return m.group(1), m.group(2)
+
+
+def string_argument(sb_filter: dict) -> Optional[str]:
+    for argument in sb_filter.get('arguments', []):
+        if argument.get('type') == 'string':
+            return argument['value']
+    return None
+
+
+def and_(values: List[Optional[bool]]) -> Optional[bool]:
+    if False in values:
+        return False
+    if None in values:
+        return None
+    return True
+
+
+def or_(values: List[Optional[bool]]) -> Optional[bool]:
+    if True in values:
+        return True
+    if None in values:
+        return None
+    return False
+
+
+class PortableEvaluator:
+    """
+    Evaluates profiles against processed log entries. Results of filters are
+    cached per rule, so evaluating reduced or mutated versions of the same
+    profile, as done by the attribution strategies, is cheap.
+
+    Cached results are keyed by the content of rules. Serialising a rule for
+    every log entry would be too slow, so keys are also cached by rule
+    object, until `forget_rules` is called once a profile is done with.
+    """
+
+    def __init__(self) -> None:
+        self.regexes: Dict[str, Optional[re.Pattern]] = dict()
+        self.rule_keys: Dict[int, Tuple[SandboxRule, str]] = dict()
+        self.rule_matches_cache: Dict[str, Dict[Tuple[str, str], Optional[bool]]] = dict()
+
+    def cached_results(self) -> int:
+        return sum(len(results) for results in self.rule_matches_cache.values())
+
+    def forget_rules(self) -> None:
+        """
+        Drops the keys cached by rule object, and with them the references to
+        the rules, but keeps cached results.
+        """
+        self.rule_keys.clear()
+
+    def clear_results(self) -> None:
+        """
+        Drops cached results, but keeps compiled regular expressions.
+        """
+        self.rule_keys.clear()
+        self.rule_matches_cache.clear()
+
+    def regex(self, pattern: str) -> Optional[re.Pattern]:
+        if pattern not in self.regexes:
+            try:
+                self.regexes[pattern] = re.compile(pattern)
+            except re.error:
+                self.regexes[pattern] = None
+        return self.regexes[pattern]
+
+    def match_regex(self, pattern: str, value: str) -> Optional[bool]:
+        if '[[:' in pattern:
+            # Python does not support POSIX character classes.
+            return regex_matches(pattern, value)
+        rx = self.regex(pattern)
+        if rx is None:
+            return None
+        return rx.search(value) is not None
+
+    def match_path(self, name: str, value: str, path: Optional[str]) -> Optional[bool]:
+        if path is None:
+            return False
+        if name in ('path', 'literal'):
+            return path == value
+        if name == 'subpath':
+            prefix = value.rstrip('/')
+            return path == value or path == prefix or path.startswith(prefix + '/')
+        if name == 'path-prefix':
+            return path.startswith(value)
+        return self.match_regex(value, path)
+
+    def match_name(self, name: str, value: str, argument: Optional[str]) -> Optional[bool]:
+        if argument is None:
+            return False
+        if name.endswith('-prefix'):
+            return argument.startswith(value)
+        if name.endswith('-regex'):
+            return self.match_regex(value, argument)
+        return argument == value
+
+    def filter_matches(self, sb_filter: dict, operation: str, argument: Optional[str]) -> Optional[bool]:
+        name: str = sb_filter['name']
+
+        if name == 'require-all':
+            return and_([self.filter_matches(f, operation, argument) for f in sb_filter['subfilters']])
+        if name == 'require-any':
+            return or_([self.filter_matches(f, operation, argument) for f in sb_filter['subfilters']])
+        if name == 'require-not':
+            result = and_([self.filter_matches(f, operation, argument) for f in sb_filter['subfilters']])
+            return None if result is None else not result
+
+        value = string_argument(sb_filter)
+        if value is None:
+            return None
+
+        extension_class = None
+        if operation == 'file-issue-extension' and argument is not None:
+            argument, extension_class = split_extension_argument(argument)
+
+        if name in PATH_FILTERS:
+            if not operation.startswith('file'):
+                return None
+            return self.match_path(name, value, argument)
+
+        base_name = re.sub(r'-(prefix|regex)$', '', name)
+        if base_name not in NAME_FILTERS:
+            return None
+        if base_name == 'extension-class':
+            return self.match_name(name, value, extension_class)
+        if operation.startswith('file'):
+            return None
+        # The matcher only checks global names for mach-register, see
+        # sandbox_filter_type_for_op in matching-core/matching.cpp
+        if operation.startswith('mach-register') and base_name == 'local-name':
+            return False
+        return self.match_name(name, value, argument)
+
+    def rule_key(self, rule: SandboxRule) -> str:
+        """
+        Identifies rules by their operations and filters, so that inverted
+        rules share results with the original ones.
+        """
+        cached = self.rule_keys.get(id(rule))
+        if cached is not None and cached[0] is rule:
+            return cached[1]
+        key = json.dumps([rule['operations'], rule.get('filters', [])], sort_keys=True)
+        # Keep a reference to the rule, so that its id is not reused before
+        # `forget_rules` is called.
+        self.rule_keys[id(rule)] = (rule, key)
+        return key
+
+    def rule_matches(self, rule: SandboxRule, operation: str, argument: Optional[str]) -> Optional[bool]:
+        key = self.rule_key(rule)
+        results = self.rule_matches_cache.setdefault(key, dict())
+        log_key = (operation, argument)
+        if log_key not in results:
+            if not any(operation_matches(op, operation) for op in rule['operations']):
+                results[log_key] = False
+            elif not rule.get('filters'):
+                results[log_key] = True
+            else:
+                # Filters of a rule are alternatives, as in SBPL
+                results[log_key] = or_([
+                    self.filter_matches(f, operation, argument)
+                    for f in rule['filters']
+                ])
+        return results[log_key]
+
+    def decide(
+        self,
+        profile: SandboxProfile,
+        operation: str,
+        argument: Optional[str],
+        order: Optional[List[int]] = None,
+    ) -> Optional[str]:
+        """
+        Returns the action the profile takes for the operation, or None if it
+        cannot be determined. `order` is the `precedence_order` of the
+        profile, if already known.
+        """
+        if order is None:
+            order = precedence_order(profile)
+        possible_actions = set()
+        decision = 'allow'
+        for rule_idx in order:
+            rule = profile[rule_idx]
+            matches = self.rule_matches(rule, operation, argument)
+            if matches is None:
+                possible_actions.add(rule['action'])
+            elif matches:
+                decision = rule['action']
+                break
+
+        possible_actions.add(decision)
+        return decision if len(possible_actions) == 1 else None
+
+    def matches(self, profile: SandboxProfile, logs: ProcessedLogs) -> List[Optional[bool]]:
+        """
+        Like `sblogs.match.get_matches_for_profile`: whether the decision of the
+        profile is consistent with each log entry, None if unknown.
+        """
+        order = precedence_order(profile)
+        results: List[Optional[bool]] = []
+        for log in logs:
+            decision = self.decide(profile, log['operation'], log.get('argument'), order)
+            results.append(None if decision is None else decision == log['action'])
+        return results
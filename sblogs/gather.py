@@ -10,6 +10,7 @@ import datetime
 import json
 import plistlib
 import tempfile
+import time
 
 from maap.misc.logger import create_logger
 from maap.misc.app_utils import init_sandbox, container_for_app, run_process
@@ -17,6 +18,18 @@ from maap.misc.filesystem import project_path
 from maap.misc.plist import parse_resilient
 from maap.extern.tools import call_sbpl, tool_named
 from maap.bundle.bundle import Bundle
+from sblogs.process import native_ingest_available, sblog_ingest
+from sblogs.stream import SANDBOX_SENDER, LogConsumer, LogStreamSource, SaturationTracker, read_spill_file
+
+# How logs are collected, see `collect_sb_traces`
+COLLECTION_MODES = ['show', 'stream']
+
+# Number of seconds to wait for log entries still in flight once the app has
+# exited, when streaming logs.
+STREAM_GRACE_PERIOD = 2.0
+
+# Number of seconds between checks for saturated coverage.
+SATURATION_POLL_INTERVAL = 0.5
 
 logger = create_logger('sblogs.gather')
 
@@ -45,6 +58,35 @@ def compile_sb_profile(profile: str) -> bytes:
     return result
 
 
+def run_process_streaming(executable: str, timeout, stdout_f, stderr_f, consumer: LogConsumer) -> (int, bool):
+    """
+    Like `run_process`, but hands the PID of the process to the log consumer
+    as soon as the process is started. If the consumer tracks saturation, the
+    process is also killed once coverage is saturated. Returns the PID and
+    whether the process was stopped because of saturation.
+    """
+    process = subprocess.Popen([executable], stdout=stdout_f, stderr=stderr_f)
+    consumer.set_pid(process.pid)
+
+    deadline = None if timeout is None else time.monotonic() + timeout
+    stopped_early = False
+    while True:
+        wait_time = None if deadline is None else max(0.0, deadline - time.monotonic())
+        if consumer.tracker is not None:
+            wait_time = SATURATION_POLL_INTERVAL if wait_time is None else min(wait_time, SATURATION_POLL_INTERVAL)
+        try:
+            process.wait(timeout=wait_time)
+            break
+        except subprocess.TimeoutExpired:
+            now = time.monotonic()
+            stopped_early = consumer.tracker is not None and consumer.tracker.is_saturated(now)
+            if stopped_early or (deadline is not None and now >= deadline):
+                process.kill()
+                process.wait()
+                break
+    return process.pid, stopped_early
+
+
 def process_sb_profiles(state: dict) -> (bool, dict):
     """
     This function does three things:
@@ -97,10 +139,19 @@ def collect_sb_traces(state: dict) -> (bool, dict):
     either indefinitely (`timeout` = None) or for the specified number of `timeout`
     seconds. It collects system log entries during this time and stores all of the
     information collected in the `state` structure.
+
+    By default, the system log is dumped once the app has exited. In `stream`
+    collection mode, log entries are instead consumed and processed while the
+    app is running, and only processed logs are stored. If a saturation window
+    is given, the app is stopped early once no new distinct log entry appeared
+    for that many seconds, and the saturation curve is stored in the state.
     """
     bundle = Bundle.make(state['arguments']['app'])
     APP_METADATA_FILE = os.path.join(container_for_app(bundle), "Container.plist")
     timeout = state['arguments']['timeout']
+    saturation_window = state['arguments'].get('saturation_window')
+    # Saturation can only be tracked while logs are streamed.
+    streaming = state['arguments'].get('collection', 'show') == 'stream' or saturation_window is not None
 
     # The easiest way to make sure our patched profile is actually used would be
     # to hook the responsible methods in libsystem_secinit and make them load another
@@ -117,39 +168,83 @@ def collect_sb_traces(state: dict) -> (bool, dict):
     # Start / stop times necessary to filter log entries
     start = datetime.datetime.now().strftime("%Y-%m-%d %H:%M:%S")
 
-    with tempfile.TemporaryDirectory() as tempdirname:
-        INFO_STDOUT = os.path.join(tempdirname, "stdout")
-        INFO_STDERR = os.path.join(tempdirname, "stderr")
-
-        with open(INFO_STDOUT, "w") as stdout_f, open(INFO_STDERR, "w") as stderr_f:
-            state['process_infos'] = {
-                'pid': run_process(bundle.executable_path(), timeout, stdout_f, stderr_f)
-            }
-
-        state['process_infos'].update({
-            'stdout': open(INFO_STDOUT).read(),
-            'stderr': open(INFO_STDERR).read()
-        })
-
-    end = datetime.datetime.now().strftime("%Y-%m-%d %H:%M:%S")
-
-    # Restore original container metadata.
-    with open(APP_METADATA_FILE, "wb") as outfile:
-        outfile.write(state['container_metadata'])
-
+    # The original container metadata is restored even if collecting logs fails.
     try:
-        state['logs'] = {
-            'raw': json.loads(subprocess.check_output(["log", "show",
-                         "--start", start,
-                         "--end", end,
-                         "--style", "json",
-                         "--predicate", 'senderImagePath == "/System/Library/Extensions/Sandbox.kext/Contents/MacOS/Sandbox"']))
-        }
+        with tempfile.TemporaryDirectory() as tempdirname:
+            INFO_STDOUT = os.path.join(tempdirname, "stdout")
+            INFO_STDERR = os.path.join(tempdirname, "stderr")
+            SPILL_FILE = os.path.join(tempdirname, "processed_logs")
+
+            with open(INFO_STDOUT, "w") as stdout_f, open(INFO_STDERR, "w") as stderr_f:
+                if streaming:
+                    tracker = None
+                    if saturation_window is not None:
+                        tracker = SaturationTracker(saturation_window, time.monotonic())
+                    with open(SPILL_FILE, "w") as spill_f:
+                        consumer = LogConsumer(LogStreamSource(), spill_f, tracker)
+                        consumer.start()
+                        # The consumer closes the log stream when stopped.
+                        try:
+                            pid, stopped_early = run_process_streaming(
+                                bundle.executable_path(), timeout, stdout_f, stderr_f, consumer
+                            )
+                            duration = time.monotonic() - tracker.start if tracker is not None else None
+                        finally:
+                            consumer.stop(STREAM_GRACE_PERIOD)
+                else:
+                    pid = run_process(bundle.executable_path(), timeout, stdout_f, stderr_f)
+
+                state['process_infos'] = {
+                    'pid': pid
+                }
+
+            state['process_infos'].update({
+                'stdout': open(INFO_STDOUT).read(),
+                'stderr': open(INFO_STDERR).read()
+            })
+
+            if streaming:
+                if consumer.error is not None:
+                    logger.error("Failed to process streamed sandbox logs for {}: {}".format(
+                        bundle.filepath, consumer.error))
+                    return False, {}
+                state['logs'] = {
+                    'processed': read_spill_file(SPILL_FILE)
+                }
+                if tracker is not None:
+                    state['saturation'] = tracker.summary(duration, stopped_early)
+
+        end = datetime.datetime.now().strftime("%Y-%m-%d %H:%M:%S")
+    finally:
+        # Restore original container metadata.
+        with open(APP_METADATA_FILE, "wb") as outfile:
+            outfile.write(state['container_metadata'])
+
+    if streaming:
         return True, state
-    except subprocess.CalledProcessError:
-        logger.error("Unable to retrieve raw sandbox logs for {}".format(bundle.filepath))
-        return False, {}
 
+    # The raw logs are written to a file, which sblog-ingest converts without
+    # loading it in its entirety. Without the tool, the process_logs stage
+    # converts the raw logs instead.
+    with tempfile.NamedTemporaryFile(suffix=".json") as raw_f:
+        try:
+            subprocess.run(["log", "show",
+                            "--start", start,
+                            "--end", end,
+                            "--style", "json",
+                            "--predicate", f'senderImagePath == "{SANDBOX_SENDER}"'],
+                           stdout=raw_f, check=True)
+        except subprocess.CalledProcessError:
+            logger.error("Unable to retrieve raw sandbox logs for {}".format(bundle.filepath))
+            return False, {}
+
+        raw_f.seek(0)
+        state['logs'] = {
+            'raw': json.load(raw_f)
+        }
+        if native_ingest_available():
+            state['logs']['processed'] = sblog_ingest(raw_f.name, state['process_infos']['pid'])
+    return True, state
 
 def gather_logs(state: dict) -> (bool, dict):
     app_path = state['arguments']['app']
@@ -0,0 +1,122 @@
+"""
+Matching log entries against the generic profile directly.
+
+Usually, log entries are matched against the profile of the app, and results
+are mapped to the generic profile through the normalised profile, see
+`sbprofiles/generalise.py`. Rules that cannot be aligned are lost on the way.
+
+The generic profile uses placeholders such as `/$_HOME$` where app profiles
+contain concrete values. Substituting the app's `normalisation_replacements`
+for the placeholders in the filters of the generic profile yields a profile
+with the rules of the generic profile, in the same order, which log entries
+can be matched against as they are. Replacing concrete values in log entries
+by placeholders instead would be ambiguous, as several placeholders may stand
+for the same value, e.g. the bundle ID and the container ID, and values such
+as the user name also occur inside unrelated paths.
+
+Log entries are always checked by the portable evaluator, which is shared by
+all apps analysed in a process, so that regular expressions common to their
+profiles are compiled once.
+"""
+from typing import Dict, Optional, Tuple
+
+from sblogs.evaluate import PortableEvaluator
+from sblogs.match import SandboxProfile, match_logs
+from sbprofiles.automata import escape
+from sbprofiles.replace import Replacer
+
+# Number of cached filter results after which the shared evaluator is reset
+GENERIC_CACHE_LIMIT = 1000000
+
+generic_evaluator: Optional[PortableEvaluator] = None
+
+
+def shared_generic_evaluator() -> PortableEvaluator:
+    """
+    Returns the portable evaluator shared by all apps matched in this process.
+    """
+    global generic_evaluator
+    if generic_evaluator is None:
+        generic_evaluator = PortableEvaluator()
+    elif generic_evaluator.cached_results() > GENERIC_CACHE_LIMIT:
+        generic_evaluator.clear_results()
+    return generic_evaluator
+
+
+def concrete_filter(sb_filter: dict, replacer: Replacer, regex_replacer: Replacer) -> dict:
+    """
+    Substitutes concrete values for placeholders in the string arguments of a
+    filter and its subfilters. Values are escaped in regular expressions.
+    """
+    concrete = dict(sb_filter)
+    if 'arguments' in sb_filter:
+        active = regex_replacer if sb_filter['name'].endswith('-regex') else replacer
+        concrete['arguments'] = [
+            dict(argument, value=active.replace(argument['value']))
+            if argument.get('type') == 'string' else argument
+            for argument in sb_filter['arguments']
+        ]
+    if 'subfilters' in sb_filter:
+        concrete['subfilters'] = [
+            concrete_filter(subfilter, replacer, regex_replacer)
+            for subfilter in sb_filter['subfilters']
+        ]
+    return concrete
+
+
+def concrete_generic_profile(
+    profile: SandboxProfile,
+    replacements: Dict[str, str],
+) -> SandboxProfile:
+    """
+    Returns the generic profile with the concrete values of an app substituted
+    for its placeholders. `replacements` maps placeholders to values, see
+    `sbprofiles.normalise.normalise_container_metadata`. Rules keep their
+    indices.
+    """
+    replacer = Replacer(replacements)
+    # Regular expressions contain placeholders with their dollar signs escaped.
+    regex_replacer = Replacer({
+        escape(placeholder): escape(value)
+        for placeholder, value in replacements.items()
+    })
+    return [
+        dict(rule, filters=[
+            concrete_filter(sb_filter, replacer, regex_replacer)
+            for sb_filter in rule['filters']
+        ]) if 'filters' in rule else rule
+        for rule in profile
+    ]
+
+
+def perform_generic_matching(state: dict) -> Tuple[bool, dict]:
+    """
+    Matches the processed log entries against the generic profile, with the
+    concrete values of the app substituted for its placeholders. Requires the
+    normalisation replacements of the app. Results refer to the rules of the
+    generic profile and are stored like those of `perform_matching`, as
+    `generic_match_results` and `generic_match_stats`.
+    """
+    if 'normalisation_replacements' not in state:
+        return False, state
+
+    profile = concrete_generic_profile(
+        state['sandbox_profiles']['general'],
+        state['normalisation_replacements'],
+    )
+
+    # Checkpoints are bound to the app's own profile.
+    arguments = dict(state['arguments'])
+    arguments.pop('checkpoint', None)
+    arguments['evaluator'] = 'portable'
+
+    match_results, match_stats = match_logs(
+        profile,
+        state['logs']['processed'],
+        arguments,
+        shared_generic_evaluator(),
+    )
+
+    state['generic_match_results'] = match_results
+    state['generic_match_stats'] = match_stats
+    return True, state
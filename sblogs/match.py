@@ -3,27 +3,98 @@ import subprocess
 import sys
 import json
 
-from collections import defaultdict
+from collections import Counter, defaultdict
+from dataclasses import dataclass, field
 from typing import Any, Dict, Iterator, List, Optional, Set, Tuple
 
+from sblogs.bitmap import LogSet
+from sblogs.checkpoint import CHECKPOINT_INTERVAL, MatchingCheckpoint
+from sblogs.evaluate import PortableEvaluator
+from sbprofiles.shadowing import find_shadowed_rules
+
 SandboxProfile = List[Dict[str, Any]]
 ProcessedLogs = List[Dict[str, str]]
 
+# Strategies for attributing log entries to the rules deciding them. See
+# `linear_attribution` and `bisect_attribution`.
+MATCHING_STRATEGIES = ['linear', 'bisect']
+
+# How profiles are evaluated against log entries. `sandbox` uses the matcher,
+# which requires macOS, `portable` the approximation in `sblogs.evaluate`.
+# `auto` uses the matcher where it is available.
+MATCHING_EVALUATORS = ['auto', 'sandbox', 'portable']
+
 
 PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
 HELPER_DIR = os.path.join(PROJECT_DIR, 'matching-core', 'build', 'bin')
 MATCHER = os.path.join(HELPER_DIR, 'matcher')
 
+# The native extension module is built alongside the matcher executable. If it
+# is not available, we fall back to spawning the matcher for every profile.
+sys.path.insert(0, HELPER_DIR)
+try:
+    import _matcher
+except ImportError:
+    _matcher = None
+finally:
+    sys.path.remove(HELPER_DIR)
+
+
+def sandbox_available() -> bool:
+    """
+    Returns whether log entries can be checked using the sandbox.
+    """
+    return sys.platform == 'darwin' and (_matcher is not None or os.path.exists(MATCHER))
+
+
+@dataclass
+class MatchOptions:
+    """
+    Options for the matcher, and statistics accumulated over all its runs.
+    Timeouts are given in milliseconds, 0 meaning no limit. The entry timeout
+    applies to every log entry, the run timeout to every matcher run.
+    Timeouts and workers do not apply to the portable evaluator.
+    """
+    workers: int = 1
+    entry_timeout: int = 0
+    run_timeout: int = 0
+    evaluator: str = 'sandbox'
+    stats: Counter = field(default_factory=Counter)
+    portable: Optional[PortableEvaluator] = None
+
 
 def get_matches_for_profile(
     profile: SandboxProfile,
     logs: ProcessedLogs,
+    options: Optional[MatchOptions] = None,
 ) -> List[Optional[bool]]:
     """
-    Obtain the match results from the C++ helper.
+    Obtain the match results from the C++ helper. Log entries that could not
+    be checked within their time budget are reported as unknown.
     """
+    if not logs:
+        return []
+
+    if options is None:
+        options = MatchOptions()
+
+    if options.evaluator == 'portable':
+        if options.portable is None:
+            options.portable = PortableEvaluator()
+        options.stats['entries'] += len(logs)
+        return options.portable.matches(profile, logs)
+
+    if _matcher is not None:
+        return get_matches_from_module(profile, logs, options)
+
     sandbox_check = subprocess.run(
-        [MATCHER],
+        [
+            MATCHER,
+            '--workers', str(options.workers),
+            '--entry-timeout', str(options.entry_timeout),
+            '--run-timeout', str(options.run_timeout),
+            '--stats',
+        ],
         capture_output=True,
         text=True,
         input=json.dumps(dict(
@@ -36,7 +107,91 @@ def get_matches_for_profile(
         print(sandbox_check.stderr, file=sys.stderr)
         sandbox_check.check_returncode()
 
-    return json.loads(sandbox_check.stdout)
+    output = json.loads(sandbox_check.stdout)
+    options.stats.update(output['stats'])
+    return output['matches']
+
+
+def get_matches_from_module(
+    profile: SandboxProfile,
+    logs: ProcessedLogs,
+    options: MatchOptions,
+) -> List[Optional[bool]]:
+    """
+    Obtain the match results from the native extension module. The logs are
+    handed over as they are, no JSON is involved for them.
+    """
+    statuses = {
+        _matcher.MATCH_CONSISTENT: True,
+        _matcher.MATCH_INCONSISTENT: False,
+        _matcher.MATCH_UNKNOWN: None,
+    }
+    try:
+        results = _matcher.match(
+            json.dumps(profile),
+            logs,
+            workers=options.workers,
+            entry_timeout=options.entry_timeout,
+            run_timeout=options.run_timeout,
+        )
+    except _matcher.MatchError as e:
+        print(e, file=sys.stderr)
+        raise
+    options.stats.update(results.stats)
+    return [statuses[status] for status in memoryview(results)]
+
+
+def operation_applies(rule_operation: str, log_operation: str) -> bool:
+    """
+    Returns whether a rule for `rule_operation` can decide log entries for
+    `log_operation`. The `default` operation applies to every operation and
+    wildcard operations such as `file-read*` apply to the whole family of
+    operations sharing their prefix. This errs on the side of applying too
+    often, which only costs time.
+    """
+    if rule_operation == 'default':
+        return True
+    return log_operation.startswith(rule_operation.rstrip('*'))
+
+
+def applicable_log_operations(
+    profile: SandboxProfile,
+    logs: ProcessedLogs,
+) -> List[Set[str]]:
+    """
+    Returns, for each rule of the profile, the set of logged operations the
+    rule applies to.
+    """
+    log_operations = set(log['operation'] for log in logs)
+    return [
+        set(
+            log_operation
+            for log_operation in log_operations
+            if any(
+                operation_applies(rule_operation, log_operation)
+                for rule_operation in rule['operations']
+            )
+        )
+        for rule in profile
+    ]
+
+
+def log_sets_by_operation(logs: ProcessedLogs) -> Dict[str, LogSet]:
+    idxs_by_operation: Dict[str, List[int]] = defaultdict(list)
+    for idx, log in enumerate(logs):
+        idxs_by_operation[log['operation']].append(idx)
+    return {
+        operation: LogSet.from_indices(idxs)
+        for operation, idxs in idxs_by_operation.items()
+    }
+
+
+def select_applicable(
+    idxs: List[int],
+    logs: ProcessedLogs,
+    operations: Set[str],
+) -> List[int]:
+    return [idx for idx in idxs if logs[idx]['operation'] in operations]
 
 
 def reduced_profiles(profile: SandboxProfile) -> Iterator[SandboxProfile]:
@@ -45,25 +200,26 @@ def reduced_profiles(profile: SandboxProfile) -> Iterator[SandboxProfile]:
         yield profile[:-i]  # Remove last i rules
 
 
-def invert_last_rule(profile: SandboxProfile) -> SandboxProfile:
-    assert 0 < len(profile)
+def invert_rule(profile: SandboxProfile, rule_idx: int) -> SandboxProfile:
+    assert 0 <= rule_idx < len(profile)
     new_profile = profile.copy()
-    action: str = profile[-1]['action']
+    new_rule = dict(profile[rule_idx])
+    action: str = new_rule['action']
     if action == 'allow':
-        new_profile[-1]['action'] = 'deny'
-        if 'modifiers' in new_profile[-1]:
-            modifiers = new_profile[-1]['modifiers']
-            new_profile[-1]['modifiers'] = [
+        new_rule['action'] = 'deny'
+        if 'modifiers' in new_rule:
+            modifiers = new_rule['modifiers']
+            new_rule['modifiers'] = [
                 modifier
                 for modifier in modifiers
                 # The report modifier is not allowed for 'deny' rules.
                 if modifier['name'] != 'report'
             ]
     elif action == 'deny':
-        new_profile[-1]['action'] = 'allow'
-        if 'modifiers' in new_profile[-1]:
-            modifiers = new_profile[-1]['modifiers']
-            new_profile[-1]['modifiers'] = [
+        new_rule['action'] = 'allow'
+        if 'modifiers' in new_rule:
+            modifiers = new_rule['modifiers']
+            new_rule['modifiers'] = [
                 modifier
                 for modifier in modifiers
                 # The no-report modifier is not allowed for 'allow' rules.
@@ -71,108 +227,412 @@ def invert_last_rule(profile: SandboxProfile) -> SandboxProfile:
             ]
     else:
         assert False, f"Invalid action: {action}"
+    new_profile[rule_idx] = new_rule
     return new_profile
 
 
-def perform_matching(state: dict) -> Tuple[bool, dict]:
-    """
-    Invokes the matcher, assuming the directory contains both the profile
-    to match against, and processed log entries.
-
-    Note that there are implicit default values for some sandbox operations
-    that are not overwritten by a default rule. An example is
-
-       (allow file-map-executable "/usr/lib/libobjc-trampolines.dylib")
+def invert_last_rule(profile: SandboxProfile) -> SandboxProfile:
+    assert 0 < len(profile)
+    return invert_rule(profile, len(profile) - 1)
 
-    The `file-map-executable` operation is allowed by default! A default deny
-    profile with no explicit rule for `file-map-executable` will therefore
-    default to allowing all `file-map-executable` actions.
 
-    The results in that case will be inconsistent for each profile reduction
-    and mutation. We therefore cannot match the log entry to a rule and it will
-    be added to the unmatched log entries.
+def linear_attribution(
+    sandbox_profile: SandboxProfile,
+    processed_logs: ProcessedLogs,
+    options: Optional[MatchOptions] = None,
+    checkpoint: Optional[MatchingCheckpoint] = None,
+) -> Tuple[Dict[int, List[int]], Dict[int, List[int]]]:
     """
+    Attributes log entries to rules by removing one rule after another from
+    the end of the profile. A log entry is attributed to the rule whose removal
+    makes its result inconsistent. Rules whose inversion would change a result
+    without being responsible for it are considered redundant.
 
-    processed_logs: ProcessedLogs = state['logs']['processed']
-    sandbox_profile: SandboxProfile = json.loads(
-        state['sandbox_profiles']['original']
-    )
+    Sets of log entries are kept as `LogSet` bitmaps, so each step only
+    touches the log entries tested and changed, apart from word-wise bitmap
+    operations.
 
+    If a checkpoint is given, progress is saved to it regularly and matching
+    resumes from the progress saved before, if any.
+    """
     num_rules = len(sandbox_profile)
 
     decisions_mapping: Dict[int, List[int]] = defaultdict(list)
     redundancy_mapping: Dict[int, List[int]] = defaultdict(list)
 
-    last_matches: Optional[Dict[int, Optional[bool]]] = None
+    # Only logs for operations a rule applies to can change when that rule is
+    # removed or inverted.
+    applicable_ops = applicable_log_operations(sandbox_profile, processed_logs)
+
+    operation_sets = log_sets_by_operation(processed_logs)
+
+    def applicable_logs(rule_idx: int) -> LogSet:
+        applicable = LogSet()
+        for operation in applicable_ops[rule_idx]:
+            applicable |= operation_sets[operation]
+        return applicable
+
+    # Log entries consistent with the current profile prefix
+    surviving: Optional[LogSet] = None
+    redundant: Dict[int, LogSet] = dict()
+    resume_prefix = num_rules + 1
+
+    saved = checkpoint.load() if checkpoint is not None else None
+    if saved is not None:
+        resume_prefix = saved['prefix']
+        surviving = LogSet.from_indices(saved['surviving'])
+        decisions_mapping.update(saved['decisions'])
+        for rule_idx, idxs in saved['redundancy'].items():
+            redundant[rule_idx] = LogSet.from_indices(idxs)
+        print(f"Resuming matching with {resume_prefix} rules left", file=sys.stderr)
+
     print(f"  0 % matching rules", file=sys.stderr)
     for profile in reduced_profiles(sandbox_profile):
+        if resume_prefix <= len(profile):
+            continue
         rule_idx = len(profile) - 1
 
         progress = (num_rules - len(profile)) / num_rules * 100.0
         print(f"\r\033[1A{progress: >3.0f} % matching rules", file=sys.stderr)
 
-        if last_matches is None:
+        if surviving is None:
             # Test all logs in the beginning
-            selected_logs = {
-                idx: match for idx, match in enumerate(processed_logs)
-            }
+            selected = LogSet.full(len(processed_logs))
         else:
-            # Then continue testing only with consistent matches
-            selected_logs = {
-                idx: processed_logs[idx]
-                for idx, match in last_matches.items()
-                if match
-            }
-
-        selected_idxs = sorted(selected_logs.keys())
+            # Then continue testing only with consistent matches, and only
+            # with those the removed rule could have decided.
+            selected = surviving & applicable_logs(rule_idx + 1)
 
+        selected_idxs = list(selected)
         matches = get_matches_for_profile(
             profile,
-            [selected_logs[idx] for idx in selected_idxs],
+            [processed_logs[idx] for idx in selected_idxs],
+            options,
         )
         assert len(matches) == len(selected_idxs)
-        new_matches = {
-            idx: match for idx, match in zip(selected_idxs, matches)
-        }
+        changed = LogSet.from_indices(
+            idx for idx, match in zip(selected_idxs, matches) if not match
+        )
+
+        if surviving is None:
+            surviving = selected - changed
+        else:
+            surviving = surviving - changed
+
+            removed_rule_idx = rule_idx + 1
+            assert removed_rule_idx < num_rules
+            decisions_mapping[removed_rule_idx] = list(changed)
+
+            # The removed rule is probably also a candidate for redundancy.
+            # Since it is now clear, that the rule is responsible, it should
+            # not be considered redundant.
+            redundant[removed_rule_idx] = redundant.get(removed_rule_idx, LogSet()) - changed
 
         if 0 <= rule_idx:
             # Check whether inversion of the current rule leads to a change. If
             # that is the case, the rule might be redundant, if removal of this
             # rule does not result in a change as well. However, this is
-            # decided in the next iteration, see below.
+            # decided in the next iteration, see above.
+            inverted_idxs = list(surviving & applicable_logs(rule_idx))
             inverted_matches = get_matches_for_profile(
                 invert_last_rule(profile),
-                [selected_logs[idx] for idx in selected_idxs],
+                [processed_logs[idx] for idx in inverted_idxs],
+                options,
             )
-            assert len(inverted_matches) == len(selected_idxs)
-            redundancy_mapping[rule_idx] = [
+            assert len(inverted_matches) == len(inverted_idxs)
+            redundant[rule_idx] = LogSet.from_indices(
                 idx
-                for idx, match in zip(selected_idxs, inverted_matches)
-                if not match and new_matches[idx]
-            ]
-
-        if last_matches is not None:
-            removed_rule_idx = rule_idx + 1
-            assert removed_rule_idx < num_rules
-            changed_idxs = [
-                idx for idx, match in new_matches.items() if not match
-            ]
-            decisions_mapping[removed_rule_idx] = changed_idxs
+                for idx, match in zip(inverted_idxs, inverted_matches)
+                if not match
+            )
 
-            # The removed rule is probably also a candidate for redundancy.
-            # Since it is now clear, that the rule is responsible, it should
-            # not be considered redundant.
-            redundancy_mapping[removed_rule_idx] = [
-                idx
-                for idx in redundancy_mapping[removed_rule_idx]
-                if idx not in changed_idxs
-            ]
+        if checkpoint is not None and checkpoint.due():
+            checkpoint.save(
+                len(profile),
+                surviving,
+                decisions_mapping,
+                {idx: list(logs) for idx, logs in redundant.items()},
+            )
 
-        last_matches = new_matches
+    for rule_idx, logs in redundant.items():
+        redundancy_mapping[rule_idx] = list(logs)
 
     # Remove progress and reset
     print(f"\r\033[1A                    ", file=sys.stderr, end='\r')
 
+    return decisions_mapping, redundancy_mapping
+
+
+def bisect_attribution(
+    sandbox_profile: SandboxProfile,
+    processed_logs: ProcessedLogs,
+    options: Optional[MatchOptions] = None,
+) -> Tuple[Dict[int, List[int]], Dict[int, List[int]]]:
+    """
+    Attributes log entries to rules by binary searching over the length of the
+    profile prefix, instead of removing one rule at a time. Log entries that
+    are tested against the same prefix are checked by a single matcher run.
+
+    This relies on the result being consistent for every prefix still
+    containing the deciding rule, which holds under last-match semantics. The
+    search only considers rules applicable to the logged operation and ends
+    with a rule whose removal makes the result inconsistent. That rule is
+    verified by inverting it in the full profile, which only changes the result
+    if the rule actually decides. Log entries failing the verification are
+    attributed by removing one rule at a time, as `linear_attribution` does.
+
+    Redundancy is not determined, because that requires inverting every rule.
+    """
+
+    num_rules = len(sandbox_profile)
+
+    decisions_mapping: Dict[int, List[int]] = defaultdict(list)
+    redundancy_mapping: Dict[int, List[int]] = defaultdict(list)
+
+    applicable_ops = applicable_log_operations(sandbox_profile, processed_logs)
+    applicable_rules: Dict[str, List[int]] = {
+        log['operation']: [
+            rule_idx
+            for rule_idx in range(num_rules)
+            if log['operation'] in applicable_ops[rule_idx]
+        ]
+        for log in processed_logs
+    }
+
+    def rules_for(idx: int) -> List[int]:
+        return applicable_rules[processed_logs[idx]['operation']]
+
+    matches = get_matches_for_profile(
+        sandbox_profile,
+        processed_logs,
+        options,
+    )
+    assert len(matches) == len(processed_logs)
+
+    # Search bounds are positions in the list of applicable rules. Removing the
+    # rule at `lo` is (assumed to be) inconsistent, while removing the rule at
+    # `hi` is known to be consistent. Position len(rules) stands for the full
+    # profile.
+    bounds: Dict[int, Tuple[int, int]] = {
+        idx: (0, len(rules_for(idx)))
+        for idx, match in enumerate(matches)
+        if match and 0 < len(rules_for(idx))
+    }
+
+    rounds = 0
+    print(f"bisection round {rounds}", file=sys.stderr)
+    while True:
+        # Group log entries by the prefix length they are tested with next
+        by_prefix: Dict[int, List[int]] = defaultdict(list)
+        for idx, (lo, hi) in sorted(bounds.items()):
+            if 1 < hi - lo:
+                mid = (lo + hi) // 2
+                by_prefix[rules_for(idx)[mid]].append(idx)
+        if not by_prefix:
+            break
+
+        rounds += 1
+        print(f"\r\033[1Abisection round {rounds}", file=sys.stderr)
+        for prefix_len, idxs in sorted(by_prefix.items()):
+            matches = get_matches_for_profile(
+                sandbox_profile[:prefix_len],
+                [processed_logs[idx] for idx in idxs],
+                options,
+            )
+            assert len(matches) == len(idxs)
+            for idx, match in zip(idxs, matches):
+                lo, hi = bounds[idx]
+                mid = (lo + hi) // 2
+                bounds[idx] = (lo, mid) if match else (mid, hi)
+
+    print(f"\r\033[1A                    ", file=sys.stderr, end='\r')
+
+    # Verify the attributed rules
+    by_rule: Dict[int, List[int]] = defaultdict(list)
+    for idx, (lo, hi) in sorted(bounds.items()):
+        by_rule[rules_for(idx)[lo]].append(idx)
+
+    unverified_idxs: List[int] = []
+    for rule_idx, idxs in sorted(by_rule.items()):
+        inverted_matches = get_matches_for_profile(
+            invert_rule(sandbox_profile, rule_idx),
+            [processed_logs[idx] for idx in idxs],
+            options,
+        )
+        assert len(inverted_matches) == len(idxs)
+        for idx, match in zip(idxs, inverted_matches):
+            if match is False:
+                decisions_mapping[rule_idx].append(idx)
+            else:
+                unverified_idxs.append(idx)
+
+    # Fall back to removing one rule at a time for the remaining log entries
+    pending_idxs = sorted(unverified_idxs)
+    for rule_idx in reversed(range(num_rules)):
+        if not pending_idxs:
+            break
+        selected_idxs = select_applicable(
+            pending_idxs,
+            processed_logs,
+            applicable_ops[rule_idx],
+        )
+        matches = get_matches_for_profile(
+            sandbox_profile[:rule_idx],
+            [processed_logs[idx] for idx in selected_idxs],
+            options,
+        )
+        assert len(matches) == len(selected_idxs)
+        changed_idxs = set(
+            idx for idx, match in zip(selected_idxs, matches) if not match
+        )
+        decisions_mapping[rule_idx].extend(sorted(changed_idxs))
+        pending_idxs = [idx for idx in pending_idxs if idx not in changed_idxs]
+
+    for rule_idx in decisions_mapping:
+        decisions_mapping[rule_idx].sort()
+
+    return decisions_mapping, redundancy_mapping
+
+
+def perform_matching(state: dict) -> Tuple[bool, dict]:
+    """
+    Invokes the matcher, assuming the directory contains both the profile
+    to match against, and processed log entries.
+
+    Note that there are implicit default values for some sandbox operations
+    that are not overwritten by a default rule. An example is
+
+       (allow file-map-executable "/usr/lib/libobjc-trampolines.dylib")
+
+    The `file-map-executable` operation is allowed by default! A default deny
+    profile with no explicit rule for `file-map-executable` will therefore
+    default to allowing all `file-map-executable` actions.
+
+    The results in that case will be inconsistent for each profile reduction
+    and mutation. We therefore cannot match the log entry to a rule and it will
+    be added to the unmatched log entries.
+
+    Rules shadowed by later rules can never decide and are removed from the
+    profile before attribution, which saves one reduction round per rule with
+    the linear strategy. Otherwise, they could be attributed log entries once
+    the rules shadowing them have been removed.
+    """
+
+    processed_logs: ProcessedLogs = state['logs']['processed']
+    original_profile: SandboxProfile = json.loads(
+        state['sandbox_profiles']['original']
+    )
+
+    state['match_results'], state['match_stats'] = match_logs(
+        original_profile,
+        processed_logs,
+        state['arguments'],
+    )
+
+    return True, state
+
+
+def match_logs(
+    original_profile: SandboxProfile,
+    processed_logs: ProcessedLogs,
+    arguments: Dict[str, Any],
+    portable: Optional[PortableEvaluator] = None,
+    shadowed_rules: Optional[Dict[int, List[int]]] = None,
+) -> Tuple[Dict[str, Any], Dict[str, int]]:
+    """
+    Attributes log entries to the rules of a profile, using the matching
+    options in `arguments`. If given, `portable` is used as the portable
+    evaluator, so that its caches can be shared, and `shadowed_rules` as the
+    result of `find_shadowed_rules` for the profile. Returns the match results
+    and statistics, see `perform_matching`.
+    """
+    strategy = arguments.get('strategy', 'linear')
+    evaluator = arguments.get('evaluator', 'auto')
+    assert strategy in MATCHING_STRATEGIES, f"Invalid strategy: {strategy}"
+    assert evaluator in MATCHING_EVALUATORS, f"Invalid evaluator: {evaluator}"
+    if evaluator == 'auto':
+        evaluator = 'sandbox' if sandbox_available() else 'portable'
+    options = MatchOptions(
+        workers=arguments.get('workers', 1),
+        entry_timeout=arguments.get('entry_timeout', 0),
+        run_timeout=arguments.get('run_timeout', 0),
+        evaluator=evaluator,
+        portable=portable,
+    )
+
+    try:
+        return attribute_logs(original_profile, processed_logs, arguments, strategy, options, shadowed_rules)
+    finally:
+        # A shared evaluator must not keep the rules of this profile alive.
+        if options.portable is not None:
+            options.portable.forget_rules()
+
+
+def attribute_logs(
+    original_profile: SandboxProfile,
+    processed_logs: ProcessedLogs,
+    arguments: Dict[str, Any],
+    strategy: str,
+    options: MatchOptions,
+    known_shadowed_rules: Optional[Dict[int, List[int]]],
+) -> Tuple[Dict[str, Any], Dict[str, int]]:
+    """
+    Does the work of `match_logs`, with the matching options resolved.
+    """
+    shadowed_rules: Dict[int, List[int]] = dict()
+    if arguments.get('skip_shadowed', True):
+        if known_shadowed_rules is None:
+            known_shadowed_rules = find_shadowed_rules(original_profile)
+        shadowed_rules = known_shadowed_rules
+    # Indices of the remaining rules in the original profile
+    kept_rules = [
+        rule_idx
+        for rule_idx in range(len(original_profile))
+        if rule_idx not in shadowed_rules
+    ]
+    sandbox_profile = [original_profile[rule_idx] for rule_idx in kept_rules]
+    if shadowed_rules:
+        print(f"Skipping {len(shadowed_rules)} shadowed rules", file=sys.stderr)
+
+    if strategy == 'bisect':
+        decisions_mapping, redundancy_mapping = bisect_attribution(
+            sandbox_profile,
+            processed_logs,
+            options,
+        )
+    else:
+        checkpoint = None
+        if arguments.get('checkpoint'):
+            checkpoint = MatchingCheckpoint(
+                arguments['checkpoint'],
+                sandbox_profile,
+                processed_logs,
+                dict(
+                    strategy=strategy,
+                    evaluator=options.evaluator,
+                    entry_timeout=options.entry_timeout,
+                    run_timeout=options.run_timeout,
+                ),
+                arguments.get('checkpoint_interval', CHECKPOINT_INTERVAL),
+            )
+        decisions_mapping, redundancy_mapping = linear_attribution(
+            sandbox_profile,
+            processed_logs,
+            options,
+            checkpoint,
+        )
+        if checkpoint is not None:
+            checkpoint.remove()
+
+    decisions_mapping = {
+        kept_rules[rule_idx]: log_idxs
+        for rule_idx, log_idxs in decisions_mapping.items()
+    }
+    redundancy_mapping = {
+        kept_rules[rule_idx]: log_idxs
+        for rule_idx, log_idxs in redundancy_mapping.items()
+    }
+
     # Get a list of unmatched log entries
     all_log_idxs: Set[int] = set(range(len(processed_logs)))
     matched_log_idxs: Set[int] = set()
@@ -184,10 +644,16 @@ def perform_matching(state: dict) -> Tuple[bool, dict]:
             matched_log_idxs.add(idx)
     unmatched_log_idxs: Set[int] = all_log_idxs.difference(matched_log_idxs)
 
-    state['match_results'] = {
+    match_results = {
         'rule_deciding_for_log_entries': decisions_mapping,
         'rule_redundant_for_log_entries': redundancy_mapping,
         'unmatched_log_entries': sorted(unmatched_log_idxs),
+        'evaluator': options.evaluator,
+        'shadowed_rules': shadowed_rules,
     }
+    match_stats = dict(options.stats)
+    match_stats['shadowed_rules'] = len(shadowed_rules)
+    # Each rule costs a reduction round with the linear strategy
+    match_stats['skipped_rounds'] = len(shadowed_rules) if strategy == 'linear' else 0
 
-    return True, state
\ No newline at end of file
+    return match_results, match_stats
@@ -0,0 +1,309 @@
+"""
+Rule × log match matrices.
+
+A match matrix records which rules of a profile match which log entries,
+regardless of the rules' actions. Decisions and redundancy are both derived
+from this relation, so once the matrix is known, statistics such as how many
+log entries a rule covers or how much rules overlap do not require further
+matcher runs.
+
+Columns are the unique (operation, argument) pairs of the log entries. The
+matrix is stored in compressed sparse row form with delta-coded column
+indices, in the binary format described in `matching-core/match_matrix.h`.
+`matcher --matrix` builds it using the sandbox, `build_portable_matrix` using
+the portable evaluator.
+
+Matrices are only emitted on request, by `main` below; the analysis pipeline
+does not build them. Reports therefore keep deriving hits and redundancy from
+the match results, which reflect the attribution strategy used, rather than
+from a matrix.
+"""
+import argparse
+import json
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+
+from collections import defaultdict
+from typing import Dict, Iterator, List, Optional, Tuple
+
+from sblogs.evaluate import PortableEvaluator, SandboxProfile, ProcessedLogs
+
+MAGIC = b'SBMX'
+VERSION = 1
+HEADER = struct.Struct('<4s5I')
+
+
+def encode_varint(value: int, out: bytearray) -> None:
+    while value >= 0x80:
+        out.append((value & 0x7f) | 0x80)
+        value >>= 7
+    out.append(value)
+
+
+def decode_varints(data: bytes, start: int, end: int) -> Iterator[int]:
+    value = shift = 0
+    for byte in data[start:end]:
+        value |= (byte & 0x7f) << shift
+        if byte & 0x80:
+            shift += 7
+        else:
+            yield value
+            value = shift = 0
+
+
+class MatchMatrix:
+    """
+    A match matrix with queries by rule (rows) and by log column.
+    """
+
+    def __init__(self, cols: int, log_columns: List[int]) -> None:
+        self.cols = cols
+        self.log_columns = log_columns
+        self.row_nnz = [0]
+        self.row_bytes = [0]
+        self.deltas = bytearray()
+
+    @property
+    def rows(self) -> int:
+        return len(self.row_nnz) - 1
+
+    @property
+    def nnz(self) -> int:
+        return self.row_nnz[-1]
+
+    def append_row(self, columns: List[int]) -> None:
+        """
+        Appends a row. `columns` has to be ascending.
+        """
+        last = 0
+        for col in columns:
+            encode_varint(col - last, self.deltas)
+            last = col
+        self.row_nnz.append(self.row_nnz[-1] + len(columns))
+        self.row_bytes.append(len(self.deltas))
+
+    def row(self, rule_idx: int) -> List[int]:
+        """
+        Returns the log columns a rule matches.
+        """
+        columns = []
+        col = 0
+        for delta in decode_varints(self.deltas, self.row_bytes[rule_idx], self.row_bytes[rule_idx + 1]):
+            col += delta
+            columns.append(col)
+        return columns
+
+    def row_popcount(self, rule_idx: int) -> int:
+        return self.row_nnz[rule_idx + 1] - self.row_nnz[rule_idx]
+
+    def transpose(self) -> List[List[int]]:
+        """
+        Returns, for each log column, the rules matching it.
+        """
+        columns: List[List[int]] = [[] for _ in range(self.cols)]
+        for rule_idx in range(self.rows):
+            for col in self.row(rule_idx):
+                columns[col].append(rule_idx)
+        return columns
+
+    def column(self, col: int) -> List[int]:
+        """
+        Returns the rules matching a log column. Decodes all rows; use
+        `transpose` for more than a few columns.
+        """
+        return [rule_idx for rule_idx in range(self.rows) if col in self.row(rule_idx)]
+
+    def column_popcounts(self) -> List[int]:
+        counts = [0] * self.cols
+        for rule_idx in range(self.rows):
+            for col in self.row(rule_idx):
+                counts[col] += 1
+        return counts
+
+    def logs_for_rule(self, rule_idx: int) -> List[int]:
+        """
+        Returns the indices of the log entries a rule matches.
+        """
+        columns = set(self.row(rule_idx))
+        return [idx for idx, col in enumerate(self.log_columns) if col in columns]
+
+    def rules_for_log(self, log_idx: int) -> List[int]:
+        return self.column(self.log_columns[log_idx])
+
+    def overlap(self, rule_a: int, rule_b: int) -> int:
+        """
+        Returns the number of log columns both rules match.
+        """
+        return len(set(self.row(rule_a)).intersection(self.row(rule_b)))
+
+    def summary(self) -> Dict[str, int]:
+        """
+        Coverage statistics: log columns and entries matched by no rule, and
+        rules matching no log entries.
+        """
+        counts = self.column_popcounts()
+        return {
+            'rules': self.rows,
+            'columns': self.cols,
+            'logs': len(self.log_columns),
+            'nnz': self.nnz,
+            'unmatched_columns': counts.count(0),
+            'unmatched_logs': sum(1 for col in self.log_columns if counts[col] == 0),
+            'rules_without_matches': sum(1 for rule_idx in range(self.rows) if self.row_popcount(rule_idx) == 0),
+        }
+
+    def serialise(self) -> bytes:
+        return b''.join([
+            HEADER.pack(MAGIC, VERSION, self.rows, self.cols, len(self.log_columns), 0),
+            struct.pack(f'<{len(self.row_nnz)}Q', *self.row_nnz),
+            struct.pack(f'<{len(self.row_bytes)}Q', *self.row_bytes),
+            struct.pack(f'<{len(self.log_columns)}I', *self.log_columns),
+            bytes(self.deltas),
+        ])
+
+    @classmethod
+    def deserialise(cls, data: bytes) -> 'MatchMatrix':
+        if len(data) < HEADER.size:
+            raise ValueError("Not a match matrix")
+        magic, version, rows, cols, logs, _ = HEADER.unpack_from(data)
+        if magic != MAGIC:
+            raise ValueError("Not a match matrix")
+        if version != VERSION:
+            raise ValueError(f"Unsupported match matrix version {version}")
+
+        offset = HEADER.size
+        tables_size = 16 * (rows + 1) + 4 * logs
+        if len(data) - offset < tables_size:
+            raise ValueError("Truncated match matrix")
+
+        row_nnz = list(struct.unpack_from(f'<{rows + 1}Q', data, offset))
+        offset += 8 * (rows + 1)
+        row_bytes = list(struct.unpack_from(f'<{rows + 1}Q', data, offset))
+        offset += 8 * (rows + 1)
+        log_columns = list(struct.unpack_from(f'<{logs}I', data, offset))
+        offset += 4 * logs
+        if row_bytes[-1] != len(data) - offset:
+            raise ValueError("Inconsistent match matrix tables")
+
+        matrix = cls(cols, log_columns)
+        matrix.row_nnz = row_nnz
+        matrix.row_bytes = row_bytes
+        matrix.deltas = bytearray(data[offset:])
+        return matrix
+
+    @classmethod
+    def load(cls, path: str) -> 'MatchMatrix':
+        with open(path, 'rb') as infile:
+            return cls.deserialise(infile.read())
+
+    def dump(self, path: str) -> None:
+        with open(path, 'wb') as outfile:
+            outfile.write(self.serialise())
+
+
+def unique_columns(logs: ProcessedLogs) -> Tuple[List[Tuple[str, Optional[str]]], List[int]]:
+    """
+    Returns the unique (operation, argument) pairs of the log entries, in
+    order of appearance, and the column of each log entry.
+    """
+    column_ids: Dict[Tuple[str, Optional[str]], int] = dict()
+    log_columns = [
+        column_ids.setdefault((log['operation'], log.get('argument')), len(column_ids))
+        for log in logs
+    ]
+    return list(column_ids), log_columns
+
+
+def build_portable_matrix(
+    profile: SandboxProfile,
+    logs: ProcessedLogs,
+    evaluator: Optional[PortableEvaluator] = None,
+) -> MatchMatrix:
+    """
+    Builds the match matrix using the portable evaluator. Pairs for which a
+    rule's filters cannot be evaluated are not attributed to the rule.
+    """
+    if evaluator is None:
+        evaluator = PortableEvaluator()
+
+    columns, log_columns = unique_columns(logs)
+    by_operation: Dict[str, List[int]] = defaultdict(list)
+    for col, (operation, _) in enumerate(columns):
+        by_operation[operation].append(col)
+
+    matrix = MatchMatrix(len(columns), log_columns)
+    for rule in profile:
+        matched = []
+        for operation, cols in by_operation.items():
+            for col in cols:
+                if evaluator.rule_matches(rule, operation, columns[col][1]):
+                    matched.append(col)
+        matrix.append_row(sorted(matched))
+    return matrix
+
+
+def build_matrix(
+    profile: SandboxProfile,
+    logs: ProcessedLogs,
+    evaluator: str = 'sandbox',
+    workers: int = 1,
+) -> MatchMatrix:
+    """
+    Builds the match matrix using the given evaluator, see
+    `sblogs.match.MATCHING_EVALUATORS`.
+    """
+    from sblogs.match import MATCHER
+
+    if evaluator == 'portable':
+        return build_portable_matrix(profile, logs)
+
+    with tempfile.TemporaryDirectory() as tempdir:
+        matrix_path = os.path.join(tempdir, 'matrix.sbmx')
+        build = subprocess.run(
+            [MATCHER, '--workers', str(workers), '--matrix', matrix_path],
+            capture_output=True,
+            text=True,
+            input=json.dumps(dict(
+                sandbox_profile=profile,
+                processed_logs=logs,
+            )),
+        )
+        if build.returncode != 0:
+            print(build.stderr, file=sys.stderr)
+            build.check_returncode()
+        return MatchMatrix.load(matrix_path)
+
+
+def main() -> None:
+    from sblogs.match import MATCHING_EVALUATORS, sandbox_available
+    from sbresults.container import load_results
+
+    parser = argparse.ArgumentParser(description='Build the rule × log match matrix of a sandbox_coverage.json')
+    parser.add_argument('--evaluator', choices=MATCHING_EVALUATORS, default='auto',
+                        help='How rules are evaluated. (default: the sandbox, where available)')
+    parser.add_argument('state', help='Path to a sandbox_coverage.json containing processed logs.')
+    parser.add_argument('matrix', help='Path the matrix is written to. Only printed if it exists.')
+    args = parser.parse_args()
+
+    if os.path.exists(args.matrix):
+        matrix = MatchMatrix.load(args.matrix)
+    else:
+        state = load_results(args.state)
+        profile = state['sandbox_profiles']['original']
+        if isinstance(profile, str):
+            profile = json.loads(profile)
+        evaluator = args.evaluator
+        if evaluator == 'auto':
+            evaluator = 'sandbox' if sandbox_available() else 'portable'
+        matrix = build_matrix(profile, state['logs']['processed'], evaluator)
+        matrix.dump(args.matrix)
+
+    json.dump(matrix.summary(), sys.stdout, indent=4)
+    print()
+
+
+if __name__ == '__main__':
+    main()
@@ -9,15 +9,23 @@ import argparse
 import os
 import json
 import re
+import subprocess
 import sys
 
-from typing import Optional
+from typing import List, Optional
 
 from maap.misc.logger import create_logger
 from maap.misc.filesystem import project_path
 
 logger = create_logger('sblogs.process')
 
+# Native implementation of `process_raw_logs` working on files, see
+# matching-core/sblog_ingest.cpp
+SBLOG_INGEST = os.path.join(
+    os.path.dirname(os.path.dirname(os.path.abspath(__file__))),
+    'matching-core', 'build', 'bin', 'sblog-ingest',
+)
+
 
 def parse_action_field(action_part: str):
     """
@@ -125,12 +133,65 @@ def is_relevant_log_entry(log_entry: dict, pid: int) -> bool:
     return True
 
 
-def process_logs(state: dict) -> (bool, dict):
-    pid = state['process_infos']['pid']
-    logs = state['logs']['raw']
-
+def process_raw_logs(logs: List[dict], pid: int) -> List[dict]:
     relevant_entries = filter(lambda entry: is_relevant_log_entry(entry, pid), logs)
     converted_entries = map(convert_log_entry, relevant_entries)
 
-    state['logs']['processed'] = [x for x in converted_entries if x is not None]
-    return True, state
\ No newline at end of file
+    return [x for x in converted_entries if x is not None]
+
+
+def native_ingest_available() -> bool:
+    """
+    Whether the native `sblog-ingest` tool was built.
+    """
+    return os.path.exists(SBLOG_INGEST)
+
+
+def sblog_ingest(path: str, pid: int) -> List[dict]:
+    """
+    Runs `sblog-ingest` on the raw logs at `path`.
+    """
+    output = subprocess.run(
+        [SBLOG_INGEST, '--pid', str(pid), path],
+        stdout=subprocess.PIPE,
+        check=True,
+    ).stdout
+    # One document per line, parsed at once
+    return json.loads(b'[' + b','.join(output.splitlines()) + b']')
+
+
+def process_raw_log_file(path: str, pid: int) -> List[dict]:
+    """
+    Processes raw logs stored in a file, as written by `log show --style json`.
+    Uses the native `sblog-ingest` tool if it was built, which avoids loading
+    the raw logs in their entirety.
+    """
+    if native_ingest_available():
+        return sblog_ingest(path, pid)
+
+    with open(path) as infile:
+        return process_raw_logs(json.load(infile), pid)
+
+
+def process_logs(state: dict) -> (bool, dict):
+    # Logs streamed during collection, or converted from the raw log file by
+    # sblog-ingest, are already processed.
+    if 'processed' in state['logs'] or 'raw' not in state['logs']:
+        return True, state
+
+    state['logs']['processed'] = process_raw_logs(state['logs']['raw'], state['process_infos']['pid'])
+    return True, state
+
+def main():
+    parser = argparse.ArgumentParser(description='Process raw sandbox logs of a single process')
+    parser.add_argument('--pid', required=True, type=int,
+                        help='PID of the process whose sandbox logs to process.')
+    parser.add_argument('raw_logs',
+                        help='Path to raw logs, as output by `log show --style json`.')
+    args = parser.parse_args()
+
+    json.dump(process_raw_log_file(args.raw_logs, args.pid), sys.stdout, indent=4)
+
+
+if __name__ == '__main__':
+    main()
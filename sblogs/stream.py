@@ -0,0 +1,327 @@
+"""
+Incremental collection of sandbox logs.
+
+Instead of dumping the system log once the app has exited, log entries are
+consumed while the app is running. Entries are filtered and processed as they
+arrive and then appended to a spill file, so memory usage does not grow with
+the number of log entries and processing overlaps the app's run.
+
+Log entries are read from a `LogSource`. `LogStreamSource` follows the live
+system log, `ReplaySource` reads entries from a file, which allows running the
+pipeline on recorded logs, e.g. on other platforms.
+
+A `SaturationTracker` records when new distinct log entries appear, which is
+used to stop apps that no longer exercise new parts of their sandbox profile.
+"""
+import argparse
+import datetime
+import json
+import subprocess
+import sys
+import threading
+import time
+
+from typing import IO, Callable, Iterator, List, Optional, Set, Tuple
+
+from sblogs.process import convert_log_entry, is_relevant_log_entry
+
+SANDBOX_SENDER = "/System/Library/Extensions/Sandbox.kext/Contents/MacOS/Sandbox"
+
+
+class LogSource:
+    """
+    A source of raw log entries, in the format used by `log show --style json`.
+    """
+
+    def entries(self) -> Iterator[dict]:
+        raise NotImplementedError
+
+    def close(self) -> None:
+        """
+        Stops producing entries. May be called from another thread.
+        """
+        pass
+
+
+class LogStreamSource(LogSource):
+    """
+    Follows the system log using `log stream`, restricted to the Sandbox
+    sender. Entries are produced until the source is closed.
+    """
+
+    def __init__(self) -> None:
+        self.process = subprocess.Popen(
+            [
+                "log", "stream",
+                "--style", "ndjson",
+                "--predicate", f'senderImagePath == "{SANDBOX_SENDER}"',
+            ],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.DEVNULL,
+            text=True,
+        )
+
+    def entries(self) -> Iterator[dict]:
+        for line in self.process.stdout:
+            # The first line describes the filter and is not JSON.
+            if line.startswith('{'):
+                yield json.loads(line)
+        self.process.wait()
+
+    def close(self) -> None:
+        if self.process.poll() is None:
+            self.process.terminate()
+
+
+class ReplaySource(LogSource):
+    """
+    Replays log entries from a file. Both the output of `log show --style json`
+    and of `log stream --style ndjson` are supported.
+    """
+
+    def __init__(self, path: str) -> None:
+        self.path = path
+        self.closed = threading.Event()
+
+    def entries(self) -> Iterator[dict]:
+        with open(self.path) as infile:
+            first = infile.read(1)
+            while first.isspace():
+                first = infile.read(1)
+            infile.seek(0)
+
+            if first == '[':
+                lines = json.load(infile)
+            else:
+                lines = (json.loads(line) for line in infile if line.startswith('{'))
+
+            for entry in lines:
+                if self.closed.is_set():
+                    return
+                yield entry
+
+    def close(self) -> None:
+        self.closed.set()
+
+
+def replay_timestamp(entry: dict) -> float:
+    """
+    Returns the time a recorded log entry was logged at, in seconds.
+    """
+    return datetime.datetime.strptime(
+        entry['timestamp'], "%Y-%m-%d %H:%M:%S.%f%z"
+    ).timestamp()
+
+
+class SaturationTracker:
+    """
+    Tracks distinct (action, operation, argument) tuples of processed log
+    entries over time. Coverage is considered saturated once no new tuple has
+    appeared for `window` seconds.
+
+    The saturation curve lists the number of distinct tuples seen, whenever it
+    grows, together with the number of seconds since `start`. If no start is
+    given, the time of the first observation is used.
+    """
+
+    def __init__(self, window: float, start: Optional[float] = None) -> None:
+        self.window = window
+        self.start = start
+        self.last_new = start
+        self.seen: Set[Tuple[str, str, Optional[str]]] = set()
+        self.curve: List[Tuple[float, int]] = []
+        self.lock = threading.Lock()
+
+    def observe(self, log: dict, now: float) -> bool:
+        """
+        Records a processed log entry seen at time `now`. Returns whether its
+        tuple is new.
+        """
+        key = (log['action'], log['operation'], log.get('argument'))
+        with self.lock:
+            if self.start is None:
+                self.start = self.last_new = now
+            if key in self.seen:
+                return False
+            self.seen.add(key)
+            self.last_new = max(self.last_new, now)
+            self.curve.append((round(now - self.start, 3), len(self.seen)))
+            return True
+
+    def is_saturated(self, now: float) -> bool:
+        with self.lock:
+            return self.last_new is not None and now - self.last_new >= self.window
+
+    def summary(self, duration: float, stopped_early: bool) -> dict:
+        """
+        Returns the representation stored in the state.
+        """
+        with self.lock:
+            return {
+                'window': self.window,
+                'curve': [list(point) for point in self.curve],
+                'distinct': len(self.seen),
+                'duration': round(duration, 3),
+                'stopped_early': stopped_early,
+            }
+
+
+class LogConsumer(threading.Thread):
+    """
+    Consumes a log source in the background and appends the processed log
+    entries of a single process to a spill file, one JSON dictionary per line.
+
+    The PID of the process is usually not known before the process is started
+    and has to be supplied using `set_pid`. Entries are only consumed once it
+    is known.
+
+    If a saturation tracker is given, every processed entry is reported to it,
+    using `clock` to tell the current time. With `stop_when_saturated`, the
+    consumer itself stops once coverage is saturated, which is used when
+    replaying recorded logs in place of running the app.
+    """
+
+    def __init__(
+        self,
+        source: LogSource,
+        spill_file: IO[str],
+        tracker: Optional[SaturationTracker] = None,
+        clock: Callable[[dict], float] = lambda entry: time.monotonic(),
+        stop_when_saturated: bool = False,
+    ) -> None:
+        super().__init__(daemon=True)
+        self.source = source
+        self.spill_file = spill_file
+        self.tracker = tracker
+        self.clock = clock
+        self.stop_when_saturated = stop_when_saturated
+        self.last_time: Optional[float] = None
+        self.saturated_at: Optional[float] = None
+        self.pid: Optional[int] = None
+        self.pid_known = threading.Event()
+        self.stopped = threading.Event()
+        self.consumed = 0
+        self.processed = 0
+        self.error: Optional[Exception] = None
+
+    def set_pid(self, pid: int) -> None:
+        self.pid = pid
+        self.pid_known.set()
+
+    def run(self) -> None:
+        self.pid_known.wait()
+        try:
+            for entry in self.source.entries():
+                self.consumed += 1
+                if entry.get('senderImagePath', SANDBOX_SENDER) != SANDBOX_SENDER:
+                    continue
+                if not is_relevant_log_entry(entry, self.pid):
+                    continue
+
+                if self.tracker is not None:
+                    now = self.last_time = self.clock(entry)
+                    if self.stop_when_saturated and self.tracker.is_saturated(now):
+                        self.saturated_at = now
+                        break
+
+                processed = convert_log_entry(entry)
+                if processed is not None:
+                    self.spill_file.write(json.dumps(processed) + '\n')
+                    self.processed += 1
+                    if self.tracker is not None:
+                        self.tracker.observe(processed, now)
+        except Exception as e:
+            self.error = e
+        finally:
+            self.spill_file.flush()
+            self.stopped.set()
+
+    def stop(self, grace_period: float = 0.0) -> None:
+        """
+        Waits up to `grace_period` seconds for the source to run dry, which
+        gives the system log time to deliver pending entries, then closes the
+        source and waits for the consumer to finish.
+        """
+        self.pid_known.set()
+        self.stopped.wait(grace_period)
+        self.source.close()
+        self.join()
+
+
+def read_spill_file(path: str) -> List[dict]:
+    with open(path) as infile:
+        return [json.loads(line) for line in infile]
+
+
+def collect_from_source(source: LogSource, pid: int, spill_path: str) -> List[dict]:
+    """
+    Runs a consumer over the whole source and returns the processed entries.
+    """
+    with open(spill_path, 'w') as spill_file:
+        consumer = LogConsumer(source, spill_file)
+        consumer.start()
+        consumer.set_pid(pid)
+        consumer.join()
+
+    if consumer.error is not None:
+        raise consumer.error
+
+    return read_spill_file(spill_path)
+
+
+def replay_with_saturation(
+    source: LogSource,
+    pid: int,
+    spill_path: str,
+    window: float,
+) -> Tuple[List[dict], dict]:
+    """
+    Stand-in for running an app with saturation-based early stop: recorded
+    log entries are consumed as if they were logged live, until no new tuple
+    has appeared for `window` seconds according to their timestamps. Returns
+    the processed entries and the saturation summary.
+    """
+    tracker = SaturationTracker(window)
+
+    with open(spill_path, 'w') as spill_file:
+        consumer = LogConsumer(source, spill_file, tracker, replay_timestamp, stop_when_saturated=True)
+        consumer.start()
+        consumer.set_pid(pid)
+        consumer.join()
+
+    if consumer.error is not None:
+        raise consumer.error
+
+    if tracker.start is None:
+        summary = tracker.summary(0.0, False)
+    elif consumer.saturated_at is not None:
+        summary = tracker.summary(tracker.last_new + window - tracker.start, True)
+    else:
+        summary = tracker.summary(consumer.last_time - tracker.start, False)
+    return read_spill_file(spill_path), summary
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Process recorded sandbox logs incrementally')
+    parser.add_argument('--pid', required=True, type=int,
+                        help='PID of the process whose sandbox logs to process.')
+    parser.add_argument('--replay', required=True,
+                        help='Path to recorded logs, as output by `log show --style json` or `log stream --style ndjson`.')
+    parser.add_argument('--saturation-window', required=False, default=None, type=float,
+                        help='Stop once no new log entry appeared for this many seconds, according to the recorded timestamps.')
+    parser.add_argument('spill_file',
+                        help='Path to the spill file the processed log entries are appended to.')
+    args = parser.parse_args()
+
+    source = ReplaySource(args.replay)
+    if args.saturation_window is None:
+        processed = collect_from_source(source, args.pid, args.spill_file)
+    else:
+        processed, summary = replay_with_saturation(source, args.pid, args.spill_file, args.saturation_window)
+        json.dump(summary, sys.stdout, indent=4)
+        print()
+    print(f"{len(processed)} log entries processed", file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
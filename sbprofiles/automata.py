@@ -0,0 +1,531 @@
+"""
+Finite automata for SBPL regular expressions.
+
+Regex filters such as `path-regex` cannot be compared textually: `^/a/.*`
+covers `^/a/b[0-9]$`, although neither is a prefix of the other. This module
+compiles regular expressions into deterministic automata and decides whether
+the language of one includes or intersects that of another.
+
+The dialect is the POSIX extended syntax used by SBPL: literals, `.`, bracket
+expressions including classes such as `[:alnum:]`, groups, alternation, the
+`*`, `+`, `?` and `{m,n}` quantifiers and the `^` and `$` anchors. As with
+`re.search`, a regex matches a string if it matches any part of it. Escapes
+are interpreted as in Python, so that results agree with the portable
+evaluator. Escapes of letters and digits, such as `\\w`, are not supported.
+
+Anchors are handled by enclosing strings in the markers `BOS` and `EOS`,
+which `^` and `$` match like characters. A regex is then compiled into an
+automaton accepting `BOS s EOS` for every string `s` it matches somewhere.
+
+DFA states are subsets of NFA states and only constructed once needed, so
+checks that are decided early do not pay for the whole automaton. Some regexes
+used by Apple have automata too large to construct; once an automaton
+exceeds `MAX_STATES`, checks involving it are undecided.
+"""
+from bisect import bisect_right
+from collections import deque
+from functools import lru_cache
+from typing import Dict, FrozenSet, Iterable, List, Optional, Tuple
+
+# Characters are Unicode code points, followed by the two markers.
+MAX_CHAR = 0x10ffff
+BOS = MAX_CHAR + 1
+EOS = MAX_CHAR + 2
+
+# Sets of characters as sorted, disjoint, inclusive intervals
+CharSet = Tuple[Tuple[int, int], ...]
+
+ANY_CHAR: CharSet = ((0, MAX_CHAR),)
+ANY_SYMBOL: CharSet = ((0, EOS),)
+
+# Maximum number of NFA states per regex
+MAX_NFA_STATES = 16384
+
+# Maximum number of DFA states constructed per regex
+MAX_STATES = 4096
+
+# Maximum number of automaton state pairs visited per check
+MAX_PAIRS = 65536
+
+# Maximum number of copies of a subexpression made for `{m,n}`
+MAX_REPEAT = 256
+
+# Number of compiled regexes and of check results kept
+REGEX_CACHE_SIZE = 256
+RESULT_CACHE_SIZE = 16384
+
+POSIX_CLASSES: Dict[str, CharSet] = {
+    'alnum': ((0x30, 0x39), (0x41, 0x5a), (0x61, 0x7a)),
+    'alpha': ((0x41, 0x5a), (0x61, 0x7a)),
+    'blank': ((0x09, 0x09), (0x20, 0x20)),
+    'cntrl': ((0x00, 0x1f), (0x7f, 0x7f)),
+    'digit': ((0x30, 0x39),),
+    'graph': ((0x21, 0x7e),),
+    'lower': ((0x61, 0x7a),),
+    'print': ((0x20, 0x7e),),
+    'punct': ((0x21, 0x2f), (0x3a, 0x40), (0x5b, 0x60), (0x7b, 0x7e)),
+    'space': ((0x09, 0x0d), (0x20, 0x20)),
+    'upper': ((0x41, 0x5a),),
+    'xdigit': ((0x30, 0x39), (0x41, 0x46), (0x61, 0x66)),
+}
+
+
+class RegexError(ValueError):
+    """
+    Raised for malformed regexes and syntax that is not supported.
+    """
+
+
+class AutomatonTooLarge(Exception):
+    """
+    Raised once an automaton would exceed `MAX_STATES` states.
+    """
+
+
+def char_set(intervals: List[Tuple[int, int]]) -> CharSet:
+    """
+    Normalises intervals into a character set.
+    """
+    merged: List[Tuple[int, int]] = []
+    for lo, hi in sorted(intervals):
+        if merged and lo <= merged[-1][1] + 1:
+            merged[-1] = (merged[-1][0], max(merged[-1][1], hi))
+        else:
+            merged.append((lo, hi))
+    return tuple(merged)
+
+
+def complement(chars: CharSet) -> CharSet:
+    """
+    Returns all characters, but not markers, missing from `chars`.
+    """
+    result = []
+    next_char = 0
+    for lo, hi in chars:
+        if next_char < lo:
+            result.append((next_char, lo - 1))
+        next_char = hi + 1
+    if next_char <= MAX_CHAR:
+        result.append((next_char, MAX_CHAR))
+    return tuple(result)
+
+
+def contains(chars: CharSet, char: int) -> bool:
+    return any(lo <= char <= hi for lo, hi in chars)
+
+
+def escape(text: str) -> str:
+    """
+    Escapes a string, so that it is matched literally.
+    """
+    return ''.join('\\' + c if c in '.^$*+?()[]{}|\\' else c for c in text)
+
+
+# Regex syntax trees. Nodes are tuples, whose first element is the kind:
+# ('chars', CharSet), ('cat', [nodes]), ('alt', [nodes]) and
+# ('repeat', node, min, max), where max is None if unbounded.
+Node = tuple
+
+
+class Parser:
+    """
+    Recursive descent parser for the SBPL regex dialect.
+    """
+
+    def __init__(self, pattern: str) -> None:
+        self.pattern = pattern
+        self.pos = 0
+
+    def peek(self) -> Optional[str]:
+        return self.pattern[self.pos] if self.pos < len(self.pattern) else None
+
+    def take(self) -> str:
+        if self.pos >= len(self.pattern):
+            raise RegexError(f"Unexpected end of regex {self.pattern!r}")
+        c = self.pattern[self.pos]
+        self.pos += 1
+        return c
+
+    def parse(self) -> Node:
+        node = self.alternation()
+        if self.pos != len(self.pattern):
+            raise RegexError(f"Unbalanced parenthesis in {self.pattern!r}")
+        return node
+
+    def alternation(self) -> Node:
+        branches = [self.concatenation()]
+        while self.peek() == '|':
+            self.pos += 1
+            branches.append(self.concatenation())
+        return branches[0] if len(branches) == 1 else ('alt', branches)
+
+    def concatenation(self) -> Node:
+        items = []
+        while self.peek() not in (None, '|', ')'):
+            items.append(self.quantified())
+        return items[0] if len(items) == 1 else ('cat', items)
+
+    def bound(self) -> Optional[Tuple[int, Optional[int]]]:
+        """
+        Parses a `{m}`, `{m,}` or `{m,n}` quantifier. Braces not starting a
+        quantifier are literals.
+        """
+        end = self.pattern.find('}', self.pos)
+        if end == -1:
+            return None
+        parts = self.pattern[self.pos + 1:end].split(',')
+        if len(parts) > 2 or not parts[0].isdigit() or not all(p.isdigit() for p in parts[1:] if p):
+            return None
+        low = int(parts[0])
+        high: Optional[int] = low
+        if len(parts) == 2:
+            high = int(parts[1]) if parts[1] else None
+        if (high is not None and high < low) or max(low, high or 0) > MAX_REPEAT:
+            raise RegexError(f"Unsupported bound in {self.pattern!r}")
+        self.pos = end + 1
+        return low, high
+
+    def quantified(self) -> Node:
+        node = self.atom()
+        while True:
+            c = self.peek()
+            if c == '*':
+                self.pos += 1
+                node = ('repeat', node, 0, None)
+            elif c == '+':
+                self.pos += 1
+                node = ('repeat', node, 1, None)
+            elif c == '?':
+                self.pos += 1
+                node = ('repeat', node, 0, 1)
+            elif c == '{':
+                bound = self.bound()
+                if bound is None:
+                    break
+                node = ('repeat', node, bound[0], bound[1])
+            else:
+                break
+        return node
+
+    def escaped(self) -> int:
+        c = self.take()
+        if c.isalnum():
+            raise RegexError(f"Unsupported escape \\{c} in {self.pattern!r}")
+        return ord(c)
+
+    def atom(self) -> Node:
+        c = self.take()
+        if c == '(':
+            node = self.alternation()
+            if self.take() != ')':
+                raise RegexError(f"Unbalanced parenthesis in {self.pattern!r}")
+            return node
+        if c == '[':
+            return ('chars', self.bracket())
+        if c == '.':
+            return ('chars', ANY_CHAR)
+        if c == '^':
+            return ('chars', ((BOS, BOS),))
+        if c == '$':
+            return ('chars', ((EOS, EOS),))
+        if c == '\\':
+            char = self.escaped()
+            return ('chars', ((char, char),))
+        if c in '*+?':
+            raise RegexError(f"Nothing to repeat in {self.pattern!r}")
+        return ('chars', ((ord(c), ord(c)),))
+
+    def bracket(self) -> CharSet:
+        negated = self.peek() == '^'
+        if negated:
+            self.pos += 1
+        intervals: List[Tuple[int, int]] = []
+        first = True
+        while True:
+            c = self.take()
+            if c == ']' and not first:
+                break
+            first = False
+            if c == '[' and self.peek() == ':':
+                end = self.pattern.find(':]', self.pos + 1)
+                name = self.pattern[self.pos + 1:end] if end != -1 else ''
+                if name not in POSIX_CLASSES:
+                    raise RegexError(f"Unsupported character class in {self.pattern!r}")
+                intervals.extend(POSIX_CLASSES[name])
+                self.pos = end + 2
+                continue
+            low = self.escaped() if c == '\\' else ord(c)
+            if self.peek() == '-' and self.pos + 1 < len(self.pattern) and self.pattern[self.pos + 1] != ']':
+                self.pos += 1
+                c = self.take()
+                high = self.escaped() if c == '\\' else ord(c)
+                if high < low:
+                    raise RegexError(f"Invalid range in {self.pattern!r}")
+                intervals.append((low, high))
+            else:
+                intervals.append((low, low))
+        chars = char_set(intervals)
+        return complement(chars) if negated else chars
+
+
+class NFA:
+    """
+    Nondeterministic automaton with epsilon transitions, built from a syntax
+    tree using Thompson's construction.
+    """
+
+    def __init__(self, node: Node) -> None:
+        self.epsilons: List[List[int]] = []
+        self.edges: List[List[Tuple[CharSet, int]]] = []
+        self.start = self.add_state()
+        # Matches may start and end anywhere, see the module description.
+        loop = ('repeat', ('chars', ANY_SYMBOL), 0, None)
+        self.accept = self.build(('cat', [loop, node, loop]), self.start)
+
+    def add_state(self) -> int:
+        if len(self.epsilons) >= MAX_NFA_STATES:
+            raise RegexError("Regex too large")
+        self.epsilons.append([])
+        self.edges.append([])
+        return len(self.epsilons) - 1
+
+    def build(self, node: Node, start: int) -> int:
+        """
+        Adds the states of `node`, entered from `start`, and returns the state
+        reached after it.
+        """
+        kind = node[0]
+        if kind == 'chars':
+            end = self.add_state()
+            self.edges[start].append((node[1], end))
+            return end
+        if kind == 'cat':
+            for item in node[1]:
+                start = self.build(item, start)
+            return start
+        if kind == 'alt':
+            end = self.add_state()
+            for branch in node[1]:
+                self.epsilons[self.build(branch, start)].append(end)
+            return end
+
+        _, item, low, high = node
+        for _ in range(low):
+            start = self.build(item, start)
+        if high is None:
+            loop = self.add_state()
+            self.epsilons[start].append(loop)
+            self.epsilons[self.build(item, loop)].append(loop)
+            return loop
+        end = self.add_state()
+        self.epsilons[start].append(end)
+        for _ in range(high - low):
+            start = self.build(item, start)
+            self.epsilons[start].append(end)
+        return end
+
+    def closure(self, states: List[int]) -> FrozenSet[int]:
+        reached = set(states)
+        pending = list(states)
+        while pending:
+            for target in self.epsilons[pending.pop()]:
+                if target not in reached:
+                    reached.add(target)
+                    pending.append(target)
+        return frozenset(reached)
+
+    def boundaries(self, states: Iterable[int]) -> List[int]:
+        """
+        Returns the sorted characters at which the transitions of the given
+        states change, so that all characters between consecutive boundaries
+        behave alike.
+        """
+        points = {0, EOS + 1}
+        for state in states:
+            for chars, _ in self.edges[state]:
+                for lo, hi in chars:
+                    points.add(lo)
+                    points.add(hi + 1)
+        return sorted(points)
+
+
+class DFA:
+    """
+    Deterministic automaton over the character classes of a regex, whose
+    states are constructed on demand.
+    """
+
+    def __init__(self, pattern: str) -> None:
+        self.pattern = pattern
+        self.nfa = NFA(Parser(pattern).parse())
+        self.boundaries = self.nfa.boundaries(range(len(self.nfa.edges)))
+        self.state_ids: Dict[FrozenSet[int], int] = dict()
+        self.states: List[FrozenSet[int]] = []
+        self.transitions: List[Dict[int, int]] = []
+        # Boundaries of the characters each state distinguishes, see
+        # `NFA.boundaries`. Most states only distinguish a few characters.
+        self.state_boundaries: List[Optional[List[int]]] = []
+        self.start = self.state(self.nfa.closure([self.nfa.start]))
+        self.dead = self.state(frozenset())
+
+    def state(self, nfa_states: FrozenSet[int]) -> int:
+        state_id = self.state_ids.get(nfa_states)
+        if state_id is None:
+            if len(self.states) >= MAX_STATES:
+                raise AutomatonTooLarge(self.pattern)
+            state_id = len(self.states)
+            self.state_ids[nfa_states] = state_id
+            self.states.append(nfa_states)
+            self.transitions.append(dict())
+            self.state_boundaries.append(None)
+        return state_id
+
+    def distinguished(self, state_id: int) -> List[int]:
+        boundaries = self.state_boundaries[state_id]
+        if boundaries is None:
+            boundaries = self.nfa.boundaries(self.states[state_id])
+            self.state_boundaries[state_id] = boundaries
+        return boundaries
+
+    def step(self, state_id: int, char: int) -> int:
+        char_class = bisect_right(self.boundaries, char) - 1
+        target = self.transitions[state_id].get(char_class)
+        if target is None:
+            targets = [
+                target
+                for nfa_state in self.states[state_id]
+                for chars, target in self.nfa.edges[nfa_state]
+                if contains(chars, char)
+            ]
+            target = self.state(self.nfa.closure(targets))
+            self.transitions[state_id][char_class] = target
+        return target
+
+    def initial(self) -> int:
+        """
+        Returns the state after the beginning of a string.
+        """
+        return self.step(self.start, BOS)
+
+    def accepts(self, state_id: int) -> bool:
+        """
+        Returns whether a string ending in this state is matched.
+        """
+        return self.nfa.accept in self.states[self.step(state_id, EOS)]
+
+    def matches(self, text: str) -> bool:
+        state_id = self.initial()
+        for c in text:
+            state_id = self.step(state_id, ord(c))
+        return self.accepts(state_id)
+
+
+@lru_cache(maxsize=RESULT_CACHE_SIZE)
+def anchored_prefix(pattern: str) -> Optional[str]:
+    """
+    Returns the text all strings matched by a regex start with, or None if the
+    regex is not anchored at the beginning or not supported.
+    """
+    try:
+        node = Parser(pattern).parse()
+    except RegexError:
+        return None
+    items = node[1] if node[0] == 'cat' else [node]
+    if not items or items[0] != ('chars', ((BOS, BOS),)):
+        return None
+    text = []
+    for item in items[1:]:
+        if item[0] != 'chars' or len(item[1]) != 1 or item[1][0][0] != item[1][0][1] or item[1][0][0] > MAX_CHAR:
+            break
+        text.append(chr(item[1][0][0]))
+    return ''.join(text)
+
+
+@lru_cache(maxsize=REGEX_CACHE_SIZE)
+def compile_regex(pattern: str) -> Optional[DFA]:
+    """
+    Returns the automaton of a regex, or None if it is not supported.
+    """
+    try:
+        return DFA(pattern)
+    except RegexError:
+        return None
+
+
+def regex_matches(pattern: str, text: str) -> Optional[bool]:
+    """
+    Returns whether a regex matches a string, or None if this cannot be
+    decided.
+    """
+    dfa = compile_regex(pattern)
+    if dfa is None:
+        return None
+    try:
+        return dfa.matches(text)
+    except AutomatonTooLarge:
+        return None
+
+
+def representatives(a: DFA, state_a: int, b: DFA, state_b: int) -> List[int]:
+    """
+    Returns one character of each class of characters both automata treat
+    alike in the given states. Markers are left out.
+    """
+    points = set(a.distinguished(state_a)).union(b.distinguished(state_b))
+    return [point for point in points if point <= MAX_CHAR]
+
+
+def explore(a: DFA, b: DFA, visit) -> Optional[bool]:
+    """
+    Runs both automata on all strings in parallel, breadth first, and calls
+    `visit` with the states reached. Stops as soon as `visit` returns True.
+    Returns whether it did, or None if the automata are too large.
+    """
+    try:
+        start = (a.initial(), b.initial())
+        seen = {start}
+        pending = deque([start])
+        while pending:
+            state_a, state_b = pending.popleft()
+            if visit(state_a, state_b):
+                return True
+            for char in representatives(a, state_a, b, state_b):
+                pair = (a.step(state_a, char), b.step(state_b, char))
+                if pair[0] == a.dead or pair in seen:
+                    continue
+                if len(seen) >= MAX_PAIRS:
+                    return None
+                seen.add(pair)
+                pending.append(pair)
+    except AutomatonTooLarge:
+        return None
+    return False
+
+
+@lru_cache(maxsize=RESULT_CACHE_SIZE)
+def includes(outer: str, inner: str) -> Optional[bool]:
+    """
+    Returns whether every string matched by regex `inner` is matched by regex
+    `outer`, or None if this cannot be decided.
+    """
+    if outer == inner:
+        return True
+    a, b = compile_regex(inner), compile_regex(outer)
+    if a is None or b is None:
+        return None
+    counterexample = explore(a, b, lambda state_a, state_b: a.accepts(state_a) and not b.accepts(state_b))
+    return None if counterexample is None else not counterexample
+
+
+@lru_cache(maxsize=RESULT_CACHE_SIZE)
+def intersects(first: str, second: str) -> Optional[bool]:
+    """
+    Returns whether some string is matched by both regexes, or None if this
+    cannot be decided.
+    """
+    a, b = compile_regex(first), compile_regex(second)
+    if a is None or b is None:
+        return None
+    return explore(a, b, lambda state_a, state_b: (
+        state_b != b.dead and a.accepts(state_a) and b.accepts(state_b)
+    ))
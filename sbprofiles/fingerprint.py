@@ -0,0 +1,59 @@
+"""
+Fingerprints of sandbox rules.
+
+Rules are compared by their canonical JSON serialisation, with keys sorted.
+A fingerprint is a 128-bit BLAKE2b digest of that serialisation, so rules can
+be compared and looked up by hash instead of by their full text.
+"""
+import hashlib
+import json
+
+from typing import Any, Dict, List, Optional
+
+from sbprofiles.replace import Replacer
+
+SandboxRule = Dict[str, Any]
+
+FINGERPRINT_SIZE = 16
+
+
+def canonical_rule(rule: SandboxRule) -> str:
+    return json.dumps(rule, sort_keys=True)
+
+
+def canonical_fingerprint(canonical: str) -> bytes:
+    return hashlib.blake2b(canonical.encode(), digest_size=FINGERPRINT_SIZE).digest()
+
+
+def rule_fingerprint(rule: SandboxRule, replacer: Optional[Replacer] = None) -> bytes:
+    """
+    Returns the fingerprint of a rule. If given, `replacer` is applied to the
+    canonical serialisation first.
+    """
+    canonical = canonical_rule(rule)
+    if replacer is not None:
+        canonical = replacer.replace(canonical)
+    return canonical_fingerprint(canonical)
+
+
+def profile_fingerprints(
+    profile: List[SandboxRule],
+    replacements: Optional[Dict[str, str]] = None,
+) -> List[bytes]:
+    """
+    Returns the fingerprints of all rules of a profile. If given, the keys of
+    `replacements` are replaced by their values in each rule first.
+    """
+    replacer = Replacer(replacements) if replacements is not None else None
+    return [rule_fingerprint(rule, replacer) for rule in profile]
+
+
+def canonical_profile(profile: List[SandboxRule]) -> str:
+    return json.dumps(profile, sort_keys=True)
+
+
+def profile_fingerprint(profile: List[SandboxRule]) -> bytes:
+    """
+    Returns the fingerprint of a whole profile, i.e. of its rules in order.
+    """
+    return canonical_fingerprint(canonical_profile(profile))
@@ -4,8 +4,12 @@ sandbox proiles.
 """
 import json
 
+from bisect import bisect_right
+from collections import defaultdict
 from typing import Any, Dict, List, Optional, Tuple
 
+from sbprofiles.fingerprint import profile_fingerprints
+
 
 def create_matching(
     base_profile: List[Dict[str, Any]],
@@ -15,6 +19,10 @@ def create_matching(
     """
     Create a matching between two (slightly) different rulesets.
 
+    Each rule of the base profile is matched to the first identical rule of
+    the reduced profile following the previous match. Rules are compared by
+    their fingerprints, see `sbprofiles.fingerprint`.
+
     Precondition: len(base_profile) >= len(reduced_profile)
 
     :param base_profile
@@ -35,33 +43,26 @@ def create_matching(
 
     assert len(base_profile) >= len(reduced_profile)
 
+    # Undo replacements in order to match the correct rule. This is done once
+    # per rule, instead of once per comparison.
+    reduced_idxs: Dict[bytes, List[int]] = defaultdict(list)
+    for reduced_idx, fingerprint in enumerate(profile_fingerprints(reduced_profile, replacements)):
+        reduced_idxs[fingerprint].append(reduced_idx)
+
     matches: Dict[int, int] = {}
     last_matched_idx = -1
 
-    for base_idx, base_rule in enumerate(base_profile):
-        base = json.dumps(base_rule, sort_keys=True)
-
-        if len(reduced_profile) <= last_matched_idx:
-            # Nothing left to match in the reduced profile
-            break
+    for base_idx, fingerprint in enumerate(profile_fingerprints(base_profile)):
+        candidates = reduced_idxs.get(fingerprint)
+        if not candidates:
+            continue
 
         # Since rules are order-preserving, we only need to look forward from
         # the last_matched rule onwards.
-        for reduced_idx, reduced_rule in enumerate(
-            reduced_profile[last_matched_idx + 1:],
-            start=last_matched_idx + 1,
-        ):
-            reduced = json.dumps(reduced_rule, sort_keys=True)
-
-            if replacements is not None:
-                # Undo replacements in order to match the correct rule
-                for key, value in replacements.items():
-                    reduced = reduced.replace(key, value)
-
-            if base == reduced:
-                matches[base_idx] = reduced_idx
-                last_matched_idx = reduced_idx
-                break
+        pos = bisect_right(candidates, last_matched_idx)
+        if pos < len(candidates):
+            matches[base_idx] = candidates[pos]
+            last_matched_idx = candidates[pos]
 
     return matches
 
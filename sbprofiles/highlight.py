@@ -0,0 +1,96 @@
+"""
+Syntax highlighting of SBPL rules for reports, cached by rule.
+
+Reports highlight every rule of a profile with Pygments, although most rules,
+e.g. those of the generic profile, are the same for every result. Highlighted
+rules are cached by the digest of their SBPL, in memory and optionally in a
+directory, usually `HIGHLIGHT_DIR` in the profile store of the results, so
+each distinct rule is highlighted once per corpus rather than once per report.
+
+Digests include the Pygments version, so highlighting is redone if it changes.
+Files are written atomically, so concurrent reports can share a directory.
+"""
+import hashlib
+import os
+
+from collections import OrderedDict
+from typing import Optional
+
+import pygments
+from pygments import highlight
+from pygments.formatters import HtmlFormatter
+from pygments.lexers import SchemeLexer
+
+from sbresults.store import write_atomically
+
+HIGHLIGHT_DIR = 'highlighted'
+DIGEST_SIZE = 16
+
+# Number of highlighted rules cached in memory
+HIGHLIGHTED_RULES = 4096
+
+HIGHLIGHTER = f'pygments-{pygments.__version__}/scheme/html'
+
+lexer = SchemeLexer(stripall=True)
+formatter = HtmlFormatter()
+
+
+def highlight_css() -> str:
+    """
+    Returns the style definitions for highlighted rules.
+    """
+    return formatter.get_style_defs()
+
+
+def highlight_digest(sbpl: str) -> str:
+    key = f'{HIGHLIGHTER}\0{sbpl}'
+    return hashlib.blake2b(key.encode(), digest_size=DIGEST_SIZE).hexdigest()
+
+
+class HighlightCache:
+    """
+    Highlighted rules, cached in memory and, if `path` is given, in files
+    named by their digest below `path`.
+    """
+
+    def __init__(self, path: Optional[str] = None) -> None:
+        self.path = path
+        self.rules: 'OrderedDict[str, str]' = OrderedDict()
+
+    def blob_path(self, digest: str) -> str:
+        assert self.path is not None
+        return os.path.join(self.path, digest[:2], digest)
+
+    def load(self, digest: str) -> Optional[str]:
+        if self.path is None:
+            return None
+        try:
+            with open(self.blob_path(digest), 'rb') as infile:
+                return infile.read().decode()
+        except FileNotFoundError:
+            return None
+
+    def store(self, digest: str, html: str) -> None:
+        if self.path is None:
+            return
+        path = self.blob_path(digest)
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        write_atomically(path, html.encode())
+
+    def highlight(self, sbpl: str) -> str:
+        """
+        Returns the HTML of a rule.
+        """
+        digest = highlight_digest(sbpl)
+        if digest in self.rules:
+            self.rules.move_to_end(digest)
+            return self.rules[digest]
+
+        html = self.load(digest)
+        if html is None:
+            html = highlight(sbpl, lexer, formatter)
+            self.store(digest, html)
+        self.rules[digest] = html
+        if len(self.rules) > HIGHLIGHTED_RULES:
+            self.rules.popitem(last=False)
+        return html
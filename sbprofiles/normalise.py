@@ -12,6 +12,8 @@ from maap.misc.plist import parse_resilient_bytes
 from maap.misc.logger import create_logger
 from maap.extern.tools import call_sbpl
 
+from sbprofiles.replace import Replacer
+
 logger = create_logger('sbprofiles.normalise')
 
 
@@ -101,9 +103,8 @@ def normalise_container_metadata(metadata: dict) -> Tuple[dict, Dict[str, str]]:
 
     # Redirectable paths that are part of the user's home directory. Patch
     # these paths such that the HOME placeholder is used instead.
-    redirectable_paths = [x.replace(home_dir, sandbox_parameters['_HOME'])
-                          for x
-                          in relevant_entries.get(redirectable_paths_key, [])]
+    home_replacer = Replacer({home_dir: sandbox_parameters['_HOME']})
+    redirectable_paths = home_replacer.replace_all(relevant_entries.get(redirectable_paths_key, []))
 
     # Store the modified values back into the dictionary
     relevant_entries[parameters_key] = sandbox_parameters
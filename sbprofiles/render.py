@@ -0,0 +1,95 @@
+"""
+Rendering of sandbox profiles to SBPL, rule by rule.
+
+Profiles are rendered in batches by the `sbpldump` library, in-process by the
+native `_sbpl` module built alongside the matcher, or otherwise by a single
+`sbpldump-batch` process per batch, see `matching-core/sbpl_render.h`. Every
+rule is rendered on its own, so rules are not recovered by splitting the SBPL
+of a whole profile into lines.
+
+Renderings are cached by the fingerprint of their profile, as reports render
+the same generic or normalised profile for many results.
+"""
+import json
+import os
+import subprocess
+import sys
+
+from collections import OrderedDict
+from typing import Dict, List, Sequence
+
+from sbprofiles.fingerprint import SandboxRule, canonical_fingerprint, canonical_profile
+
+PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+HELPER_DIR = os.path.join(PROJECT_DIR, 'matching-core', 'build', 'bin')
+SBPLDUMP_BATCH = os.path.join(HELPER_DIR, 'sbpldump-batch')
+
+sys.path.insert(0, HELPER_DIR)
+try:
+    import _sbpl
+except ImportError:
+    _sbpl = None
+finally:
+    sys.path.remove(HELPER_DIR)
+
+# Number of rendered profiles cached per process
+RENDERED_PROFILES = 256
+
+# SBPL of a profile's rules, starting with the version statement
+RuleSBPL = List[str]
+
+rendered_profiles: 'OrderedDict[bytes, RuleSBPL]' = OrderedDict()
+
+
+def render_canonical(profiles: List[str]) -> List[RuleSBPL]:
+    """
+    Renders profiles given as JSON, all at once.
+    """
+    if not profiles:
+        return []
+    if _sbpl is not None:
+        return _sbpl.render(profiles)
+    rendering = subprocess.run(
+        [SBPLDUMP_BATCH],
+        check=True,
+        capture_output=True,
+        input=''.join(profile + '\n' for profile in profiles),
+        text=True,
+    )
+    rendered = [json.loads(line) for line in rendering.stdout.splitlines()]
+    if len(rendered) != len(profiles):
+        raise ValueError(f"Rendered {len(rendered)} of {len(profiles)} profiles")
+    return rendered
+
+
+def render_profiles(profiles: Sequence[List[SandboxRule]]) -> List[RuleSBPL]:
+    """
+    Returns the SBPL of the rules of every profile. Profiles not cached are
+    rendered in a single batch. The returned lists must not be modified.
+    """
+    # Renderings are held here, as a batch may exceed the cache.
+    results: Dict[bytes, RuleSBPL] = dict()
+    missing: Dict[bytes, str] = dict()
+    fingerprints: List[bytes] = []
+    for profile in profiles:
+        text = canonical_profile(profile)
+        fingerprint = canonical_fingerprint(text)
+        fingerprints.append(fingerprint)
+        if fingerprint in results or fingerprint in missing:
+            continue
+        if fingerprint in rendered_profiles:
+            rendered_profiles.move_to_end(fingerprint)
+            results[fingerprint] = rendered_profiles[fingerprint]
+        else:
+            missing[fingerprint] = text
+
+    for fingerprint, rules in zip(missing, render_canonical(list(missing.values()))):
+        results[fingerprint] = rules
+        rendered_profiles[fingerprint] = rules
+        if len(rendered_profiles) > RENDERED_PROFILES:
+            rendered_profiles.popitem(last=False)
+    return [results[fingerprint] for fingerprint in fingerprints]
+
+
+def render_profile(profile: List[SandboxRule]) -> RuleSBPL:
+    return render_profiles([profile])[0]
@@ -0,0 +1,63 @@
+"""
+Single-pass replacement of normalisation placeholders.
+
+Normalisation replaces concrete values such as the home directory or the
+bundle ID of an app by placeholders such as `/$_HOME$`, and results are
+mapped back by undoing these replacements. `Replacer` replaces all patterns
+in a single pass over the text, choosing leftmost-longest matches, so that
+e.g. the home directory takes precedence over the user name it contains.
+
+The native `_replacer` module built alongside the matcher uses an
+Aho-Corasick automaton, see `matching-core/replacer.h`. Without it, an
+equivalent regular expression is used: alternatives sorted by decreasing
+length make Python's leftmost-first matching leftmost-longest.
+"""
+import os
+import re
+import sys
+
+from typing import Dict, List, Optional
+
+PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+HELPER_DIR = os.path.join(PROJECT_DIR, 'matching-core', 'build', 'bin')
+
+sys.path.insert(0, HELPER_DIR)
+try:
+    import _replacer
+except ImportError:
+    _replacer = None
+finally:
+    sys.path.remove(HELPER_DIR)
+
+
+class Replacer:
+    """
+    Replaces the keys of `patterns` by their values. Empty keys are ignored.
+    """
+
+    def __init__(self, patterns: Dict[str, str]) -> None:
+        self.patterns = {key: value for key, value in patterns.items() if key}
+        self.native = None
+        self.regex = None
+        if _replacer is not None:
+            self.native = _replacer.Replacer(list(self.patterns.items()))
+        elif self.patterns:
+            self.regex = re.compile('|'.join(
+                re.escape(key) for key in sorted(self.patterns, key=len, reverse=True)
+            ))
+
+    def replace(self, text: str) -> str:
+        if self.native is not None:
+            return self.native.replace(text)
+        if self.regex is None:
+            return text
+        return self.regex.sub(lambda m: self.patterns[m.group()], text)
+
+    def replace_all(self, texts: List[Optional[str]]) -> List[Optional[str]]:
+        """
+        Replaces patterns in many texts, e.g. the arguments of log entries.
+        None is passed through.
+        """
+        if self.native is not None:
+            return self.native.replace_all(texts)
+        return [None if text is None else self.replace(text) for text in texts]
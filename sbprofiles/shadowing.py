@@ -0,0 +1,271 @@
+"""
+Static detection of shadowed rules.
+
+Under last-match semantics, a rule whose matches are all matched by later
+rules for the same operations can never decide. Such rules are common in app
+profiles, e.g. a `literal` path followed by a `subpath` containing it. This
+module proves shadowing for rules with literal, prefix, subpath and regex
+filters and their name filter counterparts. Regular expressions are compared
+using automata, see `sbprofiles.automata`. Everything else is conservatively
+assumed not to be shadowed.
+
+`default` rules are not analysed. Rules for specific operations take
+precedence over them regardless of their order, as modelled by
+`sblogs.evaluate.precedence_order`, so they neither shadow nor are shadowed by
+rules for specific operations.
+"""
+import re
+
+from typing import Any, Dict, List, Optional, Tuple
+
+from sblogs.evaluate import NAME_FILTERS, is_default_rule, string_argument
+from sbprofiles.automata import anchored_prefix, escape, includes, regex_matches
+
+SandboxRule = Dict[str, Any]
+SandboxProfile = List[SandboxRule]
+
+# A filter as (domain, kind, value). The domain is `path` for path filters and
+# the base name for name filters, e.g. `global-name`. The kind is one of
+# `literal`, `prefix`, `subpath` or `regex`.
+Filter = Tuple[str, str, str]
+
+REGEX_META = set('.^$*+?()[]{}|\\')
+
+# Regular expression suffixes matching the end of a path or a path component
+SUBPATH_SUFFIXES = {'(/|$)', '($|/)', '(/.*)?$'}
+
+
+def literal_prefix(pattern: str) -> Tuple[str, str]:
+    """
+    Splits an anchored regular expression into the literal text it starts with
+    and the remaining pattern. Escaped meta characters are part of the text.
+    """
+    assert pattern.startswith('^')
+    text = []
+    i = 1
+    while i < len(pattern):
+        c = pattern[i]
+        if c == '\\' and i + 1 < len(pattern) and pattern[i + 1] in REGEX_META:
+            text.append(pattern[i + 1])
+            i += 2
+        elif c in REGEX_META:
+            break
+        else:
+            text.append(c)
+            i += 1
+    return ''.join(text), pattern[i:]
+
+
+def is_simple_regex(pattern: str) -> bool:
+    """
+    Returns whether a regular expression means the same to Python as to the
+    sandbox, which uses POSIX extended regular expressions.
+    """
+    return '[[:' not in pattern and re.search(r'\\[0-9A-Za-z]', pattern) is None
+
+
+def simplify_regex(domain: str, pattern: str) -> Filter:
+    """
+    Expresses anchored regular expressions amounting to a literal, prefix or
+    subpath filter as such.
+    """
+    if pattern.startswith('^') and is_simple_regex(pattern):
+        text, rest = literal_prefix(pattern)
+        if rest == '':
+            return domain, 'prefix', text
+        if rest == '$':
+            return domain, 'literal', text
+        if rest in SUBPATH_SUFFIXES and domain == 'path' and not text.endswith('/'):
+            return domain, 'subpath', text
+    return domain, 'regex', pattern
+
+
+def parse_filter(sb_filter: dict) -> Optional[Filter]:
+    """
+    Returns the representation of a single filter, or None if shadowing of or
+    by this filter cannot be decided.
+    """
+    name: str = sb_filter['name']
+    value = string_argument(sb_filter)
+    if value is None:
+        return None
+
+    if name in ('path', 'literal'):
+        return 'path', 'literal', value
+    if name == 'subpath':
+        return 'path', 'subpath', value
+    if name == 'path-prefix':
+        return 'path', 'prefix', value
+    if name == 'path-regex':
+        return simplify_regex('path', value)
+
+    base_name = re.sub(r'-(prefix|regex)$', '', name)
+    if base_name not in NAME_FILTERS:
+        return None
+    if name.endswith('-prefix'):
+        return base_name, 'prefix', value
+    if name.endswith('-regex'):
+        return simplify_regex(base_name, value)
+    return base_name, 'literal', value
+
+
+def in_subpath(path: str, subpath: str) -> bool:
+    return path == subpath or path.startswith(subpath.rstrip('/') + '/')
+
+
+def filter_regex(sb_filter: Filter) -> str:
+    """
+    Returns a regular expression matching the same as a filter.
+    """
+    _, kind, value = sb_filter
+    if kind == 'regex':
+        return value
+    if kind == 'literal':
+        return '^' + escape(value) + '$'
+    if kind == 'prefix':
+        return '^' + escape(value)
+    return '^' + escape(value.rstrip('/')) + '(/|$)'
+
+
+def filter_covers(outer: Filter, inner: Filter) -> bool:
+    """
+    Returns whether everything `inner` matches is also matched by `outer`.
+    """
+    outer_domain, outer_kind, outer_value = outer
+    inner_domain, inner_kind, inner_value = inner
+    if outer_domain != inner_domain:
+        return False
+
+    if outer_kind == 'regex' and inner_kind == 'literal':
+        return regex_matches(outer_value, inner_value) is True
+    if 'regex' in (outer_kind, inner_kind):
+        # Strings starting with different text are never matched by both,
+        # which rules out most pairs without constructing automata.
+        outer_prefix = anchored_prefix(filter_regex(outer))
+        inner_prefix = anchored_prefix(filter_regex(inner))
+        if outer_prefix is not None and inner_prefix is not None and not (
+            outer_prefix.startswith(inner_prefix) or inner_prefix.startswith(outer_prefix)
+        ):
+            return False
+        return includes(filter_regex(outer), filter_regex(inner)) is True
+
+    if inner_kind == 'literal':
+        if outer_kind == 'literal':
+            return inner_value == outer_value
+        if outer_kind == 'prefix':
+            return inner_value.startswith(outer_value)
+        return in_subpath(inner_value, outer_value)
+
+    # Both prefix and subpath filters match everything starting with their
+    # value, followed by a slash in case of subpaths.
+    if outer_kind == 'prefix':
+        return inner_value.startswith(outer_value)
+    if outer_kind == 'subpath':
+        return in_subpath(inner_value, outer_value) and (
+            inner_kind == 'subpath' or inner_value.startswith(outer_value.rstrip('/') + '/')
+        )
+    return False
+
+
+def covering_filters(rule: SandboxRule) -> Optional[List[Filter]]:
+    """
+    Returns the filters a rule matches, any of which suffices, or None if the
+    rule matches everything for its operations. Filters that cannot be
+    decided are left out, which only makes the rule cover less.
+    """
+    if not rule.get('filters'):
+        return None
+
+    filters = []
+    pending = list(rule['filters'])
+    while pending:
+        sb_filter = pending.pop()
+        if sb_filter['name'] == 'require-any':
+            pending.extend(sb_filter['subfilters'])
+        else:
+            parsed = parse_filter(sb_filter)
+            if parsed is not None:
+                filters.append(parsed)
+    return filters
+
+
+def covered_filters(rule: SandboxRule) -> List[Optional[List[Filter]]]:
+    """
+    Splits what a rule matches into parts that have to be covered separately.
+    Each part is given by filters, covering any of which covers the part, or
+    None if the part can only be covered by a rule without filters.
+    """
+    if not rule.get('filters'):
+        return [None]
+
+    parts: List[Optional[List[Filter]]] = []
+    pending = list(rule['filters'])
+    while pending:
+        sb_filter = pending.pop()
+        if sb_filter['name'] == 'require-any':
+            pending.extend(sb_filter['subfilters'])
+        elif sb_filter['name'] == 'require-all':
+            # A conjunction is covered if any of its terms is.
+            terms = [parse_filter(term) for term in sb_filter['subfilters']]
+            terms = [term for term in terms if term is not None]
+            parts.append(terms or None)
+        else:
+            parsed = parse_filter(sb_filter)
+            parts.append(None if parsed is None else [parsed])
+    return parts
+
+
+def operation_covers(outer: str, inner: str) -> bool:
+    if outer.endswith('*'):
+        return inner.rstrip('*').startswith(outer.rstrip('*'))
+    return outer == inner
+
+
+def find_shadowed_rules(profile: SandboxProfile) -> Dict[int, List[int]]:
+    """
+    Returns the rules of the profile that can never decide, each mapped to the
+    later rules shadowing it.
+    """
+    # Later rules by operation, as (rule index, covering filters)
+    covering: List[Tuple[str, int, Optional[List[Filter]]]] = []
+    shadowed: Dict[int, List[int]] = dict()
+
+    for rule_idx in reversed(range(len(profile))):
+        rule = profile[rule_idx]
+        operations: List[str] = rule['operations']
+        if is_default_rule(rule):
+            continue
+
+        shadowing = set()
+        is_shadowed = True
+        for operation in operations:
+            for part in covered_filters(rule):
+                shadowing_idx = next(
+                    (
+                        idx
+                        for outer_operation, idx, outer_filters in covering
+                        if operation_covers(outer_operation, operation) and (
+                            outer_filters is None or (part is not None and any(
+                                filter_covers(outer, inner)
+                                for outer in outer_filters
+                                for inner in part
+                            ))
+                        )
+                    ),
+                    None,
+                )
+                if shadowing_idx is None:
+                    is_shadowed = False
+                    break
+                shadowing.add(shadowing_idx)
+            if not is_shadowed:
+                break
+
+        if is_shadowed:
+            shadowed[rule_idx] = sorted(shadowing)
+
+        filters = covering_filters(rule)
+        # Later rules come first, so the closest shadowing rule is found.
+        covering[:0] = [(operation, rule_idx, filters) for operation in operations]
+
+    return dict(sorted(shadowed.items()))
@@ -0,0 +1,668 @@
+"""
+Compact results containers.
+
+`dump_state` writes results as indented JSON, including raw logs, compiled
+profiles as base64 and several full profiles, so result files of a single app
+run to tens of MB. A results container stores the same state in sections,
+each compressed on its own:
+
+  - log entries, raw and processed, as columns of dictionary-coded values,
+  - mappings from rules to log entries as delta-coded integer arrays,
+  - profiles by content hash, so identical profiles are stored once, or
+    only referenced if they are in a profile store shared by many results,
+  - base64 strings such as the container metadata decoded,
+  - everything else as compact JSON.
+
+A directory at the start of the file lists the sections and which part of the
+state each of them holds, so readers decode only the sections they access, see
+`ContainerState`. Containers are converted to JSON identical to the output of
+`dump_state`, and JSON results to containers, by
+`python3 -m sbresults.container`.
+
+Layout, all integers little-endian:
+  char     magic[4] = "SBRC"
+  uint32_t version
+  uint32_t sections
+  uint32_t values
+  uint32_t checksum     CRC-32 of the directory
+followed by the directory:
+  struct { uint8_t encoding, compression; uint16_t name_size; uint32_t checksum;
+           uint64_t offset, size, raw_size; char name[name_size]; } sections[]
+  struct { uint16_t path_size; uint32_t section; char path[path_size]; } values[]
+and the sections. Values are parts of the state identified by their keys
+joined by '/', the state itself, without the other values, has the empty path.
+Sections in the profile store are empty and named by their digest.
+"""
+import argparse
+import base64
+import binascii
+import copy
+import json
+import mmap
+import os
+import struct
+import sys
+import zlib
+
+from collections.abc import Mapping
+from typing import Any, Dict, Iterator, List, Optional, Tuple
+
+from sblogs.matrix import decode_varints, encode_varint
+from sbresults.store import (
+    PROFILE_STORE_NAME, ProfileStore, find_profile_store, open_profile_store, profile_digest, shared_profile,
+)
+
+MAGIC = b'SBRC'
+VERSION = 1
+HEADER = struct.Struct('<4sIIII')
+SECTION = struct.Struct('<BBHIQQQ')
+VALUE = struct.Struct('<HI')
+
+# Section encodings
+JSON = 0
+COLUMNS = 1
+INDICES = 2
+INTEGERS = 3
+BASE64 = 4
+
+# Section compression
+UNCOMPRESSED = 0
+ZLIB = 1
+STORED = 2  # in the profile store, see `sbresults/store.py`
+
+# Parts of the state stored in sections of their own, with their preferred
+# encoding. Values the encoding does not apply to are stored as JSON.
+# Profiles, below `sandbox_profiles`, are stored by content hash.
+EXTRACTED_VALUES = [
+    (('container_metadata',), BASE64),
+    (('logs', 'raw'), COLUMNS),
+    (('logs', 'processed'), COLUMNS),
+    (('match_results', 'rule_deciding_for_log_entries'), INDICES),
+    (('match_results', 'rule_redundant_for_log_entries'), INDICES),
+    (('match_results', 'unmatched_log_entries'), INTEGERS),
+    (('generic_match_results', 'rule_deciding_for_log_entries'), INDICES),
+    (('generic_match_results', 'rule_redundant_for_log_entries'), INDICES),
+    (('generic_match_results', 'unmatched_log_entries'), INTEGERS),
+]
+
+# Result file names by output format
+RESULT_NAMES = {
+    'json': 'sandbox_coverage.json',
+    'container': 'sandbox_coverage.sbrc',
+}
+OUTPUT_FORMATS = list(RESULT_NAMES)
+
+Path = Tuple[str, ...]
+
+
+def serialise(value: Any) -> Any:
+    """
+    Serialise byte strings. First try decoding them as JSON, if that does not work out
+    encode the byte string as base64.
+    This function traverses lists and dicts, modifying their items as required.
+    """
+    if isinstance(value, dict):
+        return {serialise(k): serialise(v) for (k, v) in value.items()}
+    elif isinstance(value, list):
+        return [serialise(x) for x in value]
+    elif isinstance(value, bytes):
+        # Try decoding as JSON
+        try:
+            return serialise(json.loads(value))
+        except (json.JSONDecodeError, UnicodeError):
+            pass
+
+        # Not valid JSON: Fall back to base64
+        return base64.encodebytes(value).decode()
+    else:
+        return value
+
+
+def restore_state(state: dict) -> dict:
+    """
+    Restores the values later stages expect as byte or JSON strings in a
+    serialised state. Only values needed to repeat the analysis are restored.
+    """
+    if isinstance(state.get('container_metadata'), str):
+        state['container_metadata'] = base64.decodebytes(state['container_metadata'].encode())
+
+    profiles = state.get('sandbox_profiles', {})
+    if 'original' in profiles and not isinstance(profiles['original'], str):
+        profiles['original'] = json.dumps(profiles['original'])
+
+    return state
+
+
+def json_key(key: Any) -> str:
+    """
+    Converts a key as `json.dump` does.
+    """
+    if isinstance(key, str):
+        return key
+    elif key is True:
+        return 'true'
+    elif key is False:
+        return 'false'
+    elif key is None:
+        return 'null'
+    elif isinstance(key, float):
+        return float.__repr__(key)
+    return str(key)
+
+
+def ordered(value: Any) -> Any:
+    """
+    Orders the keys of all objects as `dump_state` writes them and converts
+    them to strings, so sections preserve the order of keys.
+    """
+    if isinstance(value, dict):
+        return {json_key(k): ordered(v) for k, v in sorted(value.items(), key=lambda item: item[0])}
+    elif isinstance(value, (list, tuple)):
+        return [ordered(x) for x in value]
+    return value
+
+
+def encode_json(value: Any) -> bytes:
+    return json.dumps(value, separators=(',', ':')).encode()
+
+
+def zigzag(value: int) -> int:
+    return 2 * value if value >= 0 else -2 * value - 1
+
+
+def unzigzag(value: int) -> int:
+    return value >> 1 if value & 1 == 0 else -((value + 1) >> 1)
+
+
+def is_integer(value: Any) -> bool:
+    return isinstance(value, int) and not isinstance(value, bool)
+
+
+def encode_integers(values: List[int], out: bytearray) -> None:
+    """
+    Appends the count and the zigzag-coded deltas of `values`, so ascending
+    values take a byte each if they are close.
+    """
+    encode_varint(len(values), out)
+    last = 0
+    for value in values:
+        encode_varint(zigzag(value - last), out)
+        last = value
+
+
+def decode_integers(varints: Iterator[int]) -> List[int]:
+    values = []
+    last = 0
+    for _ in range(next(varints)):
+        last += unzigzag(next(varints))
+        values.append(last)
+    return values
+
+
+def encode_columns(entries: Any) -> Optional[bytes]:
+    """
+    Encodes a list of objects, such as log entries, column by column. Each
+    column is a dictionary of its distinct values and a code per entry, 0 if
+    the entry lacks the key. Returns None if `entries` are not all objects.
+    """
+    if not isinstance(entries, list) or not all(isinstance(entry, dict) for entry in entries):
+        return None
+    names = set()
+    for entry in entries:
+        names.update(entry)
+    if not all(isinstance(name, str) for name in names):
+        return None
+
+    columns = []
+    codes = bytearray()
+    # Keys of decoded entries are sorted, as written by `dump_state`.
+    for name in sorted(names):
+        index: Dict[Any, int] = dict()
+        values = []
+        begin = len(codes)
+        for entry in entries:
+            if name not in entry:
+                codes.append(0)
+                continue
+            value = entry[name]
+            key = value if type(value) is str else (encode_json(value),)
+            code = index.get(key)
+            if code is None:
+                values.append(value)
+                code = index[key] = len(values)
+            encode_varint(code, codes)
+        columns.append([name, values, len(codes) - begin])
+
+    header = encode_json({'count': len(entries), 'columns': columns})
+    return struct.pack('<I', len(header)) + header + bytes(codes)
+
+
+def decode_columns(data: bytes) -> List[dict]:
+    header_size, = struct.unpack_from('<I', data)
+    header = json.loads(bytes(data[4:4 + header_size]))
+    entries: List[dict] = [dict() for _ in range(header['count'])]
+    start = 4 + header_size
+    for name, values, size in header['columns']:
+        # Containers are copied, so entries can be modified independently.
+        shared = any(isinstance(value, (dict, list)) for value in values)
+        for entry, code in zip(entries, decode_varints(data, start, start + size)):
+            if code:
+                value = values[code - 1]
+                entry[name] = copy.deepcopy(value) if shared else value
+        start += size
+    return entries
+
+
+def encode_indices(mapping: Any) -> Optional[bytes]:
+    """
+    Encodes a mapping from rule indices to lists of log indices, such as
+    `rule_deciding_for_log_entries`. Returns None for other values.
+    """
+    if not isinstance(mapping, dict):
+        return None
+    for key, values in mapping.items():
+        if not (key.isascii() and key.isdigit()) or str(int(key)) != key:
+            return None
+        if not isinstance(values, list) or not all(is_integer(value) for value in values):
+            return None
+
+    out = bytearray()
+    encode_integers([int(key) for key in mapping], out)
+    for values in mapping.values():
+        encode_integers(values, out)
+    return bytes(out)
+
+
+def decode_indices(data: bytes) -> Dict[str, List[int]]:
+    varints = decode_varints(data, 0, len(data))
+    keys = decode_integers(varints)
+    return {str(key): decode_integers(varints) for key in keys}
+
+
+def encode_value(value: Any, encoding: int) -> Tuple[int, bytes]:
+    """
+    Encodes a value using `encoding` if it applies, as JSON otherwise.
+    """
+    encoded = None
+    if encoding == COLUMNS:
+        encoded = encode_columns(value)
+    elif encoding == INDICES:
+        encoded = encode_indices(value)
+    elif encoding == INTEGERS:
+        if isinstance(value, list) and all(is_integer(x) for x in value):
+            out = bytearray()
+            encode_integers(value, out)
+            encoded = bytes(out)
+    elif encoding == BASE64 and isinstance(value, str):
+        try:
+            decoded = base64.decodebytes(value.encode())
+        except (binascii.Error, UnicodeError):
+            decoded = None
+        # Only if encoding again yields the same string
+        if decoded is not None and base64.encodebytes(decoded).decode() == value:
+            encoded = decoded
+
+    if encoded is None:
+        return JSON, encode_json(value)
+    return encoding, encoded
+
+
+def decode_value(encoding: int, data: bytes) -> Any:
+    if encoding == JSON:
+        return json.loads(bytes(data))
+    elif encoding == COLUMNS:
+        return decode_columns(data)
+    elif encoding == INDICES:
+        return decode_indices(data)
+    elif encoding == INTEGERS:
+        return decode_integers(decode_varints(data, 0, len(data)))
+    elif encoding == BASE64:
+        return base64.encodebytes(bytes(data)).decode()
+    raise ValueError(f"Unknown section encoding {encoding}")
+
+
+def split_state(state: dict) -> Tuple[dict, List[Tuple[Path, str, int, Any]]]:
+    """
+    Removes the values stored in sections of their own from a serialised
+    state. Returns the remaining state and the values with their section
+    names and preferred encodings. Dictionaries on the way to removed values
+    are copied, `state` is not modified.
+    """
+    state = dict(state)
+    values = []
+
+    def take(path: Path) -> Tuple[bool, Any]:
+        parent = state
+        for key in path[:-1]:
+            child = parent.get(key)
+            if not isinstance(child, dict):
+                return False, None
+            parent[key] = child = dict(child)
+            parent = child
+        if path[-1] not in parent:
+            return False, None
+        return True, parent.pop(path[-1])
+
+    for path, encoding in EXTRACTED_VALUES:
+        found, value = take(path)
+        if found:
+            values.append((path, '/'.join(path), encoding, value))
+
+    profiles = state.get('sandbox_profiles')
+    if isinstance(profiles, dict):
+        for key in [key for key in profiles if isinstance(key, str) and '/' not in key]:
+            _, value = take(('sandbox_profiles', key))
+            values.append((('sandbox_profiles', key), None, BASE64, value))
+
+    return state, values
+
+
+def write_container(state: dict, fp, store: Optional[ProfileStore] = None) -> None:
+    """
+    Writes a state as a results container to a binary file. If given,
+    profiles are added to `store` and only referenced by the container.
+    """
+    write_serialised(ordered(serialise(state)), fp, store)
+
+
+def write_serialised(state: dict, fp, store: Optional[ProfileStore] = None) -> None:
+    """
+    Writes a serialised state, e.g. loaded from the output of `dump_state`,
+    as a results container. Keys keep their order.
+    """
+    state, extracted = split_state(state)
+
+    sections: List[Tuple[str, int, int, bytes, int]] = []
+    section_ids: Dict[str, int] = dict()
+    value_sections: List[Tuple[str, int]] = []
+
+    def add_section(name: Optional[str], encoding: int, value: Any) -> int:
+        encoding, raw = encode_value(value, encoding)
+        if name is None:
+            # Profiles by content hash
+            name = f'profiles/{profile_digest(encoding, raw)}'
+            if store is not None and name not in section_ids:
+                store.put(encoding, raw)
+                section_ids[name] = len(sections)
+                sections.append((name, encoding, STORED, b'', len(raw)))
+        if name not in section_ids:
+            data, compression = zlib.compress(raw), ZLIB
+            if len(data) >= len(raw):
+                # E.g. compiled profiles
+                data, compression = raw, UNCOMPRESSED
+            section_ids[name] = len(sections)
+            sections.append((name, encoding, compression, data, len(raw)))
+        return section_ids[name]
+
+    value_sections.append(('', add_section('state', JSON, state)))
+    for path, name, encoding, value in extracted:
+        value_sections.append(('/'.join(path), add_section(name, encoding, value)))
+
+    directory = bytearray()
+    offset = HEADER.size + sum(SECTION.size + len(name.encode()) for name, _, _, _, _ in sections) \
+        + sum(VALUE.size + len(path.encode()) for path, _ in value_sections)
+    for name, encoding, compression, data, raw_size in sections:
+        name_bytes = name.encode()
+        directory += SECTION.pack(encoding, compression, len(name_bytes), zlib.crc32(data), offset, len(data), raw_size)
+        directory += name_bytes
+        offset += len(data)
+    for path, section in value_sections:
+        path_bytes = path.encode()
+        directory += VALUE.pack(len(path_bytes), section)
+        directory += path_bytes
+
+    fp.write(HEADER.pack(MAGIC, VERSION, len(sections), len(value_sections), zlib.crc32(directory)))
+    fp.write(directory)
+    for _, _, _, data, _ in sections:
+        fp.write(data)
+
+
+class SectionInfo:
+
+    def __init__(self, name: str, encoding: int, compression: int, checksum: int, offset: int, size: int, raw_size: int) -> None:
+        self.name = name
+        self.encoding = encoding
+        self.compression = compression
+        self.checksum = checksum
+        self.offset = offset
+        self.size = size
+        self.raw_size = raw_size
+
+
+class ResultsContainer:
+    """
+    A results container. Only the directory is read when opening it, sections
+    are read and decoded when accessed. Profiles referenced by the container
+    are read from `store`.
+    """
+
+    def __init__(self, data, store: Optional[ProfileStore] = None) -> None:
+        if len(data) < HEADER.size:
+            raise ValueError("Not a results container")
+        magic, version, section_count, value_count, checksum = HEADER.unpack_from(data)
+        if magic != MAGIC:
+            raise ValueError("Not a results container")
+        if version != VERSION:
+            raise ValueError(f"Unsupported results container version {version}")
+        self.data = data
+        self.store = store
+
+        self.sections: List[SectionInfo] = []
+        pos = HEADER.size
+        for _ in range(section_count):
+            encoding, compression, name_size, section_checksum, offset, size, raw_size = self.unpack(SECTION, pos)
+            pos += SECTION.size
+            name = bytes(self.read(pos, name_size)).decode()
+            pos += name_size
+            if offset + size > len(data):
+                raise ValueError(f"Section {name} out of bounds")
+            self.sections.append(SectionInfo(name, encoding, compression, section_checksum, offset, size, raw_size))
+
+        # Paths of values mapped to their sections
+        self.values: Dict[Path, int] = dict()
+        for _ in range(value_count):
+            path_size, section = self.unpack(VALUE, pos)
+            pos += VALUE.size
+            path = bytes(self.read(pos, path_size)).decode()
+            pos += path_size
+            if section >= section_count:
+                raise ValueError(f"Value {path} refers to a missing section")
+            self.values[tuple(path.split('/')) if path else ()] = section
+
+        if zlib.crc32(self.read(HEADER.size, pos - HEADER.size)) != checksum:
+            raise ValueError("Results container checksum mismatch")
+        if () not in self.values:
+            raise ValueError("Results container without state")
+
+    def read(self, offset: int, size: int) -> memoryview:
+        if offset + size > len(self.data):
+            raise ValueError("Truncated results container")
+        return memoryview(self.data)[offset:offset + size]
+
+    def unpack(self, record: struct.Struct, offset: int) -> tuple:
+        return record.unpack(self.read(offset, record.size))
+
+    def decode(self, section: int) -> Any:
+        """
+        Reads and decodes a section.
+        """
+        info = self.sections[section]
+        if info.compression == STORED:
+            if self.store is None:
+                raise ValueError(f"Section {info.name} is in a profile store, which was not found")
+            encoding, data = self.store.get(info.name.split('/')[-1])
+            if encoding != info.encoding:
+                raise ValueError(f"Inconsistent encoding of section {info.name}")
+        else:
+            data = self.read(info.offset, info.size)
+            if zlib.crc32(data) != info.checksum:
+                raise ValueError(f"Checksum mismatch of section {info.name}")
+        if info.compression == ZLIB:
+            data = zlib.decompress(data)
+        elif info.compression not in (UNCOMPRESSED, STORED):
+            raise ValueError(f"Unknown compression of section {info.name}")
+        if len(data) != info.raw_size:
+            raise ValueError(f"Inconsistent size of section {info.name}")
+        return decode_value(info.encoding, data)
+
+    def state(self) -> 'ContainerState':
+        """
+        Returns a read-only view of the state decoding sections on access.
+        """
+        return ContainerState(self, ())
+
+    def load(self) -> dict:
+        """
+        Decodes the whole state, as `json.load` of the output of `dump_state`.
+        """
+        state = self.decode(self.values[()])
+        for path, section in sorted(self.values.items()):
+            if not path:
+                continue
+            parent = state
+            for key in path[:-1]:
+                parent = parent.setdefault(key, dict())
+            parent[path[-1]] = self.decode(section)
+
+        # Only dictionaries on the way to values need sorting, the others are
+        # decoded from sorted JSON.
+        def sort_parents(value: dict, depth: int) -> dict:
+            if depth == 0:
+                return value
+            return {
+                key: sort_parents(child, depth - 1) if isinstance(child, dict) else child
+                for key, child in sorted(value.items())
+            }
+
+        return sort_parents(state, max(len(path) for path in self.values))
+
+    def export_json(self, fp) -> None:
+        """
+        Writes the state as JSON, identical to the output of `dump_state`.
+        """
+        json.dump(self.load(), fp, indent=4)
+
+    @classmethod
+    def load_file(cls, path: str, store: Optional[ProfileStore] = None) -> 'ResultsContainer':
+        """
+        Maps a container, so only accessed sections are read. Unless given,
+        the profile store is searched for in the parent directories.
+        """
+        if store is None:
+            store = find_profile_store(os.path.dirname(os.path.abspath(path)))
+        with open(path, 'rb') as infile:
+            return cls(mmap.mmap(infile.fileno(), 0, access=mmap.ACCESS_READ), store)
+
+
+class ContainerState(Mapping):
+    """
+    A read-only view of a part of the state in a results container. Sections
+    are decoded when first accessed, so e.g. reports not showing log entries
+    never decode them. Profiles are shared by all views in this process, so
+    e.g. the generic profile is parsed once for all results.
+    """
+
+    def __init__(self, container: ResultsContainer, path: Path, skeleton: Optional[dict] = None) -> None:
+        self.container = container
+        self.path = path
+        if skeleton is None:
+            skeleton = container.decode(container.values[()])
+        self.skeleton = skeleton
+        # Keys of values stored in sections, and of views of nested values
+        self.sections: Dict[str, int] = dict()
+        self.nested = set()
+        for value_path, section in container.values.items():
+            if len(value_path) <= len(path) or value_path[:len(path)] != path:
+                continue
+            key = value_path[len(path)]
+            if len(value_path) == len(path) + 1:
+                self.sections[key] = section
+            else:
+                self.nested.add(key)
+        self.cache: Dict[str, Any] = dict()
+
+    def __getitem__(self, key: str) -> Any:
+        if key in self.cache:
+            return self.cache[key]
+        if key in self.sections:
+            section = self.sections[key]
+            name = self.container.sections[section].name
+            if name.startswith('profiles/'):
+                value = shared_profile(name.split('/')[-1], lambda: self.container.decode(section))
+            else:
+                value = self.container.decode(section)
+        elif key in self.nested:
+            value = ContainerState(self.container, self.path + (key,), self.skeleton.get(key, dict()))
+        else:
+            return self.skeleton[key]
+        self.cache[key] = value
+        return value
+
+    def __contains__(self, key: object) -> bool:
+        return key in self.skeleton or key in self.sections or key in self.nested
+
+    def __iter__(self) -> Iterator[str]:
+        return iter(sorted(set(self.skeleton) | set(self.sections) | self.nested))
+
+    def __len__(self) -> int:
+        return len(set(self.skeleton) | set(self.sections) | self.nested)
+
+
+def load_results(path: str, lazy: bool = True) -> Any:
+    """
+    Loads results written by `dump_state` or `write_container`. Containers
+    are returned as `ContainerState` views unless `lazy` is False.
+    """
+    with open(path, 'rb') as infile:
+        magic = infile.read(len(MAGIC))
+        if magic != MAGIC:
+            infile.seek(0)
+            return json.load(infile)
+    container = ResultsContainer.load_file(path)
+    return container.state() if lazy else container.load()
+
+
+def find_results(results_dir: str) -> Iterator[str]:
+    """
+    Yields the paths of the results below `results_dir`, one per directory.
+    Containers are preferred over JSON if both exist.
+    """
+    for root, dirs, files in os.walk(results_dir):
+        dirs[:] = sorted(d for d in dirs if d != PROFILE_STORE_NAME)
+        for fn in reversed(list(RESULT_NAMES.values())):
+            if fn in files:
+                yield os.path.join(root, fn)
+                break
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description='Convert results between JSON and results containers')
+    parser.add_argument('--export', action='store_true', help='Convert a container to JSON.')
+    parser.add_argument('--profile-store', default=None,
+                        help=f'Only reference profiles, stored in this directory, usually {PROFILE_STORE_NAME} at the root of the results.')
+    parser.add_argument('input', help='Results as written by dump_state, or a container with --export.')
+    parser.add_argument('output', help='Path the container or JSON results are written to.')
+    args = parser.parse_args()
+
+    if args.export:
+        with open(args.output, 'w') as outfile:
+            ResultsContainer.load_file(args.input).export_json(outfile)
+        return
+
+    store = None if args.profile_store is None else open_profile_store(args.profile_store)
+    with open(args.input) as infile:
+        state = json.load(infile)
+    with open(args.output, 'wb') as outfile:
+        write_serialised(state, outfile, store)
+
+    container = ResultsContainer.load_file(args.output, store)
+    for info in container.sections:
+        if info.compression == STORED:
+            print(f"{info.name}: {info.raw_size} bytes, in the profile store", file=sys.stderr)
+        else:
+            print(f"{info.name}: {info.raw_size} bytes, {info.size} compressed", file=sys.stderr)
+    print(f"{args.output}: {os.path.getsize(args.output)} bytes", file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,139 @@
+"""
+Content-addressed profile store shared by results containers.
+
+Every result embeds the generic profile and very similar normalised profiles.
+Containers written with a profile store hold only references to their
+profiles, which are stored once per corpus, named by the digest of their
+encoding, see `sbresults/container.py`. The store is a directory named
+`PROFILE_STORE_NAME` at the root of the results, where readers find it by
+searching the parent directories of a container.
+
+Blobs are written atomically and verified against their digest when read, so
+worker processes can add the same profile concurrently. Parsed profiles are
+shared by all readers in a process.
+"""
+import hashlib
+import os
+import tempfile
+import zlib
+
+from collections import OrderedDict
+from typing import Any, Callable, Dict, Optional, Tuple
+
+PROFILE_STORE_NAME = '.profiles'
+DIGEST_SIZE = 16
+
+# Number of parsed profiles shared per process. The generic profile is used
+# by every result, normalised profiles only by a few.
+SHARED_PROFILES = 64
+
+
+def profile_digest(encoding: int, raw: bytes) -> str:
+    return hashlib.blake2b(bytes([encoding]) + raw, digest_size=DIGEST_SIZE).hexdigest()
+
+
+def write_atomically(path: str, data: bytes) -> None:
+    fd, tmp_path = tempfile.mkstemp(dir=os.path.dirname(path), prefix='.tmp')
+    try:
+        with os.fdopen(fd, 'wb') as outfile:
+            outfile.write(data)
+        # Readable like the results themselves, not only by their writer
+        os.chmod(tmp_path, 0o644)
+        os.replace(tmp_path, path)
+    except BaseException:
+        os.unlink(tmp_path)
+        raise
+
+
+class ProfileStore:
+    """
+    A directory of profiles, each stored as the byte of its encoding followed
+    by the zlib-compressed encoded profile.
+    """
+
+    def __init__(self, path: str) -> None:
+        self.path = path
+
+    def blob_path(self, digest: str) -> str:
+        return os.path.join(self.path, digest[:2], digest)
+
+    def put(self, encoding: int, raw: bytes) -> str:
+        """
+        Adds an encoded profile, unless already stored. Returns its digest.
+        """
+        digest = profile_digest(encoding, raw)
+        path = self.blob_path(digest)
+        if not os.path.exists(path):
+            os.makedirs(os.path.dirname(path), exist_ok=True)
+            write_atomically(path, bytes([encoding]) + zlib.compress(raw))
+        return digest
+
+    def get(self, digest: str) -> Tuple[int, bytes]:
+        """
+        Returns the encoding and the encoded profile.
+        """
+        try:
+            with open(self.blob_path(digest), 'rb') as infile:
+                data = infile.read()
+        except FileNotFoundError:
+            raise ValueError(f"Profile {digest} missing from {self.path}") from None
+        if not data:
+            raise ValueError(f"Profile {digest} is empty")
+        encoding, raw = data[0], zlib.decompress(data[1:])
+        if profile_digest(encoding, raw) != digest:
+            raise ValueError(f"Profile {digest} does not match its digest")
+        return encoding, raw
+
+
+# Stores by path, and the stores found for directories. Directories without a
+# store are looked up again, as it may be created later.
+profile_stores: Dict[str, ProfileStore] = dict()
+store_lookups: Dict[str, str] = dict()
+
+
+def open_profile_store(path: str) -> ProfileStore:
+    """
+    Returns the store at `path`, shared within this process.
+    """
+    path = os.path.abspath(path)
+    if path not in profile_stores:
+        profile_stores[path] = ProfileStore(path)
+    return profile_stores[path]
+
+
+def find_profile_store(directory: str) -> Optional[ProfileStore]:
+    """
+    Returns the store in `directory` or the closest of its parents, if any.
+    """
+    directory = os.path.abspath(directory)
+    if directory not in store_lookups:
+        current = directory
+        while True:
+            candidate = os.path.join(current, PROFILE_STORE_NAME)
+            if os.path.isdir(candidate):
+                store_lookups[directory] = candidate
+                break
+            parent = os.path.dirname(current)
+            if parent == current:
+                return None
+            current = parent
+    return open_profile_store(store_lookups[directory])
+
+
+shared_profiles: 'OrderedDict[str, Any]' = OrderedDict()
+
+
+def shared_profile(digest: str, load: Callable[[], Any]) -> Any:
+    """
+    Returns the parsed profile with the given digest, shared by all readers
+    in this process, calling `load` to parse it if it is not cached. Shared
+    profiles must not be modified.
+    """
+    if digest in shared_profiles:
+        shared_profiles.move_to_end(digest)
+        return shared_profiles[digest]
+    profile = load()
+    shared_profiles[digest] = profile
+    if len(shared_profiles) > SHARED_PROFILES:
+        shared_profiles.popitem(last=False)
+    return profile
@@ -0,0 +1,144 @@
+"""
+Automata for SBPL regular expressions, which have to agree with the regular
+expressions of the portable evaluator.
+
+Run with `python3 -m unittest discover tests`.
+"""
+import itertools
+import os
+import re
+import sys
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+from sbprofiles.automata import MAX_REPEAT, escape, includes, intersects, regex_matches
+
+# Regexes without POSIX classes, which Python understands alike
+PATTERNS = [
+    '^/a/.*',
+    '^/a/b[0-9]$',
+    '^/a/(b|cd)+$',
+    '^/a/[^/]*$',
+    'b{2,3}',
+    '^(x|y){2}$',
+    '^/a/b?c$',
+    '\\.plist$',
+    '^/a/[]x-]$',
+    '[.]p',
+    '^$',
+    'a|^b',
+]
+
+TEXTS = [
+    '', '/', '/a', '/a/', '/a/b', '/a/b1', '/a/b12', '/a/bcd', '/a/cdb', '/a/b/c',
+    '/a/c', '/a/bc', 'bb', 'abbbb', 'xy', 'xyx', 'x.plist', 'xplist', '/a/]',
+    '/a/-', 'b', 'ba', 'xa', '/x/a/b',
+]
+
+
+class RegexMatchesTest(unittest.TestCase):
+
+    def test_agrees_with_re(self):
+        for pattern, text in itertools.product(PATTERNS, TEXTS):
+            with self.subTest(pattern=pattern, text=text):
+                self.assertEqual(regex_matches(pattern, text), re.search(pattern, text) is not None)
+
+    def test_posix_classes(self):
+        equivalents = {
+            '^[[:digit:]]+$': '^[0-9]+$',
+            '^[[:alpha:]_][[:alnum:]]*$': '^[A-Za-z_][0-9A-Za-z]*$',
+            '[[:space:]]': '[\t-\r ]',
+            '^[^[:upper:]]$': '^[^A-Z]$',
+        }
+        for pattern, equivalent in equivalents.items():
+            for text in ['', '0', '42', 'a1', '_x', '1a', 'A', 'a b', '\t', 'é']:
+                with self.subTest(pattern=pattern, text=text):
+                    self.assertEqual(regex_matches(pattern, text), re.search(equivalent, text) is not None)
+
+    def test_escape(self):
+        text = '/a/b.c(d)[e]{1}+?*|^$\\'
+        self.assertTrue(regex_matches('^' + escape(text) + '$', text))
+        self.assertFalse(regex_matches('^' + escape(text) + '$', text + 'x'))
+
+    def test_unsupported(self):
+        self.assertIsNone(regex_matches('\\w+', 'a'))
+        self.assertIsNone(regex_matches('(a', 'a'))
+        self.assertIsNone(regex_matches('a{%d}' % (MAX_REPEAT + 1), 'a'))
+
+
+class IncludesTest(unittest.TestCase):
+
+    def test_anchors(self):
+        self.assertTrue(includes('^/a/', '^/a/b$'))
+        self.assertTrue(includes('/a/', '^/a/b'))
+        self.assertFalse(includes('^/a/', '/a/b'))
+        self.assertFalse(includes('^/a/b$', '^/a/b'))
+        self.assertTrue(includes('b', '^/a/b$'))
+        self.assertTrue(includes('^/a/.*', '^/a/b[0-9]$'))
+        self.assertFalse(includes('^/a/b[0-9]$', '^/a/.*'))
+
+    def test_brackets(self):
+        self.assertTrue(includes('^[a-z]$', '^[b-d]$'))
+        self.assertFalse(includes('^[a-c]$', '^[b-d]$'))
+        self.assertTrue(includes('^[^/]$', '^[a-z]$'))
+        self.assertFalse(includes('^[^/]$', '^.$'))
+        self.assertTrue(includes('^[]a]$', '^]$'))
+
+    def test_posix_classes(self):
+        self.assertTrue(includes('^[[:alnum:]]+$', '^[[:digit:]]+$'))
+        self.assertTrue(includes('^[[:alnum:]]+$', '^[0-9a-f]+$'))
+        self.assertFalse(includes('^[[:digit:]]+$', '^[[:xdigit:]]+$'))
+        self.assertTrue(includes('^[[:xdigit:]]$', '^[A-F]$'))
+
+    def test_bounds(self):
+        self.assertTrue(includes('^a{1,3}$', '^a{2}$'))
+        self.assertTrue(includes('^a{1,}$', '^aa+$'))
+        self.assertFalse(includes('^a{1,3}$', '^a{2,4}$'))
+        self.assertTrue(includes('^a*$', '^a{0,5}$'))
+        self.assertTrue(includes('^x{$', '^x{$'))
+        self.assertTrue(includes('^x.$', '^x{$'))
+
+    def test_alternation(self):
+        self.assertTrue(includes('^/(a|b)/', '^/a/c$'))
+        self.assertTrue(includes('^/a|^/b', '^/b/c'))
+        self.assertFalse(includes('^/a/(c|d)$', '^/a/(c|e)$'))
+        self.assertTrue(includes('^(ab|a)(c|bc)$', '^abc$'))
+
+    def test_undecided(self):
+        self.assertIsNone(includes('^\\d$', '^1$'))
+        self.assertIsNone(includes('^.*$', '^(a'))
+
+
+class IntersectsTest(unittest.TestCase):
+
+    def test_anchors(self):
+        self.assertTrue(intersects('^/a/', '/b$'))
+        self.assertFalse(intersects('^/a$', '^/b$'))
+        self.assertTrue(intersects('^/a', 'b$'))
+        self.assertFalse(intersects('^$', '.'))
+        self.assertTrue(intersects('^$', 'x*'))
+
+    def test_brackets(self):
+        self.assertTrue(intersects('^[a-c]$', '^[c-e]$'))
+        self.assertFalse(intersects('^[a-c]$', '^[d-f]$'))
+        self.assertFalse(intersects('^[^a]$', '^a$'))
+
+    def test_posix_classes(self):
+        self.assertFalse(intersects('^[[:digit:]]+$', '^[[:alpha:]]+$'))
+        self.assertTrue(intersects('^[[:alnum:]]$', '^[[:punct:][:digit:]]$'))
+        self.assertFalse(intersects('^[[:upper:]]$', '^[[:lower:]]$'))
+
+    def test_bounds(self):
+        self.assertTrue(intersects('^a{2,4}$', '^a{4,6}$'))
+        self.assertFalse(intersects('^a{2,3}$', '^a{4,}$'))
+        self.assertFalse(intersects('^(ab){2}$', '^ab$'))
+
+    def test_alternation(self):
+        self.assertTrue(intersects('^/(a|b)$', '^/(b|c)$'))
+        self.assertFalse(intersects('^/(a|b)$', '^/(c|d)$'))
+        self.assertTrue(intersects('^/x/(a|b)c', 'bc$'))
+
+
+if __name__ == '__main__':
+    unittest.main()
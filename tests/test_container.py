@@ -0,0 +1,127 @@
+"""
+Round trips of results containers, which have to load as the JSON written by
+`dump_state`.
+
+Run with `python3 -m unittest discover tests`.
+"""
+import io
+import json
+import os
+import sys
+import tempfile
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+from sbresults.container import STORED, ResultsContainer, serialise, write_container
+from sbresults.store import ProfileStore
+
+GENERIC_PROFILE = [
+    {'action': 'deny', 'operations': ['default']},
+    {'action': 'allow', 'operations': ['file-read*'],
+     'filters': [{'name': 'subpath', 'arguments': [{'type': 'string', 'value': '/$_HOME$/Library'}]}]},
+]
+
+
+def example_state() -> dict:
+    """
+    Returns a state as written by the driver, with values as later stages
+    leave them, e.g. byte strings and integer keys.
+    """
+    raw_logs = [
+        {'eventMessage': f'Sandbox: App(42) allow file-read-data /Users/al/{i}', 'processID': 42}
+        for i in range(12)
+    ]
+    processed_logs = [
+        {'operation': 'file-read-data', 'argument': f'/Users/al/{i}', 'action': 'allow'}
+        for i in range(12)
+    ] + [{'operation': 'mach-lookup', 'action': 'deny'}]
+    return {
+        'arguments': {'app': '/Applications/App.app', 'strategy': 'linear', 'timeout': None},
+        'container_metadata': b'bplist00\x00\x01\x02',
+        'logs': {'raw': raw_logs, 'processed': processed_logs},
+        'process_infos': {'pid': 42, 'stdout': '', 'stderr': ''},
+        'sandbox_profiles': {
+            'original': json.dumps(GENERIC_PROFILE).encode(),
+            'patched': b'\x00\x80compiled',
+            'general': GENERIC_PROFILE,
+        },
+        'match_results': {
+            'rule_deciding_for_log_entries': {2: [0, 1, 5], 10: [12]},
+            'rule_redundant_for_log_entries': {},
+            'unmatched_log_entries': [3, 4],
+            'shadowed_rules': {},
+        },
+        'match_stats': {'runs': 3},
+    }
+
+
+def dumped(state: dict) -> str:
+    out = io.StringIO()
+    json.dump(serialise(state), out, indent=4, sort_keys=True)
+    return out.getvalue()
+
+
+def written(state: dict, store=None) -> bytes:
+    out = io.BytesIO()
+    write_container(state, out, store)
+    return out.getvalue()
+
+
+class ContainerTest(unittest.TestCase):
+
+    def test_export_matches_dump(self):
+        container = ResultsContainer(written(example_state()))
+        out = io.StringIO()
+        container.export_json(out)
+        self.assertEqual(out.getvalue(), dumped(example_state()))
+        self.assertEqual(container.load(), json.loads(dumped(example_state())))
+
+    def test_lazy_section(self):
+        container = ResultsContainer(written(example_state()))
+        expected = json.loads(dumped(example_state()))
+        decoded = []
+        decode = container.decode
+        container.decode = lambda section: decoded.append(section) or decode(section)
+
+        state = container.state()
+        self.assertEqual(state['match_results']['unmatched_log_entries'], [3, 4])
+        self.assertEqual(state['process_infos'], expected['process_infos'])
+        # The state itself and the single section accessed
+        self.assertEqual(len(decoded), 2)
+        self.assertEqual(sorted(state), sorted(expected))
+
+    def test_stored_profiles(self):
+        with tempfile.TemporaryDirectory() as tempdir:
+            store = ProfileStore(os.path.join(tempdir, '.profiles'))
+            data = written(example_state(), store)
+            blobs = sum(len(files) for _, _, files in os.walk(store.path))
+            # The original profile is the generic profile, stored once.
+            self.assertEqual(blobs, 2)
+
+            container = ResultsContainer(data, store)
+            stored = [info for info in container.sections if info.compression == STORED]
+            self.assertEqual(len(stored), 2)
+            self.assertTrue(all(info.size == 0 for info in stored))
+            self.assertEqual(container.state()['sandbox_profiles']['general'], GENERIC_PROFILE)
+            self.assertEqual(container.load(), json.loads(dumped(example_state())))
+
+            with self.assertRaises(ValueError):
+                ResultsContainer(data).load()
+
+    def test_corrupted_section(self):
+        data = bytearray(written(example_state()))
+        container = ResultsContainer(bytes(data))
+        section = container.values[('logs', 'processed')]
+        info = container.sections[section]
+        data[info.offset + info.size // 2] ^= 0xff
+
+        container = ResultsContainer(bytes(data))
+        with self.assertRaisesRegex(ValueError, 'Checksum mismatch of section logs/processed'):
+            container.state()['logs']['processed']
+        # Other sections are still readable.
+        self.assertEqual(container.state()['match_results']['unmatched_log_entries'], [3, 4])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,80 @@
+"""
+Matching log entries against the generic profile, with the concrete values of
+an app substituted for its placeholders.
+
+Run with `python3 -m unittest discover tests`.
+"""
+import os
+import sys
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+from sblogs.generic import concrete_generic_profile, perform_generic_matching
+
+
+def rule(action, operations, name, value):
+    return {
+        'action': action,
+        'operations': operations,
+        'filters': [{'name': name, 'arguments': [{'type': 'string', 'value': value}]}],
+    }
+
+
+# The bundle ID and the container ID of an app are usually the same.
+REPLACEMENTS = {
+    '/$_HOME$': '/Users/al',
+    '$_USER$': 'al',
+    '$APPLICATION_BUNDLE_ID$': 'com.example.App',
+    '$APPLICATION_CONTAINER_ID$': 'com.example.App',
+}
+
+GENERIC_PROFILE = [
+    {'action': 'deny', 'operations': ['default']},
+    rule('allow', ['file-read*'], 'subpath', '/$_HOME$/Library/Containers/$APPLICATION_CONTAINER_ID$'),
+    rule('allow', ['mach-lookup'], 'global-name', '$APPLICATION_BUNDLE_ID$.helper'),
+    rule('allow', ['file-read*'], 'path-regex', r'^/\$_HOME\$/Library/Preferences/\$APPLICATION_BUNDLE_ID\$\.plist$'),
+]
+
+LOGS = [
+    {'operation': 'file-read-data', 'argument': '/Users/al/Library/Containers/com.example.App/Data', 'action': 'allow'},
+    {'operation': 'mach-lookup', 'argument': 'com.example.App.helper', 'action': 'allow'},
+    {'operation': 'file-read-data', 'argument': '/Users/al/Library/Preferences/com.example.App.plist', 'action': 'allow'},
+    {'operation': 'file-read-data', 'argument': '/Users/al/Library/Preferences/com.example.AppXplist', 'action': 'deny'},
+    {'operation': 'file-read-data', 'argument': '/Applications/alarm.app', 'action': 'deny'},
+]
+
+
+class ConcreteGenericProfileTest(unittest.TestCase):
+
+    def test_placeholders_sharing_a_value(self):
+        profile = concrete_generic_profile(GENERIC_PROFILE, REPLACEMENTS)
+        values = [sb_rule['filters'][0]['arguments'][0]['value'] for sb_rule in profile[1:]]
+        self.assertEqual(values, [
+            '/Users/al/Library/Containers/com.example.App',
+            'com.example.App.helper',
+            r'^/Users/al/Library/Preferences/com\.example\.App\.plist$',
+        ])
+        self.assertEqual(profile[0], GENERIC_PROFILE[0])
+
+    def test_generic_profile_is_unchanged(self):
+        concrete_generic_profile(GENERIC_PROFILE, REPLACEMENTS)
+        self.assertEqual(GENERIC_PROFILE[1]['filters'][0]['arguments'][0]['value'],
+                         '/$_HOME$/Library/Containers/$APPLICATION_CONTAINER_ID$')
+
+    def test_matching(self):
+        state = {
+            'arguments': {'strategy': 'linear', 'skip_shadowed': True},
+            'logs': {'processed': LOGS},
+            'sandbox_profiles': {'general': GENERIC_PROFILE},
+            'normalisation_replacements': REPLACEMENTS,
+        }
+        success, state = perform_generic_matching(state)
+        self.assertTrue(success)
+        results = state['generic_match_results']
+        self.assertEqual(results['rule_deciding_for_log_entries'], {0: [3, 4], 1: [0], 2: [1], 3: [2]})
+        self.assertEqual(results['unmatched_log_entries'], [])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,70 @@
+"""
+Precedence of `default` rules, which the portable evaluator and the static
+shadowing analysis have to agree on.
+
+Run with `python3 -m unittest discover tests`.
+"""
+import os
+import sys
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+from sblogs.evaluate import PortableEvaluator, precedence_order
+from sbprofiles.shadowing import find_shadowed_rules
+
+
+def rule(action, operations, path=None):
+    result = {'action': action, 'operations': operations}
+    if path is not None:
+        result['filters'] = [{'name': 'subpath', 'arguments': [{'type': 'string', 'value': path}]}]
+    return result
+
+
+class PrecedenceTest(unittest.TestCase):
+
+    def test_order(self):
+        profile = [
+            rule('deny', ['default']),
+            rule('allow', ['file-read*']),
+            rule('allow', ['default']),
+            rule('deny', ['file-write*']),
+        ]
+        self.assertEqual(precedence_order(profile), [3, 1, 2, 0])
+
+    def test_specific_rules_override_later_default(self):
+        profile = [
+            rule('deny', ['file-read*'], '/private'),
+            rule('allow', ['default']),
+        ]
+        evaluator = PortableEvaluator()
+        self.assertEqual(evaluator.decide(profile, 'file-read-data', '/private/etc'), 'deny')
+        self.assertEqual(evaluator.decide(profile, 'file-read-data', '/usr/lib'), 'allow')
+        self.assertEqual(evaluator.decide(profile, 'mach-lookup', 'com.apple.foo'), 'allow')
+
+    def test_last_default_rule_decides(self):
+        profile = [
+            rule('allow', ['default']),
+            rule('deny', ['default']),
+        ]
+        self.assertEqual(PortableEvaluator().decide(profile, 'mach-lookup', None), 'deny')
+
+    def test_default_rules_do_not_shadow(self):
+        profile = [
+            rule('deny', ['file-read*'], '/private'),
+            rule('allow', ['default']),
+        ]
+        self.assertEqual(find_shadowed_rules(profile), {})
+
+    def test_specific_rules_shadow_across_default(self):
+        profile = [
+            rule('allow', ['file-read*'], '/private/etc'),
+            rule('deny', ['default']),
+            rule('deny', ['file-read*'], '/private'),
+        ]
+        self.assertEqual(find_shadowed_rules(profile), {0: [2]})
+        self.assertEqual(PortableEvaluator().decide(profile, 'file-read-data', '/private/etc/hosts'), 'deny')
+
+
+if __name__ == '__main__':
+    unittest.main()
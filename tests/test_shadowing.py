@@ -0,0 +1,102 @@
+"""
+Coverage of filters by other filters, which decides statically shadowed rules.
+
+Run with `python3 -m unittest discover tests`.
+"""
+import os
+import sys
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+from sbprofiles.shadowing import filter_covers, find_shadowed_rules, parse_filter
+
+
+def literal(value):
+    return 'path', 'literal', value
+
+
+def prefix(value):
+    return 'path', 'prefix', value
+
+
+def subpath(value):
+    return 'path', 'subpath', value
+
+
+def regex(value):
+    return 'path', 'regex', value
+
+
+class FilterCoversTest(unittest.TestCase):
+
+    def test_literal(self):
+        self.assertTrue(filter_covers(literal('/a/b'), literal('/a/b')))
+        self.assertFalse(filter_covers(literal('/a/b'), literal('/a/bc')))
+        self.assertFalse(filter_covers(literal('/a'), subpath('/a')))
+        self.assertFalse(filter_covers(literal('/a'), prefix('/a')))
+
+    def test_prefix(self):
+        self.assertTrue(filter_covers(prefix('/a/b'), literal('/a/bc')))
+        self.assertTrue(filter_covers(prefix('/a/b'), prefix('/a/bc')))
+        self.assertTrue(filter_covers(prefix('/a/'), subpath('/a/b')))
+        self.assertFalse(filter_covers(prefix('/a/b'), literal('/a/c')))
+        self.assertFalse(filter_covers(prefix('/a/bc'), prefix('/a/b')))
+        # The subpath also matches `/a/b` itself.
+        self.assertFalse(filter_covers(prefix('/a/b/'), subpath('/a/b')))
+
+    def test_subpath(self):
+        self.assertTrue(filter_covers(subpath('/a'), literal('/a')))
+        self.assertTrue(filter_covers(subpath('/a'), literal('/a/b')))
+        self.assertTrue(filter_covers(subpath('/a/'), literal('/a/b')))
+        self.assertTrue(filter_covers(subpath('/a'), subpath('/a/b')))
+        self.assertTrue(filter_covers(subpath('/a'), prefix('/a/b')))
+        self.assertFalse(filter_covers(subpath('/a'), literal('/ab')))
+        self.assertFalse(filter_covers(subpath('/a'), prefix('/a')))
+        self.assertFalse(filter_covers(subpath('/a/b'), subpath('/a')))
+
+    def test_regex(self):
+        self.assertTrue(filter_covers(regex('^/a/[^/]+$'), literal('/a/b')))
+        self.assertFalse(filter_covers(regex('^/a/[^/]+$'), literal('/a/b/c')))
+        self.assertTrue(filter_covers(regex('^/a/'), subpath('/a/b')))
+        self.assertFalse(filter_covers(regex('^/a/b/'), subpath('/a/b')))
+        self.assertTrue(filter_covers(regex('^/a/.*\\.plist$'), regex('^/a/b/[[:alnum:]]+\\.plist$')))
+        self.assertFalse(filter_covers(regex('^/a/[^/]*\\.plist$'), regex('^/a/.*\\.plist$')))
+        self.assertTrue(filter_covers(subpath('/a'), regex('^/a/(b|c)$')))
+        self.assertFalse(filter_covers(prefix('/a/b'), regex('^/a/(b|c)$')))
+        self.assertTrue(filter_covers(literal('/a/b'), regex('^/a/b$')))
+        # Undecided regexes do not cover anything.
+        self.assertFalse(filter_covers(regex('^/a/\\w+$'), literal('/a/b')))
+
+    def test_domains(self):
+        self.assertFalse(filter_covers(('global-name', 'prefix', '/a'), literal('/a/b')))
+        self.assertTrue(filter_covers(('global-name', 'prefix', 'com.'), ('global-name', 'literal', 'com.apple')))
+
+    def test_simplified_regex(self):
+        def path_regex(value):
+            return parse_filter({'name': 'path-regex', 'arguments': [{'type': 'string', 'value': value}]})
+
+        self.assertEqual(path_regex('^/a/b$'), literal('/a/b'))
+        self.assertEqual(path_regex('^/a/b'), prefix('/a/b'))
+        self.assertEqual(path_regex('^/a/b(/|$)'), subpath('/a/b'))
+        self.assertEqual(path_regex('^/a/[[:digit:]]$'), regex('^/a/[[:digit:]]$'))
+        self.assertTrue(filter_covers(path_regex('^/a(/|$)'), path_regex('^/a/b\\.c$')))
+
+    def test_shadowed_rules(self):
+        def rule(filters):
+            return {'action': 'allow', 'operations': ['file-read*'], 'filters': filters}
+
+        def path_filter(name, value):
+            return {'name': name, 'arguments': [{'type': 'string', 'value': value}]}
+
+        profile = [
+            rule([path_filter('literal', '/a/b')]),
+            rule([path_filter('path-regex', '^/c/[0-9]+$')]),
+            rule([path_filter('subpath', '/a')]),
+            rule([path_filter('path-regex', '^/c/[[:digit:]]*$')]),
+        ]
+        self.assertEqual(find_shadowed_rules(profile), {0: [2], 1: [3]})
+
+
+if __name__ == '__main__':
+    unittest.main()